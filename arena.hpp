@@ -0,0 +1,105 @@
+#ifndef ARENA
+#define ARENA
+#include "mainrepl_struct.hpp"
+
+//scratch memory of the calling thread, for its statements and the write batches of checkpoints and write-back
+__thread Arena statement_arena = {NULL, NULL};
+
+/*
+*function to make a block for an arena
+*@param capacity    bytes the block holds after its header
+*@returns pointer to the block
+*/
+ArenaBlock* arena_block_new(size_t capacity){
+    ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + capacity);
+    if(block == NULL){
+        printf("Unable to allocate %zu bytes of statement memory.\n", capacity);
+        exit(EXIT_FAILURE);
+    }
+    block->next     = NULL;
+    block->capacity = capacity;
+    block->used     = 0;
+    return block;
+}
+
+/*
+*function to get the position to release an arena back to
+*@param arena       pointer to the arena
+*@returns the mark
+*/
+ArenaMark arena_mark(Arena* arena){
+    if(arena->first == NULL){
+        arena->first    = arena_block_new(ARENA_BLOCK_SIZE);
+        arena->current  = arena->first;
+    }
+    ArenaMark mark = {arena->current, arena->current->used};
+    return mark;
+}
+
+/*
+*function to give back everything allocated after a mark, the blocks stay with the arena
+*@param arena       pointer to the arena
+*@param mark        mark from arena_mark
+*/
+void arena_release(Arena* arena, ArenaMark mark){
+    arena->current          = mark.block;
+    arena->current->used    = mark.used;
+}
+
+/*
+*function to allocate from an arena, the memory lives until the arena is released past it,
+*a spare block is reused before a new one is made so a statement that ran once allocates nothing the next time
+*@param arena       pointer to the arena
+*@param size        bytes wanted
+*@returns pointer to the memory, aligned to ARENA_ALIGNMENT
+*/
+void* arena_alloc(Arena* arena, size_t size){
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if(arena->first == NULL)
+        arena_mark(arena);
+
+    ArenaBlock* block = arena->current;
+    if(block->capacity - block->used < size){
+        //a spare too small for the request is left where it is, a new block goes before it
+        if(block->next != NULL && block->next->capacity >= size)
+            block = block->next;
+        else{
+            ArenaBlock* spare = block->next;
+            block           = arena_block_new(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+            block->next     = spare;
+            arena->current->next = block;
+        }
+        block->used     = 0;
+        arena->current  = block;
+    }
+
+    //the header is a multiple of the alignment, so are all offsets into the block
+    void* memory    = (char*)(block + 1) + block->used;
+    block->used    += size;
+    return memory;
+}
+
+/*
+*function to grow the last allocation of an arena, or move it to a larger one
+*@param arena       pointer to the arena
+*@param memory      the allocation, from arena_alloc
+*@param old_size    bytes it has
+*@param new_size    bytes wanted
+*@returns pointer to the memory, the old bytes copied over
+*/
+void* arena_grow(Arena* arena, void* memory, size_t old_size, size_t new_size){
+    ArenaBlock* block       = arena->current;
+    size_t      aligned_old = (old_size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    size_t      aligned_new = (new_size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    //the last allocation of the current block grows in place when the block has room
+    if((char*)memory + aligned_old == (char*)(block + 1) + block->used &&
+       block->capacity - (block->used - aligned_old) >= aligned_new){
+        block->used += aligned_new - aligned_old;
+        return memory;
+    }
+    void* grown = arena_alloc(arena, new_size);
+    memcpy(grown, memory, old_size);
+    return grown;
+}
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef BTREE
 #define BTREE
 #include "mainrepl_struct.hpp"
+#include "key_search.hpp"
 
 /*
 *function to check if a node is root node
@@ -31,21 +32,44 @@ uint32_t* leaf_node_num_cells(void* node){
     return (uint32_t*)(node + LEAF_NODE_NUM_CELLS_OFFSET);
 }
 
+/*
+*funtion to get the key for a given cell number
+*@param node        pointer to a node
+*@param cell_num    cell number to get the key
+*@returns pointer to the node key
+*/
+uint32_t* leaf_node_key(void* node, uint32_t cell_num){
+    return (uint32_t*)((uint8_t*)node + LEAF_NODE_KEYS_OFFSET + cell_num * LEAF_NODE_KEY_SIZE);
+}
+
+/*
+*function to get the offset of a cell from the slot array, it starts after the last key
+*@param node        pointer to a node
+*@param cell_num    cell number to get the slot of
+*@returns a pointer to the offset of the cell in the page
+*/
+uint16_t* leaf_node_slot(void* node, uint32_t cell_num){
+    return (uint16_t*)((uint8_t*)leaf_node_key(node, *leaf_node_num_cells(node)) + cell_num * LEAF_NODE_SLOT_SIZE);
+}
+
 /*
 *function to return a cell
 *@param node        pointer to a node
 *@param cell_num    cell number to get
 *@returns a pointer to a cell in a node
-*/void* leaf_node_cell(void* node, uint32_t cell_num){
-    return node + LEAF_NODE_HEADER_SIZE + (cell_num * LEAF_NODE_CELL_SIZE);
+*/
+void* leaf_node_cell(void* node, uint32_t cell_num){
+    return (uint8_t*)node + *leaf_node_slot(node, cell_num);
 }
+
 /*
-*funtion to get the key for a given cell number
+*function to get the payload size of a cell
 *@param node        pointer to a node
-*@param cell_num    cell number to get the key
-*@returns pointer to the node key
-*/uint32_t* leaf_node_key(void* node, uint32_t cell_num){
-    return (uint32_t*)leaf_node_cell(node, cell_num);
+*@param cell_num    cell number to get the payload size
+*@returns a pointer to the payload size
+*/
+uint16_t* leaf_node_payload_size(void* node, uint32_t cell_num){
+    return (uint16_t*)((uint8_t*)leaf_node_cell(node, cell_num) + LEAF_NODE_PAYLOAD_SIZE_OFFSET);
 }
 
 /*
@@ -55,7 +79,160 @@ uint32_t* leaf_node_num_cells(void* node){
 *@returns a pointer to the node value
 */
 void* leaf_node_value(void* node, uint32_t cell_num){
-    return leaf_node_cell(node, cell_num) + LEAF_NODE_KEY_SIZE;
+    return (uint8_t*)leaf_node_cell(node, cell_num) + LEAF_NODE_VALUE_OFFSET;
+}
+
+/*
+*function to get the space a cell takes in the page
+*@param payload_size    size of the payload of the cell
+*@returns size of the cell in bytes, not counting its slot
+*/
+uint32_t leaf_node_cell_size(uint32_t payload_size){
+    uint32_t size = LEAF_NODE_VALUE_OFFSET + payload_size;
+    return (size + LEAF_NODE_CELL_ALIGNMENT - 1) & ~(LEAF_NODE_CELL_ALIGNMENT - 1);
+}
+
+/*
+*function to get the start of the cell content area, the lowest cell offset in the page
+*@param node    pointer to a node
+*@returns a pointer to the offset
+*/
+uint16_t* leaf_node_content_start(void* node){
+    return (uint16_t*)((uint8_t*)node + LEAF_NODE_CONTENT_START_OFFSET);
+}
+
+/*
+*function to get the bytes of the content area left unused by removed cells
+*@param node    pointer to a node
+*@returns a pointer to the number of bytes
+*/
+uint16_t* leaf_node_fragmented(void* node){
+    return (uint16_t*)((uint8_t*)node + LEAF_NODE_FRAGMENTED_OFFSET);
+}
+
+/*
+*function to get the bytes used by the cells and slots of a leaf node
+*@param node    pointer to a node
+*@returns number of bytes used
+*/
+uint32_t leaf_node_used_space(void* node){
+    return PAGE_SIZE - *leaf_node_content_start(node) - *leaf_node_fragmented(node)
+           + *leaf_node_num_cells(node) * LEAF_NODE_CELL_OVERHEAD;
+}
+
+/*
+*function to get the free space of a leaf node, counting the fragmented bytes
+*@param node    pointer to a node
+*@returns number of bytes free
+*/
+uint32_t leaf_node_free_space(void* node){
+    return LEAF_NODE_SPACE_FOR_CELLS - leaf_node_used_space(node);
+}
+
+/*
+*function to check if a cell fits in a leaf node
+*@param node            pointer to a node
+*@param payload_size    size of the payload of the cell
+*@returns true if the cell, its key and its slot fit
+*/
+bool leaf_node_fits(void* node, uint32_t payload_size){
+    return leaf_node_cell_size(payload_size) + LEAF_NODE_CELL_OVERHEAD <= leaf_node_free_space(node);
+}
+
+/*
+*function to move the cells of a leaf node to the end of the page,
+*so the free space left by removed cells is contiguous again
+*@param node    pointer to a node
+*/
+void leaf_node_defragment(void* node){
+    char        copy[PAGE_SIZE];
+    uint32_t    num_cells   = *leaf_node_num_cells(node);
+    uint32_t    offset      = PAGE_SIZE;
+
+    memcpy(copy, node, PAGE_SIZE);
+    for(uint32_t i = 0; i < num_cells; i++){
+        uint32_t size = leaf_node_cell_size(*leaf_node_payload_size(copy, i));
+        offset -= size;
+        memcpy((uint8_t*)node + offset, leaf_node_cell(copy, i), size);
+        *leaf_node_slot(node, i) = offset;
+    }
+    *leaf_node_content_start(node)  = offset;
+    *leaf_node_fragmented(node)     = 0;
+}
+
+/*
+*function to make room for a cell in a leaf node, the caller checks it fits
+*@param node            pointer to a node
+*@param cell_num        position of the new cell, later cells shift right
+*@param key             key of the new cell
+*@param payload_size    size of the payload, the caller writes it to leaf_node_value
+*/
+void leaf_node_insert_cell(void* node, uint32_t cell_num, uint32_t key, uint32_t payload_size){
+    uint32_t num_cells  = *leaf_node_num_cells(node);
+    uint32_t size       = leaf_node_cell_size(payload_size);
+
+    //compared without subtracting, the content start can be below the cell size
+    if(*leaf_node_content_start(node) < size + LEAF_NODE_KEYS_OFFSET + (num_cells + 1) * LEAF_NODE_CELL_OVERHEAD)
+        leaf_node_defragment(node);
+
+    //the slot array moves up by a key, the slots from cell_num by one more slot
+    uint8_t* old_slots = (uint8_t*)leaf_node_slot(node, 0);
+    uint8_t* new_slots = old_slots + LEAF_NODE_KEY_SIZE;
+    memmove(new_slots + (cell_num + 1) * LEAF_NODE_SLOT_SIZE, old_slots + cell_num * LEAF_NODE_SLOT_SIZE,
+            (num_cells - cell_num) * LEAF_NODE_SLOT_SIZE);
+    memmove(new_slots, old_slots, cell_num * LEAF_NODE_SLOT_SIZE);
+    memmove(leaf_node_key(node, cell_num + 1), leaf_node_key(node, cell_num),
+            (num_cells - cell_num) * LEAF_NODE_KEY_SIZE);
+
+    uint32_t offset = *leaf_node_content_start(node) - size;
+    *leaf_node_content_start(node)              = offset;
+    *leaf_node_num_cells(node)                  = num_cells + 1;
+    *leaf_node_slot(node, cell_num)             = offset;
+    *leaf_node_key(node, cell_num)              = key;
+    *leaf_node_payload_size(node, cell_num)     = payload_size;
+}
+
+/*
+*function to copy a cell to the end of a leaf node
+*@param node    pointer to the node to append to
+*@param source  pointer to the node holding the cell
+*@param cell_num cell to copy
+*/
+void leaf_node_append_cell(void* node, void* source, uint32_t cell_num){
+    uint32_t payload_size   = *leaf_node_payload_size(source, cell_num);
+    uint32_t num_cells      = *leaf_node_num_cells(node);
+    leaf_node_insert_cell(node, num_cells, *leaf_node_key(source, cell_num), payload_size);
+    memcpy(leaf_node_value(node, num_cells), leaf_node_value(source, cell_num), payload_size);
+}
+
+/*
+*function to remove a cell from a leaf node, its space is reclaimed by the next defragment
+*@param node        pointer to a node
+*@param cell_num    cell to remove
+*/
+void leaf_node_remove_cell(void* node, uint32_t cell_num){
+    uint32_t num_cells  = *leaf_node_num_cells(node);
+    uint32_t offset     = *leaf_node_slot(node, cell_num);
+    uint32_t size       = leaf_node_cell_size(*leaf_node_payload_size(node, cell_num));
+
+    if(offset == *leaf_node_content_start(node))
+        *leaf_node_content_start(node) = offset + size;
+    else
+        *leaf_node_fragmented(node) += size;
+
+    //the keys close the gap, the slot array moves down by a key and the later slots by one more slot
+    uint8_t* old_slots = (uint8_t*)leaf_node_slot(node, 0);
+    uint8_t* new_slots = old_slots - LEAF_NODE_KEY_SIZE;
+    memmove(leaf_node_key(node, cell_num), leaf_node_key(node, cell_num + 1),
+            (num_cells - cell_num - 1) * LEAF_NODE_KEY_SIZE);
+    memmove(new_slots, old_slots, cell_num * LEAF_NODE_SLOT_SIZE);
+    memmove(new_slots + cell_num * LEAF_NODE_SLOT_SIZE, old_slots + (cell_num + 1) * LEAF_NODE_SLOT_SIZE,
+            (num_cells - cell_num - 1) * LEAF_NODE_SLOT_SIZE);
+    *leaf_node_num_cells(node) = num_cells - 1;
+    if(num_cells == 1){
+        *leaf_node_content_start(node)  = PAGE_SIZE;
+        *leaf_node_fragmented(node)     = 0;
+    }
 }
 
 /*
@@ -64,7 +241,7 @@ void* leaf_node_value(void* node, uint32_t cell_num){
 *@returns type of the node
 */
 NodeType get_node_type(void* node){
-    uint32_t value = *((uint32_t*)(node + NODE_TYPE_OFFSET));
+    uint8_t value = *((uint8_t*)(node + NODE_TYPE_OFFSET));
     return (NodeType)value;
 }
 
@@ -74,8 +251,8 @@ NodeType get_node_type(void* node){
 *@param type    node type to be set
 */
 void set_node_type(void* node, NodeType type){
-    uint32_t value = type;
-    *((uint32_t*)(node + NODE_TYPE_OFFSET)) = value;
+    uint8_t value = type;
+    *((uint8_t*)(node + NODE_TYPE_OFFSET)) = value;
 }
 
 /*
@@ -96,6 +273,8 @@ void initialize_leaf_node(void* node){
     set_node_root(node, false);
     *(leaf_node_num_cells(node)) = 0;
     *(leaf_node_next_leaf(node)) = 0;
+    *(leaf_node_content_start(node)) = PAGE_SIZE;
+    *(leaf_node_fragmented(node)) = 0;
 }
 
 /*
@@ -116,13 +295,13 @@ uint32_t* internal_node_right_child(void* node){
 }
 
 /*
-*function to get the internal node cell
+*function to get the internal node cell, the child left of key cell_num
 *@param node        pointer to a node
 *@param cell_num    cell number to read
-*@returns a pointer to a cell with node, cell_num 
+*@returns a pointer to the child page number of the cell
 */
 uint32_t* internal_node_cell(void* node, uint32_t cell_num){
-    return (uint32_t*)(node + INTERNAL_NODE_HEADER_SIZE + cell_num * INTERNAL_NODE_CELL_SIZE);
+    return (uint32_t*)((uint8_t*)node + INTERNAL_NODE_CHILDREN_OFFSET + cell_num * INTERNAL_NODE_CHILD_SIZE);
 }
 
 /*
@@ -151,7 +330,43 @@ uint32_t* internal_node_child(void* node, uint32_t child_num){
 *returns a pointer to the key of the passed cell
 */
 uint32_t* internal_node_key(void* node, uint32_t key_num){
-    return (uint32_t*)(internal_node_cell(node, key_num) + INTERNAL_NODE_CHILD_SIZE);
+    return (uint32_t*)((uint8_t*)node + INTERNAL_NODE_KEYS_OFFSET + key_num * INTERNAL_NODE_KEY_SIZE);
+}
+
+/*
+*function to get the number of rows under a child of an internal node
+*@param node        pointer to a node
+*@param child_num   child to get the count of, num_keys for the right child
+*@returns a pointer to the count
+*/
+uint32_t* internal_node_count(void* node, uint32_t child_num){
+    return (uint32_t*)((uint8_t*)node + INTERNAL_NODE_COUNTS_OFFSET + child_num * INTERNAL_NODE_COUNT_SIZE);
+}
+
+/*
+*function to get the number of rows under a node
+*@param node    pointer to a node
+*@returns the cells of a leaf or the sum of the counts of an internal node
+*/
+uint32_t node_row_count(void* node){
+    if(get_node_type(node) == NODE_LEAF)
+        return *leaf_node_num_cells(node);
+    uint32_t count = 0;
+    for(uint32_t i = 0; i <= *internal_node_num_keys(node); i++)
+        count += *internal_node_count(node, i);
+    return count;
+}
+
+/*
+*function to get a child of an internal node of a format 3 file, which has no counts
+*@param node        pointer to a node
+*@param child_num   child to get, num_keys for the right child
+*@returns a pointer to the child page number
+*/
+uint32_t* uncounted_internal_node_child(void* node, uint32_t child_num){
+    if(child_num == *internal_node_num_keys(node))
+        return internal_node_right_child(node);
+    return (uint32_t*)((uint8_t*)node + UNCOUNTED_INTERNAL_NODE_CHILDREN_OFFSET + child_num * INTERNAL_NODE_CHILD_SIZE);
 }
 
 /*
@@ -165,17 +380,178 @@ void initialize_internal_node(void* node){
 }
 
 /*
-*function to get the maximum value in a node
+*function to find the index of the child that holds a key in an internal node
+*@param node    pointer to an internal node
+*@param key     key to search
+*@returns index of the child to descend into, num_keys for the right child
+*/
+uint32_t internal_node_find_child(void* node, uint32_t key){
+    return key_lower_bound(internal_node_key(node, 0), *internal_node_num_keys(node), key);
+}
+
+/*
+*function to get a key of a secondary index leaf node, the number of keys and
+*the next leaf are kept where a table leaf keeps them
+*@param index       pointer to the index
+*@param node        pointer to a leaf node of the index
+*@param key_num     key to get
+*@returns a pointer to the key
+*/
+uint8_t* index_leaf_key(Index* index, void* node, uint32_t key_num){
+    return (uint8_t*)node + INDEX_NODE_BODY_OFFSET + key_num * index->key_size;
+}
+
+/*
+*function to get a child of a secondary index internal node, the number of keys and
+*the right child are kept where a table internal node keeps them
+*@param node        pointer to an internal node of the index
+*@param child_num   child to get, num_keys for the right child
+*@returns a pointer to the child page number
+*/
+uint32_t* index_internal_child(void* node, uint32_t child_num){
+    if(child_num == *internal_node_num_keys(node))
+        return internal_node_right_child(node);
+    return (uint32_t*)((uint8_t*)node + INDEX_NODE_BODY_OFFSET + child_num * INTERNAL_NODE_CHILD_SIZE);
+}
+
+/*
+*function to get a key of a secondary index internal node, the keys follow the children
+*@param index       pointer to the index
+*@param node        pointer to an internal node of the index
+*@param key_num     key to get
+*@returns a pointer to the key
+*/
+uint8_t* index_internal_key(Index* index, void* node, uint32_t key_num){
+    return (uint8_t*)node + INDEX_NODE_BODY_OFFSET + index->internal_max_keys * INTERNAL_NODE_CHILD_SIZE
+           + key_num * index->key_size;
+}
+
+/*
+*function to initialize a secondary index leaf node
 *@param node    pointer to a node
-*@returns maximum key value in a node
-*/
-uint32_t get_node_max_key(void* node){
-    switch(get_node_type(node)){
-        case NODE_INTERNAL:
-            return *internal_node_key(node, *internal_node_num_keys(node)-1);
-        case NODE_LEAF:
-            return *leaf_node_key(node, *leaf_node_num_cells(node)-1);
+*/
+void initialize_index_leaf_node(void* node){
+    set_node_type(node, NODE_LEAF);
+    set_node_root(node, false);
+    *(leaf_node_num_cells(node)) = 0;
+    *(leaf_node_next_leaf(node)) = 0;
+}
+
+/*
+*function to find the first key not smaller than a key in an array of index keys
+*@param keys        pointer to the sorted keys
+*@param num_keys    number of keys
+*@param key_size    size of a key
+*@param key         key to search
+*@returns index of the first key >= key, num_keys if there is none
+*/
+uint32_t index_key_lower_bound(const uint8_t* keys, uint32_t num_keys, uint32_t key_size, const uint8_t* key){
+    uint32_t lo = 0;
+    uint32_t hi = num_keys;
+    while(lo < hi){
+        uint32_t middle = (lo + hi) / 2;
+        if(memcmp(keys + middle * key_size, key, key_size) < 0)
+            lo = middle + 1;
+        else
+            hi = middle;
     }
+    return lo;
+}
+
+/*
+*function to find the position of a key in a secondary index node
+*@param index   pointer to the index
+*@param node    pointer to a node of the index
+*@param key     key to search
+*@returns for a leaf the first key >= key, for an internal node the child to descend into
+*/
+uint32_t index_node_find(Index* index, void* node, const uint8_t* key){
+    if(get_node_type(node) == NODE_LEAF)
+        return index_key_lower_bound(index_leaf_key(index, node, 0), *leaf_node_num_cells(node), index->key_size, key);
+    return index_key_lower_bound(index_internal_key(index, node, 0), *internal_node_num_keys(node), index->key_size, key);
+}
+
+/*
+*function to get the magic number of the db header page
+*@param page    pointer to the header page
+*@returns a pointer to the magic number
+*/
+uint32_t* db_header_magic(void* page){
+    return (uint32_t*)((uint8_t*)page + DB_HEADER_MAGIC_OFFSET);
+}
+
+/*
+*function to get the root page number of the table from the db header page
+*@param page    pointer to the header page
+*@returns a pointer to the root page number
+*/
+uint32_t* db_header_root_page(void* page){
+    return (uint32_t*)((uint8_t*)page + DB_HEADER_ROOT_PAGE_OFFSET);
+}
+
+/*
+*function to get the first free list trunk from the db header page
+*@param page    pointer to the header page
+*@returns a pointer to the page number of the first trunk, 0 when the free list is empty
+*/
+uint32_t* db_header_freelist_trunk(void* page){
+    return (uint32_t*)((uint8_t*)page + DB_HEADER_FREELIST_TRUNK_OFFSET);
+}
+
+/*
+*function to get the number of free pages from the db header page
+*@param page    pointer to the header page
+*@returns a pointer to the number of free pages, trunks included
+*/
+uint32_t* db_header_freelist_count(void* page){
+    return (uint32_t*)((uint8_t*)page + DB_HEADER_FREELIST_COUNT_OFFSET);
+}
+
+/*
+*function to get the file format version from the db header page
+*@param page    pointer to the header page
+*@returns a pointer to the format version
+*/
+uint32_t* db_header_format(void* page){
+    return (uint32_t*)((uint8_t*)page + DB_HEADER_FORMAT_OFFSET);
+}
+
+/*
+*function to get the root page number of the index of a column from the db header page
+*@param page    pointer to the header page
+*@param column  indexed column
+*@returns a pointer to the root page number, 0 when the column has no index
+*/
+uint32_t* db_header_index_root(void* page, Column column){
+    return (uint32_t*)((uint8_t*)page + DB_HEADER_INDEX_ROOTS_OFFSET + column * sizeof(uint32_t));
+}
+
+/*
+*function to get the next trunk of a free list trunk page
+*@param page    pointer to a trunk page
+*@returns a pointer to the page number of the next trunk, 0 for the last one
+*/
+uint32_t* freelist_trunk_next(void* page){
+    return (uint32_t*)((uint8_t*)page + FREELIST_TRUNK_NEXT_OFFSET);
+}
+
+/*
+*function to get the number of free pages listed in a trunk page
+*@param page    pointer to a trunk page
+*@returns a pointer to the number of entries
+*/
+uint32_t* freelist_trunk_count(void* page){
+    return (uint32_t*)((uint8_t*)page + FREELIST_TRUNK_COUNT_OFFSET);
+}
+
+/*
+*function to get a free page number listed in a trunk page
+*@param page        pointer to a trunk page
+*@param entry_num   entry to get
+*@returns a pointer to the free page number
+*/
+uint32_t* freelist_trunk_entry(void* page, uint32_t entry_num){
+    return (uint32_t*)((uint8_t*)page + FREELIST_TRUNK_HEADER_SIZE + entry_num * sizeof(uint32_t));
 }
 
 /*
@@ -183,12 +559,14 @@ uint32_t get_node_max_key(void* node){
 */
 void print_constants(){
     printf("------------------DB Constants------------------\n");
-    printf("Row size = %d.\n", ROW_SIZE);
+    printf("Max row payload size = %d.\n", ROW_MAX_PAYLOAD_SIZE);
     printf("Common node header size = %d.\n",COMMON_NODE_HEADER_SIZE );
     printf("Leaf node header size = %d.\n", LEAF_NODE_HEADER_SIZE);
-    printf("Leaf node cell size = %d.\n", LEAF_NODE_CELL_SIZE);
+    printf("Leaf node cell header size = %d.\n", LEAF_NODE_VALUE_OFFSET);
+    printf("Leaf node slot size = %d.\n", LEAF_NODE_SLOT_SIZE);
     printf("Leaf node space for cells = %d.\n", LEAF_NODE_SPACE_FOR_CELLS);
-    printf("Leaf node max number of cells = %d.\n", LEAF_NODE_MAX_CELLS);
+    printf("Leaf node max payload size = %d.\n", LEAF_NODE_MAX_PAYLOAD_SIZE);
+    printf("Internal node max keys = %d.\n", INTERNAL_NODE_MAX_KEYS);
     printf("-------------------------------------------------\n");
 }
 
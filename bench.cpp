@@ -0,0 +1,466 @@
+#include "repl_helpers.hpp"
+
+//benchmark of the tree and the pager, each result is the latency of every operation and the wall time of the run
+//usage: ./bench [--rows N] [--frames N] [--mmap] [--wal] [--file PATH] [--csv | --json] [--baseline CSV]
+
+#define BENCH_DEFAULT_ROWS      200000
+#define BENCH_DEFAULT_FILE      "bench.db"
+#define BENCH_MAX_RESULTS       16
+#define BENCH_NAME_SIZE         32
+#define BENCH_SCAN_REPEATS      5
+
+//how the results are printed
+typedef enum{
+    BENCH_OUTPUT_TEXT,
+    BENCH_OUTPUT_CSV,
+    BENCH_OUTPUT_JSON
+}BenchOutput;
+
+//latencies of one benchmark, the samples are sorted once it is finished
+typedef struct{
+    char        name[BENCH_NAME_SIZE];
+    uint64_t*   samples;            //ns per operation
+    uint32_t    num_samples;
+    uint32_t    capacity;
+    uint64_t    items;              //rows or pages the operations went through
+    uint64_t    wall_ns;            //time of the whole run
+}BenchResult;
+
+//settings of a run and the results so far
+typedef struct{
+    DbOptions   options;
+    uint32_t    rows;
+    const char* filename;
+    BenchOutput output;
+    const char* baseline;
+    BenchResult results[BENCH_MAX_RESULTS];
+    uint32_t    num_results;
+}Bench;
+
+/*
+*function to read the monotonic clock
+*@returns the time in ns
+*/
+uint64_t bench_now(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/*
+*function to start a new result
+*@param bench       pointer to the run
+*@param name        name of the benchmark
+*@param capacity    samples expected, more are made room for
+*@returns pointer to the result
+*/
+BenchResult* bench_result_new(Bench* bench, const char* name, uint32_t capacity){
+    if(bench->num_results == BENCH_MAX_RESULTS){
+        printf("Too many benchmark results.\n");
+        exit(EXIT_FAILURE);
+    }
+    BenchResult* result = &(bench->results[bench->num_results++]);
+    snprintf(result->name, BENCH_NAME_SIZE, "%s", name);
+    result->capacity    = capacity ? capacity : 1;
+    result->samples     = (uint64_t*)malloc(result->capacity * sizeof(uint64_t));
+    result->num_samples = 0;
+    result->items       = 0;
+    result->wall_ns     = 0;
+    return result;
+}
+
+/*
+*function to record the latency of an operation
+*@param result      pointer to the result
+*@param ns          latency in ns
+*/
+void bench_result_add(BenchResult* result, uint64_t ns){
+    if(result->num_samples == result->capacity){
+        result->capacity    *= 2;
+        result->samples     = (uint64_t*)realloc(result->samples, result->capacity * sizeof(uint64_t));
+    }
+    result->samples[result->num_samples++] = ns;
+}
+
+/*
+*function to compare two samples for qsort
+*/
+int bench_compare_samples(const void* a, const void* b){
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+*function to get a percentile of the sorted samples of a result, nearest rank
+*@param result      pointer to the result
+*@param percent     0-100
+*@returns the latency in ns, 0 without samples
+*/
+uint64_t bench_percentile(BenchResult* result, double percent){
+    if(result->num_samples == 0)
+        return 0;
+    uint32_t rank = (uint32_t)(percent / 100.0 * result->num_samples);
+    if(rank >= result->num_samples)
+        rank = result->num_samples - 1;
+    return result->samples[rank];
+}
+
+/*
+*function to get the mean latency of a result
+*@param result      pointer to the result
+*@returns the mean in ns
+*/
+double bench_mean(BenchResult* result){
+    double sum = 0;
+    for(uint32_t i = 0; i < result->num_samples; i++)
+        sum += result->samples[i];
+    return result->num_samples ? sum / result->num_samples : 0;
+}
+
+/*
+*function to get the throughput of a result, the rows or pages it went through per second of wall time
+*@param result      pointer to the result
+*@returns items per second
+*/
+double bench_items_per_sec(BenchResult* result){
+    return result->wall_ns ? result->items * 1e9 / result->wall_ns : 0;
+}
+
+/*
+*function to open a new empty db for a benchmark, the file and its log are removed first
+*@param bench       pointer to the run
+*@returns pointer to the table
+*/
+Table* bench_open_empty(Bench* bench){
+    char wal_name[PATH_MAX];
+    snprintf(wal_name, sizeof(wal_name), "%s-wal", bench->filename);
+    unlink(bench->filename);
+    unlink(wal_name);
+    return open_db(bench->filename, &(bench->options));
+}
+
+/*
+*function to fill a row of the benchmark, the strings vary in length with the id
+*@param row     pointer to the row
+*@param id      id of the row
+*/
+void bench_make_row(Row* row, uint32_t id){
+    row->id = id;
+    snprintf(row->username, sizeof(row->username), "user%u", id);
+    snprintf(row->email, sizeof(row->email), "user%u@%.*s.com", id, (int)(id % 24) + 4, "benchmarkbenchmarkbenchmark");
+}
+
+/*
+*function to shuffle ids, Fisher-Yates with a fixed seed so runs compare
+*@param ids     the ids
+*@param count   number of ids
+*/
+void bench_shuffle(uint32_t* ids, uint32_t count){
+    srand(42);
+    for(uint32_t i = count; i > 1; i--){
+        uint32_t j      = ((uint32_t)rand() * (uint64_t)RAND_MAX + rand()) % i;
+        uint32_t swap   = ids[i - 1];
+        ids[i - 1]      = ids[j];
+        ids[j]          = swap;
+    }
+}
+
+/*
+*function to insert rows one statement at a time like the REPL does, an insert that adds
+*pages to the file split a leaf and is recorded in the split result as well
+*@param table       pointer to the table
+*@param ids         ids to insert, in order
+*@param count       number of ids
+*@param result      pointer to the result of all inserts
+*@param splits      pointer to the result of the inserts that split, NULL to not tell them apart
+*/
+void bench_insert(Table* table, uint32_t* ids, uint32_t count, BenchResult* result, BenchResult* splits){
+    Statement statement;
+    statement.type          = STATEMENT_INSERT;
+    statement.num_params    = 0;
+
+    uint64_t start = bench_now();
+    for(uint32_t i = 0; i < count; i++){
+        bench_make_row(&(statement.row_to_insert), ids[i]);
+        uint32_t num_pages  = table->pager->num_pages;
+        uint64_t before     = bench_now();
+        if(execute_statement(&statement, table) != EXECUTE_SUCCESS){
+            printf("Benchmark insert of %u failed.\n", ids[i]);
+            exit(EXIT_FAILURE);
+        }
+        uint64_t ns = bench_now() - before;
+        bench_result_add(result, ns);
+        if(splits != NULL && table->pager->num_pages != num_pages)
+            bench_result_add(splits, ns);
+    }
+    result->wall_ns = bench_now() - start;
+    result->items   = count;
+    //the splits are spread over the run, their throughput is over the time they took
+    if(splits != NULL){
+        for(uint32_t i = 0; i < splits->num_samples; i++)
+            splits->wall_ns += splits->samples[i];
+        splits->items = splits->num_samples;
+    }
+}
+
+/*
+*function to run the insert benchmarks, rows in id order and in random order,
+*the table of the random run is left open for the read benchmarks
+*@param bench       pointer to the run
+*@param ids         scratch space for the ids of the rows
+*@returns pointer to the table with the rows
+*/
+Table* bench_inserts(Bench* bench, uint32_t* ids){
+    for(uint32_t i = 0; i < bench->rows; i++)
+        ids[i] = i;
+    Table* table = bench_open_empty(bench);
+    bench_insert(table, ids, bench->rows, bench_result_new(bench, "insert_sequential", bench->rows), NULL);
+    db_close(table);
+
+    bench_shuffle(ids, bench->rows);
+    table = bench_open_empty(bench);
+    BenchResult* inserts = bench_result_new(bench, "insert_random", bench->rows);
+    BenchResult* splits  = bench_result_new(bench, "leaf_split", bench->rows / 16);
+    bench_insert(table, ids, bench->rows, inserts, splits);
+    return table;
+}
+
+/*
+*function to look up every row by id in random order, table_find to the leaf and the cell check
+*@param bench       pointer to the run
+*@param table       pointer to the table with the rows
+*@param ids         the ids of the rows, shuffled
+*/
+void bench_point_find(Bench* bench, Table* table, uint32_t* ids){
+    BenchResult* result = bench_result_new(bench, "point_find", bench->rows);
+    uint64_t     start  = bench_now();
+    table_read_begin(table);
+    for(uint32_t i = 0; i < bench->rows; i++){
+        uint64_t before = bench_now();
+        Cursor   cursor;
+        table_find(table, ids[i], &cursor);
+        void*    node   = cursor.node;
+        bool     found  = cursor.cell_num < *leaf_node_num_cells(node) && *leaf_node_key(node, cursor.cell_num) == ids[i];
+        cursor_close(&cursor);
+        bench_result_add(result, bench_now() - before);
+        if(!found){
+            printf("Benchmark row %u not found.\n", ids[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    table_read_end(table);
+    result->wall_ns = bench_now() - start;
+    result->items   = bench->rows;
+}
+
+/*
+*function to scan the whole table a few times through advance_cursor, viewing every row
+*@param bench       pointer to the run
+*@param table       pointer to the table with the rows
+*/
+void bench_full_scan(Bench* bench, Table* table){
+    BenchResult* result = bench_result_new(bench, "full_scan", BENCH_SCAN_REPEATS);
+    uint64_t     start  = bench_now();
+    RowView      row;
+    uint64_t     bytes  = 0;
+    table_read_begin(table);
+    for(uint32_t i = 0; i < BENCH_SCAN_REPEATS; i++){
+        uint64_t before = bench_now();
+        Cursor   cursor;
+        table_start(table, &cursor);
+        cursor_read_ahead_start(&cursor, UINT32_MAX);
+        while(!cursor.end_of_table){
+            cursor_row_view(&cursor, &row);
+            bytes += row.username_length + row.email_length;
+            advance_cursor(&cursor);
+            result->items++;
+        }
+        cursor_close(&cursor);
+        bench_result_add(result, bench_now() - before);
+    }
+    table_read_end(table);
+    result->wall_ns = bench_now() - start;
+    if(bytes == 0)
+        printf("Benchmark scan read no rows.\n");
+}
+
+/*
+*function to time get_page on pages missing from the buffer pool and then on the same pages once cached,
+*the db is reopened and the kernel asked to drop the file from its cache so the first reads go to the disk
+*@param bench       pointer to the run
+*@param table       pointer to the table with the rows, closed here
+*@returns pointer to the reopened table
+*/
+Table* bench_get_page(Bench* bench, Table* table){
+    db_close(table);
+    int file_descriptor = open(bench->filename, O_RDONLY);
+    if(file_descriptor != -1){
+        posix_fadvise(file_descriptor, 0, 0, POSIX_FADV_DONTNEED);
+        close(file_descriptor);
+    }
+    table = open_db(bench->filename, &(bench->options));
+
+    //as many pages as the pool holds, so the warm reads find all of them
+    uint32_t  num_pages   = table->pager->num_pages;
+    uint32_t  count       = (bench->options.pager_mode == PAGER_MMAP || bench->options.num_frames > num_pages) ?
+                            num_pages : bench->options.num_frames;
+    uint32_t* page_nums   = (uint32_t*)malloc(num_pages * sizeof(uint32_t));
+    for(uint32_t i = 0; i < num_pages; i++)
+        page_nums[i] = i;
+    bench_shuffle(page_nums, num_pages);
+
+    BenchResult* cold = bench_result_new(bench, "get_page_cold", count);
+    BenchResult* warm = bench_result_new(bench, "get_page_warm", count);
+    BenchResult* results[2] = {cold, warm};
+    for(uint32_t pass = 0; pass < 2; pass++){
+        uint64_t start = bench_now();
+        for(uint32_t i = 0; i < count; i++){
+            uint64_t before = bench_now();
+            volatile uint8_t first_byte = *(uint8_t*)get_page(table->pager, page_nums[i]);
+            (void)first_byte;
+            bench_result_add(results[pass], bench_now() - before);
+        }
+        results[pass]->wall_ns  = bench_now() - start;
+        results[pass]->items    = count;
+    }
+    free(page_nums);
+    return table;
+}
+
+/*
+*function to print the results
+*@param bench       pointer to the run
+*/
+void bench_print(Bench* bench){
+    if(bench->output == BENCH_OUTPUT_CSV)
+        printf("name,ops,items,seconds,items_per_sec,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+    else if(bench->output == BENCH_OUTPUT_TEXT)
+        printf("%-18s %9s %12s %10s %10s %10s %10s %10s %12s\n",
+               "benchmark", "ops", "items/s", "mean ns", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns");
+
+    for(uint32_t i = 0; i < bench->num_results; i++){
+        BenchResult* result = &(bench->results[i]);
+        double       mean   = bench_mean(result);
+        uint64_t     p50    = bench_percentile(result, 50);
+        uint64_t     p90    = bench_percentile(result, 90);
+        uint64_t     p99    = bench_percentile(result, 99);
+        uint64_t     p999   = bench_percentile(result, 99.9);
+        uint64_t     max    = bench_percentile(result, 100);
+        switch(bench->output){
+            case BENCH_OUTPUT_TEXT:
+                printf("%-18s %9u %12.0f %10.0f %10llu %10llu %10llu %10llu %12llu\n", result->name, result->num_samples,
+                       bench_items_per_sec(result), mean, (unsigned long long)p50, (unsigned long long)p90,
+                       (unsigned long long)p99, (unsigned long long)p999, (unsigned long long)max);
+                break;
+            case BENCH_OUTPUT_CSV:
+                printf("%s,%u,%llu,%.6f,%.0f,%.0f,%llu,%llu,%llu,%llu,%llu\n", result->name, result->num_samples,
+                       (unsigned long long)result->items, result->wall_ns / 1e9, bench_items_per_sec(result), mean,
+                       (unsigned long long)p50, (unsigned long long)p90, (unsigned long long)p99,
+                       (unsigned long long)p999, (unsigned long long)max);
+                break;
+            case BENCH_OUTPUT_JSON:
+                printf("{\"name\":\"%s\",\"ops\":%u,\"items\":%llu,\"seconds\":%.6f,\"items_per_sec\":%.0f,\"mean_ns\":%.0f,"
+                       "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}\n",
+                       result->name, result->num_samples, (unsigned long long)result->items, result->wall_ns / 1e9,
+                       bench_items_per_sec(result), mean, (unsigned long long)p50, (unsigned long long)p90,
+                       (unsigned long long)p99, (unsigned long long)p999, (unsigned long long)max);
+                break;
+        }
+    }
+}
+
+/*
+*function to compare the results with those of an earlier run saved with --csv,
+*prints the change of the throughput and of the p50 and p99 latencies of every benchmark in both
+*@param bench       pointer to the run
+*/
+void bench_compare(Bench* bench){
+    FILE* input = fopen(bench->baseline, "r");
+    if(input == NULL){
+        printf("Unable to open baseline '%s'.\n", bench->baseline);
+        return;
+    }
+
+    char line[512];
+    printf("\n%-18s %12s %10s %10s   (change against %s)\n", "benchmark", "items/s", "p50", "p99", bench->baseline);
+    while(fgets(line, sizeof(line), input) != NULL){
+        char                name[BENCH_NAME_SIZE];
+        unsigned            ops;
+        unsigned long long  items, p50, p90, p99;
+        double              seconds, items_per_sec, mean;
+        if(sscanf(line, "%31[^,],%u,%llu,%lf,%lf,%lf,%llu,%llu,%llu", name, &ops, &items, &seconds,
+                  &items_per_sec, &mean, &p50, &p90, &p99) != 9)
+            continue;
+        for(uint32_t i = 0; i < bench->num_results; i++){
+            BenchResult* result = &(bench->results[i]);
+            if(strcmp(result->name, name) != 0)
+                continue;
+            double now_rate = bench_items_per_sec(result);
+            double now_p50  = bench_percentile(result, 50);
+            double now_p99  = bench_percentile(result, 99);
+            printf("%-18s %+11.1f%% %+9.1f%% %+9.1f%%\n", name,
+                   items_per_sec ? (now_rate / items_per_sec - 1) * 100 : 0,
+                   p50 ? (now_p50 / p50 - 1) * 100 : 0,
+                   p99 ? (now_p99 / p99 - 1) * 100 : 0);
+        }
+    }
+    fclose(input);
+}
+
+int main(int argc, char* argv[]){
+    Bench bench;
+    init_db_options(&(bench.options));
+    bench.options.use_wal   = false;
+    bench.rows              = BENCH_DEFAULT_ROWS;
+    bench.filename          = BENCH_DEFAULT_FILE;
+    bench.output            = BENCH_OUTPUT_TEXT;
+    bench.baseline          = NULL;
+    bench.num_results       = 0;
+
+    //the log is off by default, with --wal every insert waits for its sync
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--rows") == 0 && i + 1 < argc)
+            bench.rows = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            bench.options.num_frames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--mmap") == 0)
+            bench.options.pager_mode = PAGER_MMAP;
+        else if(strcmp(argv[i], "--wal") == 0)
+            bench.options.use_wal = true;
+        else if(strcmp(argv[i], "--file") == 0 && i + 1 < argc)
+            bench.filename = argv[++i];
+        else if(strcmp(argv[i], "--csv") == 0)
+            bench.output = BENCH_OUTPUT_CSV;
+        else if(strcmp(argv[i], "--json") == 0)
+            bench.output = BENCH_OUTPUT_JSON;
+        else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            bench.baseline = argv[++i];
+        else{
+            printf("Unrecognized option '%s'.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(bench.rows == 0){
+        printf("Must benchmark at least one row.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t*   ids     = (uint32_t*)malloc(bench.rows * sizeof(uint32_t));
+    Table*      table   = bench_inserts(&bench, ids);
+    bench_point_find(&bench, table, ids);
+    bench_full_scan(&bench, table);
+    table = bench_get_page(&bench, table);
+    db_close(table);
+    free(ids);
+
+    for(uint32_t i = 0; i < bench.num_results; i++)
+        qsort(bench.results[i].samples, bench.results[i].num_samples, sizeof(uint64_t), bench_compare_samples);
+    bench_print(&bench);
+    if(bench.baseline != NULL)
+        bench_compare(&bench);
+
+    for(uint32_t i = 0; i < bench.num_results; i++)
+        free(bench.results[i].samples);
+    exit(EXIT_SUCCESS);
+}
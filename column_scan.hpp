@@ -0,0 +1,250 @@
+#ifndef COLUMN_SCAN
+#define COLUMN_SCAN
+#include "mainrepl_struct.hpp"
+#include "b+tree.hpp"
+
+/*
+*function to add the rows of a leaf to a batch, the ids are copied straight from the key array,
+*the lengths are read from the cell headers, rows a select on a text column does not match are left out
+*@param batch       pointer to the batch, with room for the rows
+*@param node        pointer to the leaf, pinned
+*@param from        first cell to add
+*@param to          cell after the last one to add
+*@param statement   pointer to the select
+*/
+void column_batch_append_leaf(ColumnBatch* batch, void* node, uint32_t from, uint32_t to, Statement* statement){
+    uint32_t    count   = batch->count;
+    uint32_t*   keys    = leaf_node_key(node, 0);
+    uint16_t*   slots   = leaf_node_slot(node, 0);
+
+    if(statement->match_column == COLUMN_ID){
+        memcpy(batch->ids + count, keys + from, (to - from) * sizeof(uint32_t));
+        for(uint32_t i = from; i < to; i++, count++){
+            const uint8_t* value = (const uint8_t*)node + slots[i] + LEAF_NODE_VALUE_OFFSET;
+            batch->username_lengths[count]  = value[ROW_USERNAME_LENGTH_OFFSET];
+            batch->email_lengths[count]     = value[ROW_EMAIL_LENGTH_OFFSET];
+        }
+        batch->count = count;
+        return;
+    }
+
+    //the strings in the cell have no terminators, they are compared by length and bytes
+    uint32_t match_length = strlen(statement->match);
+    for(uint32_t i = from; i < to; i++){
+        const uint8_t*  value           = (const uint8_t*)node + slots[i] + LEAF_NODE_VALUE_OFFSET;
+        uint32_t        username_length = value[ROW_USERNAME_LENGTH_OFFSET];
+        uint32_t        email_length    = value[ROW_EMAIL_LENGTH_OFFSET];
+        const uint8_t*  text            = value + ROW_STRINGS_OFFSET;
+        uint32_t        length          = username_length;
+        if(statement->match_column == COLUMN_EMAIL){
+            text   += username_length;
+            length  = email_length;
+        }
+        if(statement->match_prefix ? length < match_length : length != match_length)
+            continue;
+        if(memcmp(text, statement->match, match_length) != 0)
+            continue;
+        batch->ids[count]               = keys[i];
+        batch->username_lengths[count]  = username_length;
+        batch->email_lengths[count]     = email_length;
+        count++;
+    }
+    batch->count = count;
+}
+
+/*
+*function to get the vector of a column of a batch
+*@param batch   pointer to the batch
+*@param column  COLUMN_ID for the ids, a text column for its lengths
+*@returns pointer to the values
+*/
+uint32_t* column_batch_vector(ColumnBatch* batch, Column column){
+    switch(column){
+        case COLUMN_USERNAME:
+            return batch->username_lengths;
+        case COLUMN_EMAIL:
+            return batch->email_lengths;
+        default:
+            return batch->ids;
+    }
+}
+
+/*
+*function to add up a vector
+*@param values  pointer to the values
+*@param count   number of values
+*@returns the sum
+*/
+uint64_t column_sum(const uint32_t* values, uint32_t count){
+    uint64_t sum = 0;
+    for(uint32_t i = 0; i < count; i++)
+        sum += values[i];
+    return sum;
+}
+
+/*
+*function to find the smallest value of a vector
+*@param values  pointer to the values
+*@param count   number of values
+*@returns the smallest value, UINT32_MAX for none
+*/
+uint32_t column_min(const uint32_t* values, uint32_t count){
+    uint32_t min = UINT32_MAX;
+    for(uint32_t i = 0; i < count; i++)
+        min = (values[i] < min) ? values[i] : min;
+    return min;
+}
+
+/*
+*function to find the largest value of a vector
+*@param values  pointer to the values
+*@param count   number of values
+*@returns the largest value, 0 for none
+*/
+uint32_t column_max(const uint32_t* values, uint32_t count){
+    uint32_t max = 0;
+    for(uint32_t i = 0; i < count; i++)
+        max = (values[i] > max) ? values[i] : max;
+    return max;
+}
+
+/*
+*function to count the values of a vector in each group
+*@param groups  pointer to the group of each value
+*@param count   number of values
+*@param counts  pointer to the counts of the groups, added to
+*/
+void column_group_count(const uint32_t* groups, uint32_t count, uint64_t* counts){
+    for(uint32_t i = 0; i < count; i++)
+        counts[groups[i]]++;
+}
+
+/*
+*function to add up the values of a vector in each group
+*@param groups  pointer to the group of each value
+*@param values  pointer to the values
+*@param count   number of values
+*@param sums    pointer to the sums of the groups, added to
+*/
+void column_group_sum(const uint32_t* groups, const uint32_t* values, uint32_t count, uint64_t* sums){
+    for(uint32_t i = 0; i < count; i++)
+        sums[groups[i]] += values[i];
+}
+
+/*
+*function to find the smallest value of a vector in each group
+*@param groups  pointer to the group of each value
+*@param values  pointer to the values
+*@param count   number of values
+*@param mins    pointer to the smallest values of the groups, lowered
+*/
+void column_group_min(const uint32_t* groups, const uint32_t* values, uint32_t count, uint64_t* mins){
+    for(uint32_t i = 0; i < count; i++)
+        mins[groups[i]] = (values[i] < mins[groups[i]]) ? values[i] : mins[groups[i]];
+}
+
+/*
+*function to find the largest value of a vector in each group
+*@param groups  pointer to the group of each value
+*@param values  pointer to the values
+*@param count   number of values
+*@param maxes   pointer to the largest values of the groups, raised
+*/
+void column_group_max(const uint32_t* groups, const uint32_t* values, uint32_t count, uint64_t* maxes){
+    for(uint32_t i = 0; i < count; i++)
+        maxes[groups[i]] = (values[i] > maxes[groups[i]]) ? values[i] : maxes[groups[i]];
+}
+
+/*
+*function to start an aggregate with empty results
+*@param aggregation pointer to the aggregation
+*@param statement   pointer to the select
+*/
+void aggregation_init(Aggregation* aggregation, Statement* statement){
+    uint64_t start = (statement->aggregate == AGGREGATE_MIN) ? UINT64_MAX : 0;
+    aggregation->statement      = statement;
+    aggregation->batch.count    = 0;
+    for(uint32_t i = 0; i < AGGREGATE_MAX_GROUPS; i++){
+        aggregation->counts[i] = 0;
+        aggregation->values[i] = start;
+    }
+}
+
+/*
+*function to add the rows of the batch to the results and empty it
+*@param aggregation pointer to the aggregation
+*/
+void aggregation_flush(Aggregation* aggregation){
+    ColumnBatch*    batch       = &(aggregation->batch);
+    Statement*      statement   = aggregation->statement;
+    uint32_t*       values      = column_batch_vector(batch, statement->aggregate_column);
+    uint32_t        count       = batch->count;
+    if(count == 0)
+        return;
+
+    if(statement->group_column == COLUMN_ID){
+        aggregation->counts[0] += count;
+        if(statement->aggregate == AGGREGATE_SUM)
+            aggregation->values[0] += column_sum(values, count);
+        else if(statement->aggregate == AGGREGATE_MIN){
+            uint64_t min = column_min(values, count);
+            if(min < aggregation->values[0])
+                aggregation->values[0] = min;
+        }
+        else if(statement->aggregate == AGGREGATE_MAX){
+            uint64_t max = column_max(values, count);
+            if(max > aggregation->values[0])
+                aggregation->values[0] = max;
+        }
+    }
+    else{
+        uint32_t* groups = column_batch_vector(batch, statement->group_column);
+        column_group_count(groups, count, aggregation->counts);
+        if(statement->aggregate == AGGREGATE_SUM)
+            column_group_sum(groups, values, count, aggregation->values);
+        else if(statement->aggregate == AGGREGATE_MIN)
+            column_group_min(groups, values, count, aggregation->values);
+        else if(statement->aggregate == AGGREGATE_MAX)
+            column_group_max(groups, values, count, aggregation->values);
+    }
+    batch->count = 0;
+}
+
+/*
+*function to add a row to an aggregate, for rows that come one at a time
+*@param row         pointer to the row
+*@param context     pointer to the aggregation
+*/
+void aggregation_add_row(RowView* row, void* context){
+    Aggregation*    aggregation = (Aggregation*)context;
+    ColumnBatch*    batch       = &(aggregation->batch);
+    if(batch->count == COLUMN_BATCH_SIZE)
+        aggregation_flush(aggregation);
+    batch->ids[batch->count]                = row->id;
+    batch->username_lengths[batch->count]   = row->username_length;
+    batch->email_lengths[batch->count]      = row->email_length;
+    batch->count++;
+}
+
+/*
+*function to send the results of an aggregate, a group with no rows has none,
+*and neither has min or max over no rows
+*@param aggregation pointer to the aggregation, flushed
+*@param on_value    where to send the results
+*@param context     passed to on_value
+*/
+void aggregation_finish(Aggregation* aggregation, ValueCallback on_value, void* context){
+    Statement*  statement   = aggregation->statement;
+    bool        grouped     = (statement->group_column != COLUMN_ID);
+    for(uint32_t group = 0; group < AGGREGATE_MAX_GROUPS; group++){
+        if(!grouped && group > 0)
+            break;
+        if(aggregation->counts[group] == 0 && (grouped || statement->aggregate == AGGREGATE_MIN ||
+                                              statement->aggregate == AGGREGATE_MAX))
+            continue;
+        uint64_t value = (statement->aggregate == AGGREGATE_COUNT) ? aggregation->counts[group] : aggregation->values[group];
+        on_value(grouped ? &group : NULL, value, context);
+    }
+}
+
+#endif
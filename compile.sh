@@ -4,9 +4,25 @@ echo "mainrepl_enum.hpp"
 g++ mainrepl_enum.hpp
 echo "mainrepl_struct.hpp"
 g++ mainrepl_struct.hpp
+echo "key_search.hpp"
+g++ key_search.hpp
 echo "b+tree.hpp"
 g++ b+tree.hpp
+echo "stats.hpp"
+g++ stats.hpp
+echo "arena.hpp"
+g++ arena.hpp
+echo "wal.hpp"
+g++ wal.hpp
+echo "page_io.hpp"
+g++ page_io.hpp
+echo "column_scan.hpp"
+g++ column_scan.hpp
 echo "repl_helpers.hpp"
 g++ repl_helpers.hpp
+echo "server.hpp"
+g++ server.hpp
 echo "mainrepl.cpp"
-g++ mainrepl.cpp
+g++ -O2 mainrepl.cpp
+echo "bench.cpp"
+g++ -O2 -o bench bench.cpp
@@ -0,0 +1,118 @@
+#ifndef KEY_SEARCH
+#define KEY_SEARCH
+#include "mainrepl_struct.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include<immintrin.h>
+#define KEY_SEARCH_X86
+#endif
+
+//number of keys left to the vector count after the binary search narrows the window
+#define KEY_SEARCH_WINDOW 32
+
+typedef uint32_t (*KeyLowerBound)(const uint32_t* keys, uint32_t num_keys, uint32_t key);
+
+/*
+*function to narrow a search window with a branchless binary search,
+*keys before the window are smaller than the key, keys after it are not
+*@param keys        pointer to the sorted keys
+*@param num_keys    pointer to the number of keys, set to the size of the window
+*@param key         key to search
+*@param window      size to narrow the window down to, at least 1
+*@returns pointer to the first key of the window
+*/
+const uint32_t* key_search_narrow(const uint32_t* keys, uint32_t* num_keys, uint32_t key, uint32_t window){
+    const uint32_t* base    = keys;
+    uint32_t        length  = *num_keys;
+    while(length > window){
+        uint32_t half   = length / 2;
+        base            = (base[half] < key) ? base + half : base;
+        length         -= half;
+    }
+    *num_keys = length;
+    return base;
+}
+
+/*
+*function to find the first key not smaller than a key, portable version
+*@param keys        pointer to the sorted keys
+*@param num_keys    number of keys
+*@param key         key to search
+*@returns index of the first key >= key, num_keys if there is none
+*/
+uint32_t key_lower_bound_scalar(const uint32_t* keys, uint32_t num_keys, uint32_t key){
+    if(num_keys == 0)
+        return 0;
+    const uint32_t* base = key_search_narrow(keys, &num_keys, key, 1);
+    return (base - keys) + (*base < key);
+}
+
+#ifdef KEY_SEARCH_X86
+/*
+*function to find the first key not smaller than a key, counts the smaller keys of the window 4 at a time
+*@param keys        pointer to the sorted keys
+*@param num_keys    number of keys
+*@param key         key to search
+*@returns index of the first key >= key, num_keys if there is none
+*/
+__attribute__((target("sse2")))
+uint32_t key_lower_bound_sse2(const uint32_t* keys, uint32_t num_keys, uint32_t key){
+    const uint32_t* base    = key_search_narrow(keys, &num_keys, key, KEY_SEARCH_WINDOW);
+    //sse2 only compares signed, flipping the top bit keeps the unsigned order
+    __m128i         bias    = _mm_set1_epi32((int)0x80000000u);
+    __m128i         needle  = _mm_xor_si128(_mm_set1_epi32((int)key), bias);
+    uint32_t        count   = 0;
+    uint32_t        i       = 0;
+    for(; i + 4 <= num_keys; i += 4){
+        __m128i block   = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(base + i)), bias);
+        __m128i smaller = _mm_cmpgt_epi32(needle, block);
+        count          += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(smaller)));
+    }
+    for(; i < num_keys; i++)
+        count += base[i] < key;
+    return (base - keys) + count;
+}
+
+/*
+*function to find the first key not smaller than a key, counts the smaller keys of the window 8 at a time
+*@param keys        pointer to the sorted keys
+*@param num_keys    number of keys
+*@param key         key to search
+*@returns index of the first key >= key, num_keys if there is none
+*/
+__attribute__((target("avx2,popcnt")))
+uint32_t key_lower_bound_avx2(const uint32_t* keys, uint32_t num_keys, uint32_t key){
+    const uint32_t* base    = key_search_narrow(keys, &num_keys, key, KEY_SEARCH_WINDOW);
+    __m256i         bias    = _mm256_set1_epi32((int)0x80000000u);
+    __m256i         needle  = _mm256_xor_si256(_mm256_set1_epi32((int)key), bias);
+    uint32_t        count   = 0;
+    uint32_t        i       = 0;
+    for(; i + 8 <= num_keys; i += 8){
+        __m256i block   = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(base + i)), bias);
+        __m256i smaller = _mm256_cmpgt_epi32(needle, block);
+        count          += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(smaller)));
+    }
+    for(; i < num_keys; i++)
+        count += base[i] < key;
+    return (base - keys) + count;
+}
+#endif
+
+/*
+*function to pick the fastest lower bound the cpu supports
+*@returns the search function
+*/
+KeyLowerBound select_key_lower_bound(){
+#ifdef KEY_SEARCH_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return key_lower_bound_avx2;
+    if(__builtin_cpu_supports("sse2"))
+        return key_lower_bound_sse2;
+#endif
+    return key_lower_bound_scalar;
+}
+
+//resolved once when the program starts
+KeyLowerBound key_lower_bound = select_key_lower_bound();
+
+#endif
@@ -1,4 +1,4 @@
-#include "repl_helpers.hpp"
+#include "server.hpp"
 
 int main(int argc, char* argv[]){
 
@@ -8,14 +8,61 @@ int main(int argc, char* argv[]){
         exit(EXIT_FAILURE);
     }
 
+    //optional buffer pool size in pages: --frames N, memory mapped pager: --mmap,
+    //no write-ahead log: --no-wal, page batches on threads instead of io_uring: --no-io-uring,
+    //dirty pages the background writer writes per second, 0 to turn it off: --writeback N,
+    //no prompt or "Executed." lines: --batch,
+    //serve clients on a Unix socket instead of reading stdin: --server PATH [--workers N]
+    DbOptions options;
+    init_db_options(&options);
+    bool batch = !isatty(STDIN_FILENO);
+    char* socket_path = NULL;
+    uint32_t num_workers = SERVER_DEFAULT_WORKERS;
+    for(int i = 2; i < argc; i++){
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            options.num_frames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--mmap") == 0)
+            options.pager_mode = PAGER_MMAP;
+        else if(strcmp(argv[i], "--no-wal") == 0)
+            options.use_wal = false;
+        else if(strcmp(argv[i], "--no-io-uring") == 0)
+            options.use_io_uring = false;
+        else if(strcmp(argv[i], "--writeback") == 0 && i + 1 < argc)
+            options.writeback_rate = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--batch") == 0)
+            batch = true;
+        else if(strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+            socket_path = argv[++i];
+        else if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+            num_workers = atoi(argv[++i]);
+        else{
+            printf("Unrecognized option '%s'.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     //create input buffer and db files (if already exists, open that file)
     char* filename = argv[1];
     InputBuffer* input_buffer = new_input_buffer();
-    Table* table = open_db(filename);
+    Table* table = open_db(filename, &options);
+
+    if(socket_path != NULL){
+        server_run(table, socket_path, num_workers);
+        db_close(table);
+        exit(EXIT_SUCCESS);
+    }
+
+    //a script gets its output in large blocks instead of a write per line
+    if(batch)
+        setvbuf(stdout, NULL, _IOFBF, BATCH_OUTPUT_BUFFER);
 
     while(true){
-        print_prompt();
-        read_input(input_buffer);
+        if(!batch)
+            print_prompt();
+        if(!read_input(input_buffer)){
+            db_close(table);
+            exit(EXIT_SUCCESS);
+        }
 
         //meta commands handling (begins with '.')
         if(input_buffer->buffer[0] == '.'){
@@ -53,13 +100,26 @@ int main(int argc, char* argv[]){
         case PREPARE_NEGATIVE_ID:
             printf("Error:Id must be positive.\n");
             continue;
+
+        case PREPARE_BAD_PARAMETER:
+            printf("Error:Bad parameter.\n");
+            continue;
+
+        case PREPARE_TOO_MANY_KEYS:
+            printf("Error:Too many ids, at most %d.\n", STATEMENT_MAX_KEYS);
+            continue;
+
+        case PREPARE_ID_OUT_OF_RANGE:
+            printf("Error:Id out of range, at most %u.\n", UINT32_MAX);
+            continue;
     }
 
     //execute the read statements
-    switch(execute_statement(&statement, table)){
+    switch(statement_step(&statement, table)){
         
         case EXECUTE_SUCCESS:
-            printf("Executed.\n");        
+            if(!batch)
+                printf("Executed.\n");
             break;
         
         case EXECUTE_DUPLICATE_KEY:
@@ -69,6 +129,26 @@ int main(int argc, char* argv[]){
         case EXECUTE_TABLE_FULL:
             printf("Error: Table full.\n");
             break;
+
+        case EXECUTE_ALREADY_IN_TRANSACTION:
+            printf("Error: Already in a transaction.\n");
+            break;
+
+        case EXECUTE_NO_TRANSACTION:
+            printf("Error: No transaction to commit.\n");
+            break;
+
+        case EXECUTE_KEY_NOT_FOUND:
+            printf("Error: Key not found.\n");
+            break;
+
+        case EXECUTE_UNBOUND_PARAMETER:
+            printf("Error: Statement has unbound ? parameters.\n");
+            break;
+
+        case EXECUTE_INDEX_EXISTS:
+            printf("Error: Index already exists.\n");
+            break;
         }   
     }
 }
\ No newline at end of file
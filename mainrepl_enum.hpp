@@ -13,13 +13,20 @@ typedef enum{
     PREPARE_SYNTAX_ERROR,
     PREPARE_STRING_TOO_LONG,
     PREPARE_NEGATIVE_ID,
-    PREPARE_FAILURE
+    PREPARE_FAILURE,
+    PREPARE_BAD_PARAMETER,      //bind to a missing parameter or with the wrong type
+    PREPARE_TOO_MANY_KEYS,      //more ids in an in list than a statement holds
+    PREPARE_ID_OUT_OF_RANGE     //id or key bound above the largest id
 }PrepareResult;
 
 //for command types
 typedef enum{
     STATEMENT_INSERT,
-    STATEMENT_SELECT
+    STATEMENT_SELECT,
+    STATEMENT_DELETE,
+    STATEMENT_BEGIN,
+    STATEMENT_COMMIT,
+    STATEMENT_CREATE_INDEX
 }StatementType;
 
 //for execution results
@@ -27,12 +34,129 @@ typedef enum{
     EXECUTE_SUCCESS,
     EXECUTE_TABLE_FULL,
     EXECUTE_FAILURE,
-    EXECUTE_DUPLICATE_KEY
+    EXECUTE_DUPLICATE_KEY,
+    EXECUTE_KEY_OUT_OF_ORDER,
+    EXECUTE_TABLE_NOT_EMPTY,
+    EXECUTE_ALREADY_IN_TRANSACTION,
+    EXECUTE_NO_TRANSACTION,
+    EXECUTE_KEY_NOT_FOUND,
+    EXECUTE_UNBOUND_PARAMETER,
+    EXECUTE_INDEX_EXISTS
 }ExecuteResult;
 
+//what a ? placeholder of a prepared statement is bound into
+typedef enum{
+    PARAM_ROW_ID,
+    PARAM_ROW_USERNAME,
+    PARAM_ROW_EMAIL,
+    PARAM_KEY,              //id of a delete
+    PARAM_KEY_LO,           //where id >= ? and the low end of between
+    PARAM_KEY_HI,           //where id <= ? and the high end of between
+    PARAM_KEY_ABOVE,        //where id > ?
+    PARAM_KEY_BELOW,        //where id < ?
+    PARAM_KEY_EQUAL,        //where id = ?
+    PARAM_KEY_IN,           //an id of where id in (?, ...)
+    PARAM_MATCH,            //where username = ? and where email = ?
+    PARAM_MATCH_PREFIX,     //where username like ? and where email like ?, the value ends with %
+    PARAM_LIMIT,            //limit ?
+    PARAM_OFFSET            //offset ?
+}ParamTarget;
+
+//aggregate a select computes over the rows it finds
+typedef enum{
+    AGGREGATE_NONE,         //the rows themselves
+    AGGREGATE_COUNT,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX,
+    AGGREGATE_SUM
+}AggregateFunction;
+
+//columns of the table, a select filters on one of them, the text ones can be indexed
+typedef enum{
+    COLUMN_ID,
+    COLUMN_USERNAME,
+    COLUMN_EMAIL,
+    NUM_COLUMNS
+}Column;
+
+//how the pager reaches the db file
+typedef enum{
+    PAGER_BUFFERED,     //read/write into the buffer pool
+    PAGER_MMAP          //pages point straight into a shared mapping of the file
+}PagerMode;
+
+//how batches of page reads and writes reach the kernel
+typedef enum{
+    PAGE_IO_URING,      //one io_uring submission for the batch
+    PAGE_IO_THREADS     //pread/pwrite spread over a pool of threads
+}PageIoMode;
+
 //for node types
 typedef enum{
     NODE_INTERNAL,
     NODE_LEAF
 }NodeType;
+
+//request types of the server protocol
+typedef enum{
+    SERVER_OP_QUERY,        //statement text, same grammar as the REPL
+    SERVER_OP_INSERT,       //id and the row payload
+    SERVER_OP_SELECT,       //lowest and highest id, inclusive
+    SERVER_OP_DELETE,       //id
+    SERVER_OP_BEGIN,
+    SERVER_OP_COMMIT
+}ServerOp;
+
+//response types of the server protocol
+typedef enum{
+    SERVER_RESPONSE_ROW,    //id and the row payload
+    SERVER_RESPONSE_DONE,   //status and result code, ends the response to a request
+    SERVER_RESPONSE_VALUE   //result of an aggregate, whether it is grouped, the group and the value
+}ServerResponse;
+
+//status of a done response, says which enum the result code is from
+typedef enum{
+    SERVER_STATUS_EXECUTED,     //code is an ExecuteResult
+    SERVER_STATUS_PREPARE_ERROR,//code is a PrepareResult
+    SERVER_STATUS_BAD_REQUEST   //malformed request or unknown op
+}ServerStatus;
+
+//what a worker does with a connection after handling its requests
+typedef enum{
+    SERVER_CONNECTION_OPEN,     //back to the event loop
+    SERVER_CONNECTION_CLOSED,   //client gone or misbehaving
+    SERVER_CONNECTION_WAITING   //parked until the writer releases the table
+}ServerConnectionState;
+
+//event counters of the pager, the tree and the executor, shown by .stats
+typedef enum{
+    STAT_PAGE_HITS,             //get_page found the page in the buffer pool
+    STAT_PAGE_MISSES,           //get_page read the page from the file or the log
+    STAT_PAGE_EVICTIONS,        //cached pages given up for another
+    STAT_PAGE_COPIES,           //pages the writer copied to change, the version before stays for snapshots
+    STAT_VERSION_SPILLS,        //old versions written to the version store to free their frames
+    STAT_BYTES_READ,            //page bytes read from the db file and the log
+    STAT_BYTES_WRITTEN,         //page bytes written to the db file
+    STAT_WAL_BYTES_WRITTEN,     //frame bytes appended to the log
+    STAT_WAL_SYNCS,
+    STAT_LEAF_SPLITS,
+    STAT_INTERNAL_SPLITS,
+    STAT_DESCENTS,              //walks from the root to a leaf by table_find
+    STAT_DESCENT_LEVELS,        //nodes visited by those walks, leaves included
+    STAT_ROWS_INSERTED,
+    STAT_ROWS_DELETED,
+    STAT_ROWS_SENT,             //rows selects sent to their callers
+    NUM_STAT_COUNTERS
+}StatCounter;
+
+//latencies kept as histograms by .stats
+typedef enum{
+    STAT_LATENCY_INSERT,
+    STAT_LATENCY_SELECT,
+    STAT_LATENCY_DELETE,
+    STAT_LATENCY_PAGE_READ,     //getting a missed page into the pool, making room included
+    STAT_LATENCY_COMMIT,        //appending and syncing the log of a commit
+    STAT_LATENCY_CHECKPOINT,
+    NUM_STAT_HISTOGRAMS
+}StatHistogram;
 #endif
\ No newline at end of file
@@ -8,6 +8,18 @@
 #include<errno.h>
 #include<fcntl.h>
 #include<unistd.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+#include<pthread.h>
+#include<time.h>
+#include<sys/uio.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+#include<sys/epoll.h>
+#include<poll.h>
+#include<signal.h>
+#include<sys/syscall.h>
+#include<linux/io_uring.h>
 #include "mainrepl_enum.hpp"
 #endif
 
@@ -15,7 +27,48 @@
 #define STRUCT
 #define COLUMN_USERNAME_SIZE 32
 #define COLUMN_EMAIL_SIZE    255
-#define TABLE_MAX_PAGES      100
+#define PAGER_DEFAULT_FRAMES 256
+#define PAGER_MIN_FRAMES     32
+#define BTREE_MAX_DEPTH      32
+#define BULK_LOAD_DEFAULT_FILL 90
+#define MMAP_EXTENT_SIZE     (16 * 1024 * 1024)
+#define MMAP_MAX_SIZE        (1ULL << 40)
+#define WAL_MAGIC            0x57414c31
+#define WAL_AUTOCHECKPOINT   1000
+#define WAL_CHECKPOINT_BACKLOG 4
+#define WRITEBACK_DEFAULT_RATE 4096
+#define WRITEBACK_INTERVAL_MS  100
+#define BATCH_OUTPUT_BUFFER  (1 << 20)
+#define STATEMENT_MAX_KEYS   64
+#define STATEMENT_MAX_PARAMS (STATEMENT_MAX_KEYS + 2)
+#define SERVER_DEFAULT_WORKERS 4
+#define SERVER_MAX_EVENTS    64
+#define SERVER_BACKLOG       128
+#define SERVER_MAX_REQUEST   (64 * 1024)
+#define SERVER_READ_SIZE     (16 * 1024)
+#define SERVER_FLUSH_SIZE    (256 * 1024)
+#define PAGE_IO_QUEUE_DEPTH  256
+#define PAGE_IO_NUM_THREADS  4
+#define PAGE_IO_BATCH_PAGES  256
+#define PAGE_IO_MAX_RUN      64
+#define PAGER_READAHEAD_MIN  4
+#define PAGER_READAHEAD_MAX  64
+#define COLUMN_BATCH_SIZE    1024
+#define AGGREGATE_MAX_GROUPS (COLUMN_EMAIL_SIZE + 1)
+#define STATS_HISTOGRAM_BUCKETS 40
+#define ARENA_BLOCK_SIZE     (64 * 1024)
+#define ARENA_ALIGNMENT      16
+#define PAGER_SLAB_ALIGNMENT (2 * 1024 * 1024)
+#define PAGER_MAX_THREAD_PINS (4 * BTREE_MAX_DEPTH)
+#define VERSION_NONE         UINT64_MAX
+#define VERSION_PENDING      (UINT64_MAX - 1)
+
+//trace output of the tree code, only compiled in with -DDB_TRACE
+#ifdef DB_TRACE
+#define TRACE(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define TRACE(...) ((void)0)
+#endif
 
 //input buffer to read the cmds
 typedef struct{
@@ -31,48 +84,451 @@ typedef struct{
     char        email[COLUMN_EMAIL_SIZE + 1];
 }Row;
 
-//read cmds >> statements (insert, select)
+//a row read in place from its leaf, valid while the cursor holds the leaf pinned,
+//the strings are not terminated, the payload is the row as stored, the lengths then the strings
+typedef struct{
+    uint32_t        id;
+    const char*     username;
+    const char*     email;
+    uint8_t         username_length;
+    uint8_t         email_length;
+    const uint8_t*  payload;
+}RowView;
+
+//receives the rows a select finds, in id order, the view is only valid during the call
+typedef void (*RowCallback)(RowView* row, void* context);
+
+//receives the results of an aggregate, group is NULL without group by
+typedef void (*ValueCallback)(uint32_t* group, uint64_t value, void* context);
+
+//a ? placeholder of a prepared statement
+typedef struct{
+    ParamTarget     target;
+    uint32_t        key_num;        //element of keys a PARAM_KEY_IN is for
+    bool            bound;
+}StatementParam;
+
+//read cmds >> statements (insert, select, delete)
+//a statement is parsed once and can be bound and executed many times
 typedef struct{
     StatementType   type;
     Row             row_to_insert;
+    uint32_t        key;            //id to delete
+    uint32_t        key_lo;         //ids selected, inclusive range
+    uint32_t        key_hi;
+    uint32_t        num_keys;       //ids of where id in (...) in the order written, 0 without the list
+    uint32_t        keys[STATEMENT_MAX_KEYS];
+    Column          match_column;   //column a select matches or an index is made on, COLUMN_ID for the id range only
+    bool            match_prefix;   //rows whose value starts with match, else the ones equal to it
+    char            match[COLUMN_EMAIL_SIZE + 1];
+    AggregateFunction aggregate;    //AGGREGATE_NONE for a select sending its rows
+    Column          aggregate_column;   //the id or the length of a text column, COLUMN_ID for count(*)
+    Column          group_column;   //groups by the length of a text column, COLUMN_ID for a single group
+    uint32_t        limit;          //most rows a select sends, UINT32_MAX for all
+    uint32_t        offset;         //rows a select skips before sending any
+    uint32_t        num_params;     //? placeholders in the order they appear in the text
+    StatementParam  params[STATEMENT_MAX_PARAMS];
+    RowCallback     on_row;         //where a select sends its rows, NULL prints them
+    ValueCallback   on_value;       //where an aggregate sends its results, NULL prints them
+    void*           on_row_context; //passed to both
 }Statement;
 
-//struct to hold page info, file info
+//rows of a scan decoded a column at a time, the lengths stand in for the text columns
+typedef struct{
+    uint32_t    count;
+    uint32_t    ids[COLUMN_BATCH_SIZE];
+    uint32_t    username_lengths[COLUMN_BATCH_SIZE];
+    uint32_t    email_lengths[COLUMN_BATCH_SIZE];
+}ColumnBatch;
+
+//running results of an aggregate, one slot per group, slot 0 without group by
+typedef struct{
+    Statement*  statement;
+    ColumnBatch batch;              //rows not yet added to the results
+    uint64_t    counts[AGGREGATE_MAX_GROUPS];
+    uint64_t    values[AGGREGATE_MAX_GROUPS];
+}Aggregation;
+
+//buffer pool frame, holds one cached version of a page
+//the version is seen by the snapshots from version_begin up to but not including version_end,
+//the writer's uncommitted copy begins at VERSION_PENDING, the newest committed version ends at
+//VERSION_NONE, or at VERSION_PENDING while the writer has a copy of it
+typedef struct{
+    void*       data;
+    uint32_t    page_num;
+    uint32_t    pin_count;
+    bool        in_use;
+    bool        dirty;      //differs from the page in the db file
+    bool        logged;     //current contents are already in the write-ahead log
+    int32_t     hash_next;  //next frame in the same page table bucket, the newest version of each page is in the table
+    int32_t     older;      //frame with the next older version of the page, -1 if none is cached
+    int32_t     lru_prev;   //neighbour towards the most recently used end
+    int32_t     lru_next;   //neighbour towards the least recently used end
+    uint64_t    version_begin;  //commit that wrote the version
+    uint64_t    version_end;    //commit that replaced it, old versions are kept off the LRU list until no snapshot needs them
+}Frame;
+
+//options for opening a db
+typedef struct{
+    PagerMode   pager_mode;
+    uint32_t    num_frames;
+    bool        use_wal;
+    bool        use_io_uring;   //false to batch page I/O on a thread pool even where io_uring works
+    uint32_t    writeback_rate; //dirty pages per second written in the background, 0 for none
+}DbOptions;
+
+//one page transfer of a batch
+typedef struct{
+    int         file_descriptor;
+    void*       data;               //PAGE_SIZE bytes
+    uint64_t    offset;
+    bool        write;
+}PageIoRequest;
+
+//requests of a batch for neighbouring pages of one file, moved with one vectored transfer
+typedef struct{
+    uint32_t    first;              //index of the first request of the run in the sorted batch
+    uint32_t    count;
+}PageIoRun;
+
+//batched positional page I/O, a whole batch is handed to the kernel or the threads at once
+typedef struct{
+    PageIoMode          mode;
+    //io_uring, rings shared with the kernel
+    int                 ring_fd;
+    void*               sq_ring;
+    size_t              sq_ring_length;
+    void*               cq_ring;
+    size_t              cq_ring_length;
+    struct io_uring_sqe* sqes;
+    uint32_t            sq_entries;
+    uint32_t*           sq_head;
+    uint32_t*           sq_tail;
+    uint32_t*           sq_mask;
+    uint32_t*           sq_array;
+    uint32_t*           cq_head;
+    uint32_t*           cq_tail;
+    uint32_t*           cq_mask;
+    struct io_uring_cqe* cqes;
+    //current batch, its requests are sorted and cut into runs
+    PageIoRequest*      batch;
+    struct iovec*       batch_iovecs;       //one per request, a run's iovecs are next to each other
+    PageIoRun*          batch_runs;
+    uint32_t            batch_count;        //number of runs
+    //thread pool, the threads take runs of the current batch until it is done
+    pthread_t*          threads;
+    uint32_t            num_threads;
+    uint32_t            batch_next;
+    uint32_t            batch_done;
+    bool                stopping;
+    //one batch at a time, lock also guards the batch fields
+    pthread_mutex_t     submit_lock;
+    pthread_mutex_t     lock;
+    pthread_cond_t      work_ready;
+    pthread_cond_t      work_done;
+}PageIo;
+
+//write-ahead log file header
+typedef struct{
+    uint32_t    magic;
+    uint32_t    page_size;
+    uint32_t    salt;
+    uint32_t    checksum;
+}WalHeader;
+
+//header in front of every page image in the write-ahead log
+typedef struct{
+    uint32_t    page_num;
+    uint32_t    commit_num_pages;   //db size in pages on the last frame of a commit, else 0
+    uint32_t    salt;
+    uint32_t    checksum;
+}WalFrameHeader;
+
+//write-ahead log, page images are appended to it and copied into the db file at checkpoints
+typedef struct{
+    int             file_descriptor;
+    uint32_t        salt;
+    uint64_t        length;             //end of the last frame appended
+    uint64_t        synced_length;      //end of the last frame known to be on disk
+    uint64_t        commit_length;      //end of the last frame ending a commit, frames past it are the open transaction's
+    uint32_t        num_frames;
+    //open addressing index of the latest frame of each page in the log
+    uint32_t*       index_pages;
+    uint64_t*       index_offsets;
+    uint64_t*       index_committed;    //frame of the page as of the last commit while the latest is past it, 0 for the db file
+    uint32_t        index_size;
+    uint32_t        index_count;
+    //group commit, one thread syncs for every commit appended before it started
+    pthread_mutex_t lock;
+    pthread_cond_t  synced;
+    bool            sync_in_progress;
+}Wal;
+
+//old version of a page in the version store, read back into a frame when a snapshot needs it
+typedef struct{
+    uint32_t    page_num;
+    uint32_t    slot;               //page sized slot of the version store file
+    uint64_t    version_begin;
+    uint64_t    version_end;
+}StoredVersion;
+
+//struct to hold page info, file info and the buffer pool
 typedef struct {
     int         file_descriptor;
-    uint32_t    file_length;
+    uint64_t    file_length;
     uint32_t    num_pages;
-    void*       pages[TABLE_MAX_PAGES];
+    PagerMode   mode;
+    char*       map;                //start of the reserved address range, mmap mode only
+    uint64_t    map_length;         //bytes of the file mapped at its start
+    uint32_t    num_frames;
+    uint32_t    num_used_frames;
+    Frame*      frames;
+    char*       frame_slab;         //the pages of all frames, frame i holds bytes i * PAGE_SIZE on
+    size_t      frame_slab_length;
+    bool        frame_slab_hugetlb; //mapped from the huge page pool, else from posix_memalign
+    int32_t*    page_table;         //buckets of frame indexes, keyed by page number
+    uint32_t    page_table_size;
+    int32_t     lru_head;           //most recently used frame
+    int32_t     lru_tail;           //least recently used frame
+    Wal*        wal;                //NULL when running without a write-ahead log
+    PageIo*     io;                 //batched writes of checkpoints and close, NULL in mmap mode
+    uint32_t*   unlogged_pages;     //pages modified since the last commit
+    uint32_t    num_unlogged_pages;
+    uint32_t    unlogged_capacity;
+    uint32_t    txn_frames;         //frames the open transaction spilled to the log
+    uint32_t    committed_num_pages; //num_pages as of the last commit, a rollback cuts the file back to it
+    bool        background_checkpoints; //the background writer checkpoints, commits only past the backlog
+    //guards the frames, page table, LRU list, versions and file
+    pthread_mutex_t lock;
+    //versions, readers see the pages as of the commit their snapshot was taken at
+    uint64_t    commit_num;         //last commit published
+    uint32_t*   private_pages;      //pages the writer copied since the last commit
+    uint32_t    num_private_pages;
+    uint32_t    private_capacity;
+    int32_t*    old_versions;       //frames of replaced versions kept for snapshots
+    uint32_t    num_old_versions;
+    int         versions_fd;        //version store, old versions evicted for want of frames, unlinked once opened
+    StoredVersion* stored_versions;
+    uint32_t    num_stored_versions;
+    uint32_t    stored_capacity;
+    uint32_t*   free_slots;         //slots of the version store no version is in
+    uint32_t    num_free_slots;
+    uint32_t    num_slots;
+    uint32_t    slots_capacity;
+    uint64_t*   snapshots;          //commit numbers of the snapshots readers hold
+    uint32_t    num_snapshots;
+    uint32_t    snapshots_capacity;
+    uint32_t    num_waiting_snapshots;  //snapshot holders waiting for a frame
+    uint64_t    frame_waits;        //times a thread waited for a frame, a change tells a caller the lock was let go
+    pthread_cond_t versions_released;   //signaled when a snapshot ends or a commit publishes the writer's copies
+    //pages the writer fetched during its statement, pinned until the statement ends
+    bool        holding;
+    pthread_t   holder;
+    uint32_t*   held_pages;
+    uint32_t    num_held_pages;
+    uint32_t    held_capacity;
 }Pager;
 
+//page a thread pinned, unpinned by page number so the frame of the version is remembered
+typedef struct{
+    Pager*      pager;
+    uint32_t    page_num;
+    int32_t     frame_num;
+}ThreadPin;
+
+//secondary index on a text column, a B+tree of keys holding the column value and the row id
+//its pages are versioned like the table's, lookups read them at their snapshot
+typedef struct{
+    Column      column;
+    uint32_t    root_page_num;      //never moves, a split of the root copies it into a new child
+    uint32_t    value_size;         //bytes of the value in a key, longer values are cut
+    uint32_t    key_size;           //the value padded with zeros then the id big endian, memcmp orders them
+    uint32_t    leaf_max_keys;
+    uint32_t    internal_max_keys;
+}Index;
+
+//background writer, writes dirty pages between statements a few at a time in page order
+typedef struct{
+    pthread_t       thread;
+    pthread_mutex_t lock;           //guards stopping
+    pthread_cond_t  wake;           //signaled to stop, else waited on for an interval
+    bool            stopping;
+    uint32_t        pages_per_step; //most pages written each interval
+    uint32_t        next_page_num;  //the sweep over the dirty pages goes on from here
+}Writeback;
+
 //struct to hold db table
+//statements share lock, commands that rework the whole file take it exclusively,
+//write_lock lets one writer in at a time, it is held from begin to commit
 typedef struct {
     uint32_t root_page_num;
     Pager*   pager;
+    bool     in_transaction;
+    pthread_rwlock_t lock;
+    pthread_mutex_t  write_lock;
+    Index*           indexes[NUM_COLUMNS];  //NULL for the columns without an index
+    Writeback*       writeback;     //NULL without a background writer
 }Table;
 
 //struct to store the cursor
 typedef struct{
     Table*      table;
     uint32_t    page_num;
+    void*       node;               //the leaf at page_num, pinned while the cursor is open
     uint32_t    cell_num;
     bool        end_of_table;
+    //internal nodes passed on the way down from the root, used to update parents after a split,
+    //they are not pinned, the writer fetches them again by page number
+    uint32_t    depth;
+    uint32_t    path[BTREE_MAX_DEPTH];          //page number of the internal node at each level
+    uint32_t    path_index[BTREE_MAX_DEPTH];    //child index taken in that node
+    //read-ahead of a scan, a path like the one above leading to the next leaf to advise
+    uint32_t    readahead_window;       //leaves to have advised ahead of the cursor, 0 when off
+    uint32_t    readahead_ahead;        //leaves advised and not visited yet
+    uint32_t    readahead_key_hi;       //highest key the scan wants
+    uint32_t    readahead_path[BTREE_MAX_DEPTH];
+    uint32_t    readahead_path_index[BTREE_MAX_DEPTH];  //next child to advise at the last level
 }Cursor;
 
+//state of a bottom-up bulk load, leaves are filled in key order and
+//the (page, max key, rows) of every node of the level being built is collected
+typedef struct{
+    Table*      table;
+    uint32_t    leaf_fill;          //bytes of cells and slots per leaf
+    uint32_t    internal_fill;      //children per internal node
+    uint32_t    num_rows;
+    uint32_t    last_key;
+    uint32_t    num_nodes;
+    uint32_t    capacity;
+    uint32_t*   node_pages;
+    uint32_t*   node_keys;
+    uint32_t*   node_counts;
+}BulkLoader;
+
+//a client of the server, only one worker serves it at a time
+typedef struct{
+    int         fd;
+    char*       input;              //bytes read and not yet handled, at most one partial request
+    uint32_t    input_length;
+    uint32_t    input_capacity;
+    char*       output;             //responses not yet sent
+    uint32_t    output_length;
+    uint32_t    output_capacity;
+    uint32_t    slot;               //index in the server's connections
+}ServerConnection;
+
+//server state, the event loop hands readable connections to the workers through a queue
+typedef struct{
+    Table*              table;
+    int                 listen_fd;
+    int                 epoll_fd;
+    pthread_t*          workers;
+    uint32_t            num_workers;
+    ServerConnection**  queue;          //ring of connections with requests to handle
+    uint32_t            queue_head;
+    uint32_t            queue_length;
+    uint32_t            queue_capacity;
+    pthread_mutex_t     queue_lock;     //guards the queue, the writer, the waiting and the open connections
+    pthread_cond_t      queue_ready;
+    ServerConnection*   writer;         //connection allowed to write, NULL when none is
+    ServerConnection**  waiting;        //connections with a write parked until the writer is done
+    uint32_t            num_waiting;
+    uint32_t            waiting_capacity;
+    ServerConnection**  connections;    //every open connection, the ones left at shutdown are closed
+    uint32_t            num_connections;
+    uint32_t            connections_capacity;
+    bool                stopping;
+}Server;
+
+//counters and histograms of one thread, only that thread adds to them so it needs no lock prefix,
+//.stats adds up the blocks of all threads, bucket i of a histogram counts latencies below 2^i ns
+typedef struct ThreadStats{
+    uint64_t            counters[NUM_STAT_COUNTERS];
+    uint64_t            histograms[NUM_STAT_HISTOGRAMS][STATS_HISTOGRAM_BUCKETS];
+    uint64_t            latency_sums[NUM_STAT_HISTOGRAMS];  //ns of all latencies, for the mean
+    uint64_t            latency_maxes[NUM_STAT_HISTOGRAMS]; //ns of the slowest latency since the last reset
+    struct ThreadStats* next;           //blocks of all threads that counted anything, never freed
+}ThreadStats;
+
+//shape of the table's tree, found by walking it
+typedef struct{
+    uint32_t    height;             //levels, 1 for a root leaf
+    uint32_t    num_pages;          //pages of the file
+    uint32_t    free_pages;         //pages on the freelist
+    uint32_t    internal_nodes;
+    uint32_t    leaf_nodes;
+    uint64_t    rows;
+    uint64_t    leaf_bytes_used;    //cell bytes of all leaves, for the fill factor
+}TreeStats;
+
+//block of an arena, its bytes follow the header, which is padded to the alignment of the allocations
+typedef struct __attribute__((aligned(ARENA_ALIGNMENT))) ArenaBlock{
+    struct ArenaBlock*  next;           //the blocks after the current one are spares kept for reuse
+    size_t              capacity;
+    size_t              used;
+}ArenaBlock;
+
+//bump allocator for scratch memory, one per thread, released back to a mark when
+//the statement or batch that took it ends and its blocks kept for the next one
+typedef struct{
+    ArenaBlock* first;
+    ArenaBlock* current;
+}Arena;
+
+//position in an arena to release back to
+typedef struct{
+    ArenaBlock* block;
+    size_t      used;
+}ArenaMark;
+
 //need to use g++ compiler as in C below definitions are not supported
 //c requires them to be compile time constants
 #define size_of_attribute(Struct, Attribute) sizeof(((Struct*)0)->Attribute)
 const uint32_t ID_SIZE          = size_of_attribute(Row, id);
 const uint32_t USERNAME_SIZE    = size_of_attribute(Row, username);
 const uint32_t EMAIL_SIZE       = size_of_attribute(Row, email);
+const uint32_t PAGE_SIZE        = 4096;
+
+//fixed size row of format 0 files, only read when such a file is upgraded
 const uint32_t ID_OFFSET        = 0;
 const uint32_t USERNAME_OFFSET  = ID_OFFSET + ID_SIZE;
 const uint32_t EMAIL_OFFSET     = USERNAME_OFFSET + USERNAME_SIZE;
 const uint32_t ROW_SIZE         = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
-const uint32_t PAGE_SIZE        = 4096;
-const uint32_t ROWS_PER_PAGE    = PAGE_SIZE / ROW_SIZE;
-const uint32_t TABLE_MAX_ROWS   = TABLE_MAX_PAGES * ROWS_PER_PAGE;
+const uint32_t FIXED_LEAF_NODE_HEADER_SIZE  = 14;
+const uint32_t FIXED_LEAF_NODE_CELL_SIZE    = sizeof(uint32_t) + ROW_SIZE;
+const uint32_t FIXED_INTERNAL_NODE_HEADER_SIZE = 14;
+const uint32_t FIXED_INTERNAL_NODE_CELL_SIZE   = 2 * sizeof(uint32_t);   //child then key
+
+//variable length row, the lengths of the strings followed by their bytes without the terminators
+const uint32_t ROW_USERNAME_LENGTH_OFFSET   = 0;
+const uint32_t ROW_EMAIL_LENGTH_OFFSET      = ROW_USERNAME_LENGTH_OFFSET + sizeof(uint8_t);
+const uint32_t ROW_STRINGS_OFFSET           = ROW_EMAIL_LENGTH_OFFSET + sizeof(uint8_t);
+const uint32_t ROW_MAX_PAYLOAD_SIZE         = ROW_STRINGS_OFFSET + COLUMN_USERNAME_SIZE + COLUMN_EMAIL_SIZE;
 
+//db header page format, page 0 of the file
+const uint32_t DB_HEADER_PAGE_NUM               = 0;
+const uint32_t DB_HEADER_MAGIC                  = 0x42445153;
+const uint32_t DB_HEADER_MAGIC_OFFSET           = 0;
+const uint32_t DB_HEADER_ROOT_PAGE_OFFSET       = DB_HEADER_MAGIC_OFFSET + sizeof(uint32_t);
+const uint32_t DB_HEADER_FREELIST_TRUNK_OFFSET  = DB_HEADER_ROOT_PAGE_OFFSET + sizeof(uint32_t);
+const uint32_t DB_HEADER_FREELIST_COUNT_OFFSET  = DB_HEADER_FREELIST_TRUNK_OFFSET + sizeof(uint32_t);
+const uint32_t DB_HEADER_FORMAT_OFFSET          = DB_HEADER_FREELIST_COUNT_OFFSET + sizeof(uint32_t);
+const uint32_t DB_HEADER_INDEX_ROOTS_OFFSET     = DB_HEADER_FORMAT_OFFSET + sizeof(uint32_t);  //one per column, 0 for none
+
+//file format versions, 0 stores fixed size rows, 1 stores variable length rows in slotted leaves,
+//2 keeps the keys of every node in a contiguous array, 3 adds the secondary index roots to the header,
+//4 keeps the number of rows under each child of an internal node,
+//0, 2 and 3 can be upgraded, a 2 file has no indexes
+const uint32_t DB_FORMAT_FIXED_ROWS             = 0;
+const uint32_t DB_FORMAT_NO_INDEXES             = 2;
+const uint32_t DB_FORMAT_NO_COUNTS              = 3;
+const uint32_t DB_FORMAT_VERSION                = 4;
+
+//free list trunk page format, a trunk lists free pages and links to the next trunk
+const uint32_t FREELIST_TRUNK_NEXT_OFFSET   = 0;
+const uint32_t FREELIST_TRUNK_COUNT_OFFSET  = FREELIST_TRUNK_NEXT_OFFSET + sizeof(uint32_t);
+const uint32_t FREELIST_TRUNK_HEADER_SIZE   = FREELIST_TRUNK_COUNT_OFFSET + sizeof(uint32_t);
+const uint32_t FREELIST_TRUNK_MAX_ENTRIES   = (PAGE_SIZE - FREELIST_TRUNK_HEADER_SIZE) / sizeof(uint32_t);
 
 //db constants with btree
 //common node header format
@@ -89,16 +545,29 @@ const uint32_t LEAF_NODE_NUM_CELLS_SIZE     = sizeof(uint32_t);
 const uint32_t LEAF_NODE_NUM_CELLS_OFFSET   = COMMON_NODE_HEADER_SIZE;
 const uint32_t LEAF_NODE_NEXT_LEAF_SIZE     = sizeof(uint32_t);
 const uint32_t LEAF_NODE_NEXT_LEAF_OFFSET   = LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE;
-const uint32_t LEAF_NODE_HEADER_SIZE        = COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NEXT_LEAF_SIZE;
+const uint32_t LEAF_NODE_CONTENT_START_SIZE = sizeof(uint16_t);
+const uint32_t LEAF_NODE_CONTENT_START_OFFSET = LEAF_NODE_NEXT_LEAF_OFFSET + LEAF_NODE_NEXT_LEAF_SIZE;
+const uint32_t LEAF_NODE_FRAGMENTED_SIZE    = sizeof(uint16_t);
+const uint32_t LEAF_NODE_FRAGMENTED_OFFSET  = LEAF_NODE_CONTENT_START_OFFSET + LEAF_NODE_CONTENT_START_SIZE;
+const uint32_t LEAF_NODE_HEADER_SIZE        = LEAF_NODE_FRAGMENTED_OFFSET + LEAF_NODE_FRAGMENTED_SIZE;
 
-//leaf node body format
+//leaf node body format, a slotted page
+//the keys in order and then the slot array of their cell offsets grow down from the header,
+//the cells grow up from the end of the page, the space between them is free
+//a cell is the payload size and the payload, padded to keep the sizes aligned
 const uint32_t LEAF_NODE_KEY_SIZE           = sizeof(uint32_t);
-const uint32_t LEAF_NODE_KEY_OFFSET         = 0;
-const uint32_t LEAF_NODE_VALUE_SIZE         = ROW_SIZE;
-const uint32_t LEAF_NODE_VALUE_OFFSET       = LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
-const uint32_t LEAF_NODE_CELL_SIZE          = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
-const uint32_t LEAF_NODE_SPACE_FOR_CELLS    = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-const uint32_t LEAF_NODE_MAX_CELLS          = LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE;
+const uint32_t LEAF_NODE_KEYS_OFFSET        = (LEAF_NODE_HEADER_SIZE + LEAF_NODE_KEY_SIZE - 1) & ~(LEAF_NODE_KEY_SIZE - 1);
+const uint32_t LEAF_NODE_SLOT_SIZE          = sizeof(uint16_t);
+const uint32_t LEAF_NODE_PAYLOAD_SIZE_SIZE  = sizeof(uint16_t);
+const uint32_t LEAF_NODE_PAYLOAD_SIZE_OFFSET = 0;
+const uint32_t LEAF_NODE_VALUE_OFFSET       = LEAF_NODE_PAYLOAD_SIZE_OFFSET + LEAF_NODE_PAYLOAD_SIZE_SIZE;
+const uint32_t LEAF_NODE_CELL_ALIGNMENT     = sizeof(uint16_t);
+//bytes a cell takes besides its payload and padding, its key and slot
+const uint32_t LEAF_NODE_CELL_OVERHEAD      = LEAF_NODE_KEY_SIZE + LEAF_NODE_SLOT_SIZE;
+const uint32_t LEAF_NODE_SPACE_FOR_CELLS    = PAGE_SIZE - LEAF_NODE_KEYS_OFFSET;
+//largest payload a cell may hold, keeps at least 4 cells in a leaf so a split always leaves both halves fitting
+const uint32_t LEAF_NODE_MAX_PAYLOAD_SIZE   = LEAF_NODE_SPACE_FOR_CELLS / 4 - LEAF_NODE_CELL_OVERHEAD - LEAF_NODE_VALUE_OFFSET - LEAF_NODE_CELL_ALIGNMENT;
+static_assert(ROW_MAX_PAYLOAD_SIZE <= LEAF_NODE_MAX_PAYLOAD_SIZE, "a row must fit in a leaf cell");
 
 //Internal node header format
 const uint32_t INTERNAL_NODE_NUM_KEYS_SIZE      = sizeof(uint32_t);
@@ -107,14 +576,35 @@ const uint32_t INTERNAL_NODE_RIGHT_CHILD_SIZE   = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_RIGHT_CHILD_OFFSET = INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE;
 const uint32_t INTERNAL_NODE_HEADER_SIZE        = COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE + INTERNAL_NODE_RIGHT_CHILD_SIZE;
 
-//Internal node body format
+//Internal node body format, the keys in a contiguous array followed by the array of their children
+//and the array of the number of rows under each child, the right child's count last,
+//child i holds the keys up to key i and the right child the keys above the last one
 const uint32_t INTERNAL_NODE_KEY_SIZE    = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_CHILD_SIZE  = sizeof(uint32_t);
-const uint32_t INTERNAL_NODE_CELL_SIZE   = INTERNAL_NODE_KEY_SIZE + INTERNAL_NODE_CHILD_SIZE;
+const uint32_t INTERNAL_NODE_COUNT_SIZE  = sizeof(uint32_t);
+const uint32_t INTERNAL_NODE_MAX_KEYS    = (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE - INTERNAL_NODE_COUNT_SIZE) /
+                                           (INTERNAL_NODE_KEY_SIZE + INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_COUNT_SIZE);
+const uint32_t INTERNAL_NODE_KEYS_OFFSET     = INTERNAL_NODE_HEADER_SIZE;
+const uint32_t INTERNAL_NODE_CHILDREN_OFFSET = INTERNAL_NODE_KEYS_OFFSET + INTERNAL_NODE_MAX_KEYS * INTERNAL_NODE_KEY_SIZE;
+const uint32_t INTERNAL_NODE_COUNTS_OFFSET   = INTERNAL_NODE_CHILDREN_OFFSET + INTERNAL_NODE_MAX_KEYS * INTERNAL_NODE_CHILD_SIZE;
+
+//internal nodes of format 3 files, the same without the counts, only read when such a file is upgraded
+const uint32_t UNCOUNTED_INTERNAL_NODE_MAX_KEYS         = (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE) / (INTERNAL_NODE_KEY_SIZE + INTERNAL_NODE_CHILD_SIZE);
+const uint32_t UNCOUNTED_INTERNAL_NODE_CHILDREN_OFFSET  = INTERNAL_NODE_KEYS_OFFSET + UNCOUNTED_INTERNAL_NODE_MAX_KEYS * INTERNAL_NODE_KEY_SIZE;
+
+//secondary index node format, the common header then the number of keys and a link like the table's nodes,
+//a leaf links to the next leaf and holds only keys, an internal node links to its right child
+//and holds its other children followed by their keys, child i holds the keys up to key i
+const uint32_t INDEX_ID_SIZE                = sizeof(uint32_t);
+const uint32_t INDEX_NODE_BODY_OFFSET       = (INTERNAL_NODE_HEADER_SIZE + INDEX_ID_SIZE - 1) & ~(INDEX_ID_SIZE - 1);
+const uint32_t INDEX_USERNAME_VALUE_SIZE    = COLUMN_USERNAME_SIZE;
+//emails share long domains, 60 bytes tell nearly all of them apart, the rows are checked for the rest
+const uint32_t INDEX_EMAIL_VALUE_SIZE       = 60;
+const uint32_t INDEX_MAX_KEY_SIZE           = INDEX_EMAIL_VALUE_SIZE + INDEX_ID_SIZE;
 
-//leaf node split counts
-const uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT   = (LEAF_NODE_MAX_CELLS + 1)/2;
-const uint32_t LEAF_NODE_LEFT_SPLIT_COUNT    = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
+//internal node split counts, a full node plus the new key is split around a middle key moved up to the parent
+const uint32_t INTERNAL_NODE_LEFT_SPLIT_COUNT  = (INTERNAL_NODE_MAX_KEYS + 1) / 2;
+const uint32_t INTERNAL_NODE_RIGHT_SPLIT_COUNT = INTERNAL_NODE_MAX_KEYS - INTERNAL_NODE_LEFT_SPLIT_COUNT;
 
 #endif
 
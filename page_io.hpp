@@ -0,0 +1,330 @@
+#ifndef PAGE_IO
+#define PAGE_IO
+#include "mainrepl_struct.hpp"
+#include "stats.hpp"
+#include "arena.hpp"
+
+/*
+*function to compare two requests by file and offset, for qsort
+*@param a   pointer to the first PageIoRequest
+*@param b   pointer to the second PageIoRequest
+*@returns negative, zero or positive as a comes before, with or after b
+*/
+int compare_page_io_requests(const void* a, const void* b){
+    const PageIoRequest* x = (const PageIoRequest*)a;
+    const PageIoRequest* y = (const PageIoRequest*)b;
+    if(x->file_descriptor != y->file_descriptor)
+        return x->file_descriptor < y->file_descriptor ? -1 : 1;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/*
+*function to finish one run, a short transfer goes on from where it stopped until a write is complete
+*or a read finds the end of the file, the rest of the pages of such a read are zeroed, a failure is fatal
+*@param io          pointer to the PageIo running the batch
+*@param run         pointer to the run, its iovecs are used up
+*@param result      bytes transferred, or -errno
+*/
+void page_io_complete(PageIo* io, PageIoRun* run, ssize_t result){
+    PageIoRequest*  first   = &(io->batch[run->first]);
+    struct iovec*   iovecs  = &(io->batch_iovecs[run->first]);
+    uint32_t        count   = run->count;
+    ssize_t         length  = (ssize_t)run->count * PAGE_SIZE;
+    ssize_t         done    = 0;
+    while(true){
+        if(result < 0 || (result == 0 && first->write)){
+            printf("Error %s page at offset %llu: %d\n", first->write ? "writing" : "reading",
+                   (unsigned long long)(first->offset + done), result < 0 ? (int)-result : 0);
+            exit(EXIT_FAILURE);
+        }
+        done += result;
+        if(done == length || result == 0)
+            break;
+
+        //skip the iovecs done, the one stopped in goes on from there
+        while((size_t)result >= iovecs->iov_len){
+            result -= iovecs->iov_len;
+            iovecs++;
+            count--;
+        }
+        iovecs->iov_base    = (char*)iovecs->iov_base + result;
+        iovecs->iov_len    -= result;
+        do{
+            result = first->write ? pwritev(first->file_descriptor, iovecs, count, first->offset + done)
+                                  : preadv(first->file_descriptor, iovecs, count, first->offset + done);
+        }while(result == -1 && errno == EINTR);
+        if(result == -1)
+            result = -errno;
+    }
+    for(uint32_t i = 0; i < run->count && done < length; i++){
+        ssize_t page_start = (ssize_t)i * PAGE_SIZE;
+        if(done < page_start + PAGE_SIZE){
+            ssize_t read = done > page_start ? done - page_start : 0;
+            memset((char*)io->batch[run->first + i].data + read, 0, PAGE_SIZE - read);
+        }
+    }
+}
+
+/*
+*function to set up an io_uring with the raw system calls
+*@param io      pointer to the PageIo to fill in
+*@returns false if the kernel has no io_uring or does not let us use it
+*/
+bool page_io_uring_open(PageIo* io){
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = syscall(__NR_io_uring_setup, PAGE_IO_QUEUE_DEPTH, &params);
+    if(ring_fd < 0)
+        return false;
+
+    //read and write opcodes came with the same kernel as this feature flag
+    if(!(params.features & IORING_FEAT_RW_CUR_POS)){
+        close(ring_fd);
+        return false;
+    }
+
+    io->ring_fd         = ring_fd;
+    io->sq_entries      = params.sq_entries;
+    io->sq_ring_length  = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    io->cq_ring_length  = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    //newer kernels map both rings with one mmap
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap){
+        if(io->cq_ring_length > io->sq_ring_length)
+            io->sq_ring_length = io->cq_ring_length;
+        io->cq_ring_length = io->sq_ring_length;
+    }
+
+    io->sq_ring = mmap(NULL, io->sq_ring_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    io->cq_ring = single_mmap ? io->sq_ring :
+                  mmap(NULL, io->cq_ring_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    io->sqes    = (struct io_uring_sqe*)mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if(io->sq_ring == MAP_FAILED || io->cq_ring == MAP_FAILED || io->sqes == MAP_FAILED){
+        printf("Unable to map the io_uring: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    char* sq = (char*)io->sq_ring;
+    char* cq = (char*)io->cq_ring;
+    io->sq_head     = (uint32_t*)(sq + params.sq_off.head);
+    io->sq_tail     = (uint32_t*)(sq + params.sq_off.tail);
+    io->sq_mask     = (uint32_t*)(sq + params.sq_off.ring_mask);
+    io->sq_array    = (uint32_t*)(sq + params.sq_off.array);
+    io->cq_head     = (uint32_t*)(cq + params.cq_off.head);
+    io->cq_tail     = (uint32_t*)(cq + params.cq_off.tail);
+    io->cq_mask     = (uint32_t*)(cq + params.cq_off.ring_mask);
+    io->cqes        = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+/*
+*function to run the current batch through the io_uring, the ring is kept as full as it can be
+*so a batch of up to the queue depth runs is one system call
+*@param io          pointer to the PageIo in io_uring mode
+*/
+void page_io_uring_run(PageIo* io){
+    uint32_t submitted  = 0;
+    uint32_t completed  = 0;
+    while(completed < io->batch_count){
+        //fill the free submission slots, the cq has twice as many entries so it cannot overflow
+        uint32_t tail = *(io->sq_tail);
+        while(submitted < io->batch_count && submitted - completed < io->sq_entries){
+            PageIoRun*              run     = &(io->batch_runs[submitted]);
+            PageIoRequest*          first   = &(io->batch[run->first]);
+            uint32_t                index   = tail & *(io->sq_mask);
+            struct io_uring_sqe*    sqe     = &(io->sqes[index]);
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode     = first->write ? IORING_OP_WRITEV : IORING_OP_READV;
+            sqe->fd         = first->file_descriptor;
+            sqe->addr       = (uint64_t)(uintptr_t)&(io->batch_iovecs[run->first]);
+            sqe->len        = run->count;
+            sqe->off        = first->offset;
+            sqe->user_data  = submitted;
+            io->sq_array[index] = index;
+            tail++;
+            submitted++;
+        }
+        __atomic_store_n(io->sq_tail, tail, __ATOMIC_RELEASE);
+
+        //submit what the kernel has not taken yet and wait for everything in flight
+        uint32_t to_submit = tail - __atomic_load_n(io->sq_head, __ATOMIC_ACQUIRE);
+        if(syscall(__NR_io_uring_enter, io->ring_fd, to_submit, submitted - completed, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+           && errno != EINTR && errno != EAGAIN && errno != EBUSY){
+            printf("Error submitting page I/O: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+
+        uint32_t head = *(io->cq_head);
+        while(head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE)){
+            struct io_uring_cqe* cqe = &(io->cqes[head & *(io->cq_mask)]);
+            page_io_complete(io, &(io->batch_runs[cqe->user_data]), cqe->res);
+            head++;
+            completed++;
+        }
+        __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+*function run by each I/O thread, transfers runs of the current batch until the PageIo is closed
+*@param argument    pointer to the PageIo
+*@returns NULL
+*/
+void* page_io_thread(void* argument){
+    PageIo* io = (PageIo*)argument;
+    pthread_mutex_lock(&(io->lock));
+    while(true){
+        while(!io->stopping && (io->batch == NULL || io->batch_next == io->batch_count))
+            pthread_cond_wait(&(io->work_ready), &(io->lock));
+        if(io->stopping)
+            break;
+
+        PageIoRun*      run     = &(io->batch_runs[io->batch_next++]);
+        PageIoRequest*  first   = &(io->batch[run->first]);
+        struct iovec*   iovecs  = &(io->batch_iovecs[run->first]);
+        pthread_mutex_unlock(&(io->lock));
+
+        ssize_t result;
+        do{
+            result = first->write ? pwritev(first->file_descriptor, iovecs, run->count, first->offset)
+                                  : preadv(first->file_descriptor, iovecs, run->count, first->offset);
+        }while(result == -1 && errno == EINTR);
+        page_io_complete(io, run, result == -1 ? -errno : result);
+
+        pthread_mutex_lock(&(io->lock));
+        if(++(io->batch_done) == io->batch_count)
+            pthread_cond_signal(&(io->work_done));
+    }
+    pthread_mutex_unlock(&(io->lock));
+    return NULL;
+}
+
+/*
+*function to wait for the thread pool to finish the current batch
+*@param io          pointer to the PageIo in thread mode
+*/
+void page_io_threads_wait(PageIo* io){
+    pthread_mutex_lock(&(io->lock));
+    while(io->batch_done < io->batch_count)
+        pthread_cond_wait(&(io->work_done), &(io->lock));
+    pthread_mutex_unlock(&(io->lock));
+}
+
+/*
+*function to start the batched page I/O, io_uring where the kernel allows it else a thread pool
+*@param use_io_uring    false to go straight to the thread pool
+*@returns a pointer to the PageIo
+*/
+PageIo* page_io_open(bool use_io_uring){
+    PageIo* io      = (PageIo*)calloc(1, sizeof(PageIo));
+    io->ring_fd     = -1;
+    io->stopping    = false;
+    pthread_mutex_init(&(io->submit_lock), NULL);
+    pthread_mutex_init(&(io->lock), NULL);
+    pthread_cond_init(&(io->work_ready), NULL);
+    pthread_cond_init(&(io->work_done), NULL);
+
+    if(use_io_uring && page_io_uring_open(io)){
+        io->mode = PAGE_IO_URING;
+        return io;
+    }
+
+    io->mode        = PAGE_IO_THREADS;
+    io->num_threads = PAGE_IO_NUM_THREADS;
+    io->threads     = (pthread_t*)malloc(io->num_threads * sizeof(pthread_t));
+    for(uint32_t i = 0; i < io->num_threads; i++)
+        pthread_create(&(io->threads[i]), NULL, page_io_thread, io);
+    return io;
+}
+
+/*
+*function to read and write a batch of pages, returns once all of them are done
+*requests are sorted by file and offset, neighbouring pages move together in one vectored transfer
+*@param io          pointer to the PageIo
+*@param requests    requests of the batch, reordered
+*@param count       number of requests
+*/
+void page_io_run(PageIo* io, PageIoRequest* requests, uint32_t count){
+    if(count == 0)
+        return;
+    qsort(requests, count, sizeof(PageIoRequest), compare_page_io_requests);
+
+    ArenaMark       mark        = arena_mark(&statement_arena);
+    struct iovec*   iovecs      = (struct iovec*)arena_alloc(&statement_arena, count * sizeof(struct iovec));
+    PageIoRun*      runs        = (PageIoRun*)arena_alloc(&statement_arena, count * sizeof(PageIoRun));
+    uint32_t        num_runs    = 0;
+    for(uint32_t i = 0; i < count; i++){
+        iovecs[i].iov_base  = requests[i].data;
+        iovecs[i].iov_len   = PAGE_SIZE;
+        stats_count(requests[i].write ? STAT_BYTES_WRITTEN : STAT_BYTES_READ, PAGE_SIZE);
+
+        if(num_runs > 0){
+            PageIoRun*      run     = &(runs[num_runs - 1]);
+            PageIoRequest*  last    = &(requests[i - 1]);
+            if(run->count < PAGE_IO_MAX_RUN && last->file_descriptor == requests[i].file_descriptor &&
+               last->write == requests[i].write && last->offset + PAGE_SIZE == requests[i].offset){
+                run->count++;
+                continue;
+            }
+        }
+        runs[num_runs].first = i;
+        runs[num_runs].count = 1;
+        num_runs++;
+    }
+
+    pthread_mutex_lock(&(io->submit_lock));
+    pthread_mutex_lock(&(io->lock));
+    io->batch           = requests;
+    io->batch_iovecs    = iovecs;
+    io->batch_runs      = runs;
+    io->batch_count     = num_runs;
+    io->batch_next      = 0;
+    io->batch_done      = 0;
+    //the threads find the whole batch in place, one woken early can never take a run twice
+    if(io->mode == PAGE_IO_THREADS)
+        pthread_cond_broadcast(&(io->work_ready));
+    pthread_mutex_unlock(&(io->lock));
+
+    if(io->mode == PAGE_IO_URING)
+        page_io_uring_run(io);
+    else
+        page_io_threads_wait(io);
+
+    pthread_mutex_lock(&(io->lock));
+    io->batch = NULL;
+    pthread_mutex_unlock(&(io->lock));
+    pthread_mutex_unlock(&(io->submit_lock));
+    arena_release(&statement_arena, mark);
+}
+
+/*
+*function to stop the batched page I/O and free it
+*@param io      pointer to the PageIo
+*/
+void page_io_close(PageIo* io){
+    if(io->mode == PAGE_IO_URING){
+        munmap(io->sqes, io->sq_entries * sizeof(struct io_uring_sqe));
+        if(io->cq_ring != io->sq_ring)
+            munmap(io->cq_ring, io->cq_ring_length);
+        munmap(io->sq_ring, io->sq_ring_length);
+        close(io->ring_fd);
+    }
+    else{
+        pthread_mutex_lock(&(io->lock));
+        io->stopping = true;
+        pthread_cond_broadcast(&(io->work_ready));
+        pthread_mutex_unlock(&(io->lock));
+        for(uint32_t i = 0; i < io->num_threads; i++)
+            pthread_join(io->threads[i], NULL);
+        free(io->threads);
+    }
+    pthread_mutex_destroy(&(io->submit_lock));
+    pthread_mutex_destroy(&(io->lock));
+    pthread_cond_destroy(&(io->work_ready));
+    pthread_cond_destroy(&(io->work_done));
+    free(io);
+}
+
+#endif
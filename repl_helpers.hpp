@@ -2,6 +2,11 @@
 #define HELPERS
 #include "mainrepl_struct.hpp"
 #include "b+tree.hpp"
+#include "wal.hpp"
+#include "page_io.hpp"
+#include "column_scan.hpp"
+#include "stats.hpp"
+#include "arena.hpp"
 /*
 *function to create a new input buffer
 *@returns a pointer to new input buffer
@@ -24,17 +29,24 @@ void print_prompt(){
 /*
 *function read input from input_buffer
 *@param     input_buffer    buffer from which the input should be read
+*@returns false at the end of the input
 */
-void read_input(InputBuffer* input_buffer){
+bool read_input(InputBuffer* input_buffer){
     //getline(pointer_to_buffer, buffer_length, input_stream)
-    size_t bytes_read = getline(&(input_buffer->buffer), &(input_buffer->buffer_length), stdin);
+    ssize_t bytes_read = getline(&(input_buffer->buffer), &(input_buffer->buffer_length), stdin);
     if(bytes_read < 0){
+        if(feof(stdin))
+            return false;
         printf("Error in reading input\n");
         exit(EXIT_FAILURE);
     }
 
-    input_buffer->input_length = bytes_read - 1;
-    input_buffer->buffer[bytes_read-1] = 0;
+    //the last line of a script may have no newline
+    if(bytes_read > 0 && input_buffer->buffer[bytes_read - 1] == '\n')
+        bytes_read--;
+    input_buffer->input_length = bytes_read;
+    input_buffer->buffer[bytes_read] = 0;
+    return true;
 }
 
 /*
@@ -46,190 +58,3977 @@ void close_input_buffer(InputBuffer* input_buffer){
     free(input_buffer);
 }
 
+/*
+*function to find the frame caching a page
+*@param     pager       pointer to Pager with the buffer pool
+*@param     page_num    page number to look up
+*@returns the frame index, -1 if the page is not cached
+*/
+int32_t pager_lookup(Pager* pager, uint32_t page_num){
+    int32_t frame_num = pager->page_table[page_num % pager->page_table_size];
+    while(frame_num != -1 && pager->frames[frame_num].page_num != page_num)
+        frame_num = pager->frames[frame_num].hash_next;
+    return frame_num;
+}
+
+/*
+*function to unlink a frame from the LRU list
+*@param     pager       pointer to Pager with the buffer pool
+*@param     frame_num   frame to unlink
+*/
+void lru_remove(Pager* pager, int32_t frame_num){
+    Frame* frame = &(pager->frames[frame_num]);
+
+    if(frame->lru_prev != -1)
+        pager->frames[frame->lru_prev].lru_next = frame->lru_next;
+    else
+        pager->lru_head = frame->lru_next;
+
+    if(frame->lru_next != -1)
+        pager->frames[frame->lru_next].lru_prev = frame->lru_prev;
+    else
+        pager->lru_tail = frame->lru_prev;
+
+    frame->lru_prev = -1;
+    frame->lru_next = -1;
+}
+
+/*
+*function to put a frame at the most recently used end of the LRU list
+*@param     pager       pointer to Pager with the buffer pool
+*@param     frame_num   frame that was just used
+*/
+void lru_push_front(Pager* pager, int32_t frame_num){
+    Frame* frame    = &(pager->frames[frame_num]);
+    frame->lru_prev = -1;
+    frame->lru_next = pager->lru_head;
+
+    if(pager->lru_head != -1)
+        pager->frames[pager->lru_head].lru_prev = frame_num;
+    pager->lru_head = frame_num;
+
+    if(pager->lru_tail == -1)
+        pager->lru_tail = frame_num;
+}
+
+/*
+*function to put a frame at the least recently used end of the LRU list
+*@param     pager       pointer to Pager with the buffer pool
+*@param     frame_num   frame to reuse first
+*/
+void lru_push_back(Pager* pager, int32_t frame_num){
+    Frame* frame    = &(pager->frames[frame_num]);
+    frame->lru_next = -1;
+    frame->lru_prev = pager->lru_tail;
+
+    if(pager->lru_tail != -1)
+        pager->frames[pager->lru_tail].lru_next = frame_num;
+    pager->lru_tail = frame_num;
+
+    if(pager->lru_head == -1)
+        pager->lru_head = frame_num;
+}
+
+//snapshot the calling thread reads at, taken by table_read_begin, without one a thread sees the newest versions
+__thread Pager*     snapshot_pager          = NULL;
+__thread uint64_t   snapshot_commit_num     = 0;
+//pages the calling thread pinned, with the frame of the version each one got
+__thread ThreadPin  thread_pins[PAGER_MAX_THREAD_PINS];
+__thread uint32_t   num_thread_pins         = 0;
+//table the calling thread has a transaction open on, readers of other threads look at it without a lock
+__thread Table*     transaction_table       = NULL;
+
+/*
+*function to check if a frame holds a version a commit replaced, such frames are kept off the LRU list
+*@param     frame       pointer to the frame
+*@returns true for an old version
+*/
+bool frame_is_old(Frame* frame){
+    return frame->version_end < VERSION_PENDING;
+}
+
+/*
+*function to check if the calling thread is the writer copying the pages it fetches
+*@param     pager       pointer to Pager
+*@returns true while the thread's non-exclusive write is in
+*/
+bool pager_copying(Pager* pager){
+    return pager->holding && pthread_equal(pager->holder, pthread_self());
+}
+
+/*
+*function to put a frame in front of the versions of its page, it takes the page's place in the page table
+*@param     pager       pointer to Pager with the buffer pool
+*@param     frame_num   frame holding the newest version
+*/
+void pager_chain_push(Pager* pager, int32_t frame_num){
+    Frame*   frame  = &(pager->frames[frame_num]);
+    int32_t* link   = &(pager->page_table[frame->page_num % pager->page_table_size]);
+    while(*link != -1 && pager->frames[*link].page_num != frame->page_num)
+        link = &(pager->frames[*link].hash_next);
+
+    frame->older        = *link;
+    frame->hash_next    = (*link == -1) ? -1 : pager->frames[*link].hash_next;
+    *link               = frame_num;
+}
+
+/*
+*function to take a frame out of the versions of its page, the next older one takes its place if it was the newest
+*@param     pager       pointer to Pager with the buffer pool
+*@param     frame_num   frame to unlink
+*/
+void pager_chain_unlink(Pager* pager, int32_t frame_num){
+    Frame*   frame  = &(pager->frames[frame_num]);
+    int32_t* link   = &(pager->page_table[frame->page_num % pager->page_table_size]);
+    while(pager->frames[*link].page_num != frame->page_num)
+        link = &(pager->frames[*link].hash_next);
+
+    if(*link == frame_num){
+        if(frame->older != -1){
+            pager->frames[frame->older].hash_next = frame->hash_next;
+            *link = frame->older;
+        }
+        else
+            *link = frame->hash_next;
+    }
+    else{
+        int32_t newer = *link;
+        while(pager->frames[newer].older != frame_num)
+            newer = pager->frames[newer].older;
+        pager->frames[newer].older = frame->older;
+    }
+    frame->older        = -1;
+    frame->hash_next    = -1;
+}
+
+/*
+*function to set up a frame for a page version just read or copied into it
+*@param     pager       pointer to Pager with the buffer pool
+*@param     frame_num   frame to set up
+*@param     page_num    page number of the version
+*@param     begin       version_begin of the version
+*@param     end         version_end of the version
+*/
+void pager_init_frame(Pager* pager, int32_t frame_num, uint32_t page_num, uint64_t begin, uint64_t end){
+    Frame* frame            = &(pager->frames[frame_num]);
+    frame->page_num         = page_num;
+    frame->pin_count        = 0;
+    frame->in_use           = true;
+    frame->dirty            = false;
+    frame->logged           = true;
+    frame->older            = -1;
+    frame->hash_next        = -1;
+    frame->version_begin    = begin;
+    frame->version_end      = end;
+}
+
+/*
+*function to give back a frame from pager_get_free_frame that was not used, it is reused first
+*@param     pager       pointer to Pager with the buffer pool
+*@param     frame_num   the frame
+*/
+void pager_free_frame(Pager* pager, int32_t frame_num){
+    pager->frames[frame_num].in_use         = false;
+    pager->frames[frame_num].version_end    = VERSION_NONE;
+    lru_push_back(pager, frame_num);
+}
+
+/*
+*function to make a committed version old, it is kept off the LRU list until no snapshot needs it
+*@param     pager       pointer to Pager with the buffer pool
+*@param     frame_num   frame of the version
+*@param     commit_num  commit that replaces it
+*/
+void pager_retire_frame(Pager* pager, int32_t frame_num, uint64_t commit_num){
+    pager->frames[frame_num].version_end = commit_num;
+    lru_remove(pager, frame_num);
+    pager->old_versions[pager->num_old_versions++] = frame_num;
+}
+
+/*
+*function to find the committed version of a page the writer has copied
+*@param     pager       pointer to Pager with the buffer pool
+*@param     frame_num   frame of the writer's copy
+*@returns frame of the committed version, -1 if it is not cached
+*/
+int32_t pager_committed_version(Pager* pager, int32_t frame_num){
+    int32_t older = pager->frames[frame_num].older;
+    while(older != -1 && pager->frames[older].version_end != VERSION_PENDING)
+        older = pager->frames[older].older;
+    return older;
+}
+
+/*
+*function to put an old version at the end of the versions of its page
+*@param     pager       pointer to Pager with the buffer pool
+*@param     frame_num   frame of the version
+*/
+void pager_chain_append(Pager* pager, int32_t frame_num){
+    int32_t last = pager_lookup(pager, pager->frames[frame_num].page_num);
+    if(last == -1){
+        pager_chain_push(pager, frame_num);
+        return;
+    }
+    while(pager->frames[last].older != -1)
+        last = pager->frames[last].older;
+    pager->frames[last].older = frame_num;
+}
+
+/*
+*function to check if an old version may still be read
+*@param     pager       pointer to Pager
+*@param     begin       version_begin of the version
+*@param     end         version_end of the version
+*@returns true while a snapshot sees it, or while the commit it was retired ahead of has not come
+*/
+bool pager_version_needed(Pager* pager, uint64_t begin, uint64_t end){
+    if(end > pager->commit_num)
+        return true;
+    for(uint32_t i = 0; i < pager->num_snapshots; i++)
+        if(begin <= pager->snapshots[i] && pager->snapshots[i] < end)
+            return true;
+    return false;
+}
+
+/*
+*function to write an old version of a page to a free slot of the version store
+*@param     pager       pointer to Pager, the caller holds the pager lock
+*@param     page_num    page number of the version
+*@param     begin       version_begin of the version
+*@param     end         version_end of the version
+*@param     data        the page image
+*/
+void pager_store_version(Pager* pager, uint32_t page_num, uint64_t begin, uint64_t end, void* data){
+    uint32_t slot;
+    if(pager->num_free_slots > 0)
+        slot = pager->free_slots[--pager->num_free_slots];
+    else{
+        slot = pager->num_slots++;
+        //a slot is free or holds a version, the free list never outgrows the slots
+        if(pager->num_slots > pager->slots_capacity){
+            pager->slots_capacity   = pager->slots_capacity ? pager->slots_capacity * 2 : 64;
+            pager->free_slots       = (uint32_t*)realloc(pager->free_slots, pager->slots_capacity * sizeof(uint32_t));
+        }
+    }
+    if(pwrite(pager->versions_fd, data, PAGE_SIZE, (off_t)slot * PAGE_SIZE) == -1){
+        printf("Error writing version store: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    if(pager->num_stored_versions == pager->stored_capacity){
+        pager->stored_capacity  = pager->stored_capacity ? pager->stored_capacity * 2 : 64;
+        pager->stored_versions  = (StoredVersion*)realloc(pager->stored_versions, pager->stored_capacity * sizeof(StoredVersion));
+    }
+    StoredVersion version                               = {page_num, slot, begin, end};
+    pager->stored_versions[pager->num_stored_versions++]  = version;
+    stats_count(STAT_VERSION_SPILLS, 1);
+}
+
+/*
+*function to forget a version in the version store, its slot is reused
+*@param     pager       pointer to Pager, the caller holds the pager lock
+*@param     i           index of the version in stored_versions
+*/
+void pager_drop_stored_version(Pager* pager, uint32_t i){
+    pager->free_slots[pager->num_free_slots++]  = pager->stored_versions[i].slot;
+    pager->stored_versions[i]                   = pager->stored_versions[--pager->num_stored_versions];
+}
+
+/*
+*function to find where the newest old version of a page ends, cached or stored, the version after it begins there
+*@param     pager       pointer to Pager, the caller holds the pager lock
+*@param     page_num    page number
+*@returns version_end of the newest old version, 0 if the page has none
+*/
+uint64_t pager_newest_version_end(Pager* pager, uint32_t page_num){
+    uint64_t end = 0;
+    for(int32_t frame_num = pager_lookup(pager, page_num); frame_num != -1; frame_num = pager->frames[frame_num].older)
+        if(frame_is_old(&(pager->frames[frame_num])) && pager->frames[frame_num].version_end > end)
+            end = pager->frames[frame_num].version_end;
+    for(uint32_t i = 0; i < pager->num_stored_versions; i++)
+        if(pager->stored_versions[i].page_num == page_num && pager->stored_versions[i].version_end > end)
+            end = pager->stored_versions[i].version_end;
+    return end;
+}
+
+/*
+*function to free the old versions, cached or stored, no snapshot sees anymore and no thread has pinned,
+*one retired ahead of the commit that replaces it is kept until that commit
+*@param     pager       pointer to Pager, the caller holds the pager lock
+*/
+void pager_reclaim_versions(Pager* pager){
+    for(uint32_t i = 0; i < pager->num_old_versions;){
+        int32_t frame_num   = pager->old_versions[i];
+        Frame*  frame       = &(pager->frames[frame_num]);
+        if(frame->pin_count > 0 || pager_version_needed(pager, frame->version_begin, frame->version_end)){
+            i++;
+            continue;
+        }
+        pager_chain_unlink(pager, frame_num);
+        frame->dirty = false;
+        pager_free_frame(pager, frame_num);
+        pager->old_versions[i] = pager->old_versions[--pager->num_old_versions];
+    }
+    for(uint32_t i = 0; i < pager->num_stored_versions;){
+        StoredVersion* version = &(pager->stored_versions[i]);
+        if(pager_version_needed(pager, version->version_begin, version->version_end))
+            i++;
+        else
+            pager_drop_stored_version(pager, i);
+    }
+}
+
+/*
+*function to free the frame of an old version no thread has pinned, the version goes to the version store
+*@param     pager       pointer to Pager, the caller holds the pager lock
+*@returns the frame, off the LRU list, -1 if every old version is pinned
+*/
+int32_t pager_spill_version(Pager* pager){
+    for(uint32_t i = 0; i < pager->num_old_versions; i++){
+        int32_t frame_num   = pager->old_versions[i];
+        Frame*  frame       = &(pager->frames[frame_num]);
+        if(frame->pin_count > 0)
+            continue;
+        pager_store_version(pager, frame->page_num, frame->version_begin, frame->version_end, frame->data);
+        pager_chain_unlink(pager, frame_num);
+        pager->old_versions[i]  = pager->old_versions[--pager->num_old_versions];
+        frame->in_use           = false;
+        frame->dirty            = false;
+        frame->version_end      = VERSION_NONE;
+        return frame_num;
+    }
+    return -1;
+}
+
+/*
+*function to remember a page the writer has its own copy of, the copy is published by the next commit
+*@param     pager       pointer to Pager
+*@param     page_num    page number of the copy
+*/
+void pager_add_private_page(Pager* pager, uint32_t page_num){
+    if(pager->num_private_pages == pager->private_capacity){
+        pager->private_capacity = pager->private_capacity ? pager->private_capacity * 2 : 64;
+        pager->private_pages    = (uint32_t*)realloc(pager->private_pages, pager->private_capacity * sizeof(uint32_t));
+    }
+    pager->private_pages[pager->num_private_pages++] = page_num;
+}
+
+/*
+*function to check if the writer has a copy of a page, cached or spilled to the log
+*@param     pager       pointer to Pager
+*@param     page_num    page number to check
+*@returns true if the page has a version newer than the last commit
+*/
+bool pager_has_private(Pager* pager, uint32_t page_num){
+    int32_t head = pager_lookup(pager, page_num);
+    if(head != -1 && pager->frames[head].version_begin == VERSION_PENDING)
+        return true;
+    return pager->wal != NULL && wal_spilled(pager->wal, page_num);
+}
+
+/*
+*function to read an image of a page, from the log if it has a frame of the page, else from the db file
+*@param     pager       pointer to Pager
+*@param     page_num    page number of the image
+*@param     wal_offset  offset of the frame in the log, 0 to read the db file
+*@param     data        buffer of PAGE_SIZE bytes to read into, zeros for a page past the end of the file
+*/
+void pager_read_image(Pager* pager, uint32_t page_num, uint64_t wal_offset, void* data){
+    memset(data, 0, PAGE_SIZE);
+    if(wal_offset != 0){
+        wal_read_page(pager->wal, wal_offset, data);
+        stats_count(STAT_BYTES_READ, PAGE_SIZE);
+    }
+    else if((uint64_t)page_num * PAGE_SIZE < pager->file_length){
+        //read from file to memory at the page offset
+        ssize_t bytes_read = pread(pager->file_descriptor, data, PAGE_SIZE, (off_t)page_num * PAGE_SIZE);
+        if(bytes_read == -1){
+            printf("Error reading file: %d\n.", errno);
+            exit(EXIT_FAILURE);
+        }
+        stats_count(STAT_BYTES_READ, bytes_read);
+    }
+}
+
+/*
+*function to cut the db file back to the pages in use, after pages at its end were freed
+*@param     pager       pointer to Pager
+*/
+void pager_truncate_file(Pager* pager){
+    uint64_t length = (uint64_t)pager->num_pages * PAGE_SIZE;
+    if(pager->mode == PAGER_MMAP || pager->file_length <= length)
+        return;
+
+    if(ftruncate(pager->file_descriptor, length) == -1){
+        printf("Error truncating db file: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    pager->file_length = length;
+}
+
+/*
+*function to write a cached frame to its page in the db file
+*@param     pager       pointer to Pager with file handle and the pages info
+*@param     frame       frame holding the page to write
+*/
+void pager_write_frame(Pager* pager, Frame* frame){
+    //write page contents into the file at the page index, pwrite keeps no shared file offset
+    ssize_t bytes_written = pwrite(pager->file_descriptor, frame->data, PAGE_SIZE, (off_t)frame->page_num * PAGE_SIZE);
+
+    if(bytes_written == -1){
+        printf("Error writing:%d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    stats_count(STAT_BYTES_WRITTEN, PAGE_SIZE);
+
+    //keep track of the file growing, evicted pages are read back from it
+    if(((off_t)frame->page_num + 1) * PAGE_SIZE > pager->file_length)
+        pager->file_length = ((off_t)frame->page_num + 1) * PAGE_SIZE;
+
+    frame->dirty = false;
+}
+
 /*
 *function to flush the data to the db file
 *@param     pager       pointer to Pager with file handle and the pages info
 *@param     page_num    page number of the page to be flushed
 */
-void pager_flush(Pager* pager, uint32_t page_num){
-    if (pager->pages[page_num] == NULL){
-        printf("Tried to flush a null page.\n");
-        exit(EXIT_FAILURE);
+void pager_flush(Pager* pager, uint32_t page_num){
+    if(pager->mode == PAGER_MMAP){
+        if(msync(pager->map + (uint64_t)page_num * PAGE_SIZE, PAGE_SIZE, MS_SYNC) == -1){
+            printf("Error syncing page %d: %d\n", page_num, errno);
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+
+    int32_t frame_num = pager_lookup(pager, page_num);
+    if (frame_num == -1){
+        printf("Tried to flush a null page.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pager_write_frame(pager, &(pager->frames[frame_num]));
+}
+
+/*
+*function to write every dirty cached page to the db file as one batch, the caller holds the pager lock
+*only the newest version of a page is written, old ones are only kept for snapshots
+*@param     pager       pointer to Pager in buffered mode
+*/
+void pager_write_dirty_frames(Pager* pager){
+    ArenaMark       mark        = arena_mark(&statement_arena);
+    PageIoRequest*  requests    = (PageIoRequest*)arena_alloc(&statement_arena, pager->num_frames * sizeof(PageIoRequest));
+    uint32_t        count       = 0;
+    for(uint32_t i = 0; i < pager->num_frames; i++){
+        Frame* frame = &(pager->frames[i]);
+        if(!frame->in_use || !frame->dirty || frame->version_end != VERSION_NONE)
+            continue;
+        requests[count].file_descriptor = pager->file_descriptor;
+        requests[count].data            = frame->data;
+        requests[count].offset          = (uint64_t)frame->page_num * PAGE_SIZE;
+        requests[count].write           = true;
+        count++;
+        frame->dirty = false;
+        if(((off_t)frame->page_num + 1) * PAGE_SIZE > pager->file_length)
+            pager->file_length = ((off_t)frame->page_num + 1) * PAGE_SIZE;
+    }
+    page_io_run(pager->io, requests, count);
+    arena_release(&statement_arena, mark);
+}
+
+/*
+*function to copy a batch of page images from the log into the db file
+*@param     pager       pointer to Pager with a write-ahead log
+*@param     requests    reads of the images, the i-th reads into the i-th page of buffer
+*@param     buffer      count pages to read the images into
+*@param     page_nums   page number of the image read into each page of buffer
+*@param     count       number of pages in the batch
+*/
+void pager_copy_logged_batch(Pager* pager, PageIoRequest* requests, char* buffer, uint32_t* page_nums, uint32_t count){
+    page_io_run(pager->io, requests, count);
+
+    //the reads were reordered by log offset, the buffer a page was read into tells which page it is
+    for(uint32_t i = 0; i < count; i++){
+        uint32_t page_num = page_nums[((char*)requests[i].data - buffer) / PAGE_SIZE];
+        requests[i].file_descriptor = pager->file_descriptor;
+        requests[i].offset          = (uint64_t)page_num * PAGE_SIZE;
+        requests[i].write           = true;
+        if(((off_t)page_num + 1) * PAGE_SIZE > pager->file_length)
+            pager->file_length = ((off_t)page_num + 1) * PAGE_SIZE;
+    }
+    page_io_run(pager->io, requests, count);
+}
+
+/*
+*function to copy the pages that only have their image in the log into the db file
+*@param     pager       pointer to Pager with a write-ahead log, the caller holds the pager lock
+*/
+void pager_copy_logged_pages(Pager* pager){
+    Wal*            wal         = pager->wal;
+    ArenaMark       mark        = arena_mark(&statement_arena);
+    char*           buffer      = (char*)arena_alloc(&statement_arena, (size_t)PAGE_IO_BATCH_PAGES * PAGE_SIZE);
+    PageIoRequest*  requests    = (PageIoRequest*)arena_alloc(&statement_arena, PAGE_IO_BATCH_PAGES * sizeof(PageIoRequest));
+    uint32_t*       page_nums   = (uint32_t*)arena_alloc(&statement_arena, PAGE_IO_BATCH_PAGES * sizeof(uint32_t));
+    uint32_t        count       = 0;
+
+    for(uint32_t i = 0; i < wal->index_size; i++){
+        //pages past the end were truncated after they were logged, cached newest versions were written already
+        uint32_t page_num = wal->index_pages[i];
+        if(page_num == UINT32_MAX || page_num >= pager->num_pages)
+            continue;
+        int32_t head = pager_lookup(pager, page_num);
+        if(head != -1 && pager->frames[head].version_end == VERSION_NONE)
+            continue;
+
+        requests[count].file_descriptor = wal->file_descriptor;
+        requests[count].data            = buffer + (size_t)count * PAGE_SIZE;
+        requests[count].offset          = wal->index_offsets[i] + sizeof(WalFrameHeader);
+        requests[count].write           = false;
+        page_nums[count]                = page_num;
+        if(++count == PAGE_IO_BATCH_PAGES){
+            pager_copy_logged_batch(pager, requests, buffer, page_nums, count);
+            count = 0;
+        }
+    }
+    pager_copy_logged_batch(pager, requests, buffer, page_nums, count);
+    arena_release(&statement_arena, mark);
+}
+
+/*
+*function to write all modified pages to the db file and sync it to disk
+*@param     pager       pointer to Pager
+*/
+void pager_checkpoint(Pager* pager){
+    if(pager->mode == PAGER_MMAP){
+        if(msync(pager->map, pager->map_length, MS_SYNC) == -1){
+            printf("Error syncing db file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+
+    uint64_t start = stats_now();
+    pthread_mutex_lock(&(pager->lock));
+
+    pager_write_dirty_frames(pager);
+
+    //pages evicted since the last checkpoint only have their image in the log
+    Wal* wal = pager->wal;
+    if(wal != NULL && wal->index_count > 0)
+        pager_copy_logged_pages(pager);
+
+    pager_truncate_file(pager);
+    if(fsync(pager->file_descriptor) == -1){
+        printf("Error syncing db file: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    //everything in the log is in the db file now
+    if(wal != NULL)
+        wal_reset(wal);
+    pthread_mutex_unlock(&(pager->lock));
+    stats_time(STAT_LATENCY_CHECKPOINT, start);
+}
+
+/*
+*function to compare two frames by the page they hold, for qsort_r
+*@param a       pointer to the first frame number
+*@param b       pointer to the second frame number
+*@param pager   the Pager the frames are in
+*/
+int compare_frames_by_page(const void* a, const void* b, void* pager){
+    uint32_t x = ((Pager*)pager)->frames[*(const int32_t*)a].page_num;
+    uint32_t y = ((Pager*)pager)->frames[*(const int32_t*)b].page_num;
+    return (x > y) - (x < y);
+}
+
+/*
+*function to write a few dirty pages to the db file while no writer is in, the pages are taken
+*in page order from where the last step stopped, so the sweep moves through the file in one
+*direction, with a log only committed pages are dirty then and the log still has their images,
+*a log grown past WAL_AUTOCHECKPOINT is checkpointed instead
+*@param     table       pointer to the table
+*/
+void writeback_step(Table* table){
+    Writeback*  writeback   = table->writeback;
+    Pager*      pager       = table->pager;
+    //a statement or a transaction is changing pages, try again at the next interval
+    if(pthread_mutex_trylock(&(table->write_lock)) != 0)
+        return;
+
+    if(pager->wal != NULL && pager->wal->num_frames >= WAL_AUTOCHECKPOINT){
+        pager_checkpoint(pager);
+        pthread_mutex_unlock(&(table->write_lock));
+        return;
+    }
+
+    ArenaMark       mark        = arena_mark(&statement_arena);
+    int32_t*        frame_nums  = (int32_t*)arena_alloc(&statement_arena, pager->num_frames * sizeof(int32_t));
+    PageIoRequest*  requests    = (PageIoRequest*)arena_alloc(&statement_arena, writeback->pages_per_step * sizeof(PageIoRequest));
+    uint32_t        count       = 0;
+
+    pthread_mutex_lock(&(pager->lock));
+    for(uint32_t i = 0; i < pager->num_frames; i++)
+        if(pager->frames[i].in_use && pager->frames[i].dirty && pager->frames[i].version_end == VERSION_NONE)
+            frame_nums[count++] = i;
+    qsort_r(frame_nums, count, sizeof(int32_t), compare_frames_by_page, pager);
+
+    uint32_t start = 0;
+    while(start < count && pager->frames[frame_nums[start]].page_num < writeback->next_page_num)
+        start++;
+    uint32_t num_requests = (count < writeback->pages_per_step) ? count : writeback->pages_per_step;
+    //selects run alongside the step and need frames of their own, it pins at most a quarter of the pool
+    if(num_requests > pager->num_frames / 4)
+        num_requests = pager->num_frames / 4;
+    //pinned so readers cannot evict a page and read the old one back from the file before it is written
+    for(uint32_t i = 0; i < num_requests; i++){
+        Frame* frame = &(pager->frames[frame_nums[(start + i) % count]]);
+        frame->pin_count++;
+        requests[i].file_descriptor = pager->file_descriptor;
+        requests[i].data            = frame->data;
+        requests[i].offset          = (uint64_t)frame->page_num * PAGE_SIZE;
+        requests[i].write           = true;
+    }
+    pthread_mutex_unlock(&(pager->lock));
+
+    page_io_run(pager->io, requests, num_requests);
+
+    pthread_mutex_lock(&(pager->lock));
+    for(uint32_t i = 0; i < num_requests; i++){
+        Frame* frame = &(pager->frames[frame_nums[(start + i) % count]]);
+        frame->dirty = false;
+        frame->pin_count--;
+        if(((off_t)frame->page_num + 1) * PAGE_SIZE > pager->file_length)
+            pager->file_length = ((off_t)frame->page_num + 1) * PAGE_SIZE;
+        writeback->next_page_num = frame->page_num + 1;
+    }
+    pthread_mutex_unlock(&(pager->lock));
+    pthread_mutex_unlock(&(table->write_lock));
+    arena_release(&statement_arena, mark);
+}
+
+/*
+*function run by the background writer, a step every WRITEBACK_INTERVAL_MS until it is stopped
+*@param     argument    pointer to the table
+*/
+void* writeback_main(void* argument){
+    Table*      table       = (Table*)argument;
+    Writeback*  writeback   = table->writeback;
+    pthread_mutex_lock(&(writeback->lock));
+    while(!writeback->stopping){
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += (long)WRITEBACK_INTERVAL_MS * 1000000;
+        deadline.tv_sec  += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&(writeback->wake), &(writeback->lock), &deadline);
+        if(writeback->stopping)
+            break;
+        pthread_mutex_unlock(&(writeback->lock));
+        writeback_step(table);
+        pthread_mutex_lock(&(writeback->lock));
+    }
+    pthread_mutex_unlock(&(writeback->lock));
+    return NULL;
+}
+
+/*
+*function to start the background writer of a buffered table, it takes over the checkpoints
+*of the log, commits only checkpoint when the writer falls behind by WAL_CHECKPOINT_BACKLOG times
+*@param     table       pointer to the table
+*@param     rate        dirty pages to write per second
+*/
+void writeback_start(Table* table, uint32_t rate){
+    Writeback* writeback        = (Writeback*)malloc(sizeof(Writeback));
+    writeback->stopping         = false;
+    writeback->pages_per_step   = (uint64_t)rate * WRITEBACK_INTERVAL_MS / 1000;
+    writeback->next_page_num    = 0;
+    if(writeback->pages_per_step == 0)
+        writeback->pages_per_step = 1;
+    pthread_mutex_init(&(writeback->lock), NULL);
+    pthread_condattr_t wake_attr;
+    pthread_condattr_init(&wake_attr);
+    pthread_condattr_setclock(&wake_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&(writeback->wake), &wake_attr);
+    pthread_condattr_destroy(&wake_attr);
+
+    table->writeback                        = writeback;
+    table->pager->background_checkpoints    = true;
+    if(pthread_create(&(writeback->thread), NULL, writeback_main, table) != 0){
+        printf("Unable to start the background writer.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+*function to stop the background writer and wait for its step to finish
+*@param     table       pointer to the table
+*/
+void writeback_stop(Table* table){
+    Writeback* writeback = table->writeback;
+    if(writeback == NULL)
+        return;
+    pthread_mutex_lock(&(writeback->lock));
+    writeback->stopping = true;
+    pthread_cond_signal(&(writeback->wake));
+    pthread_mutex_unlock(&(writeback->lock));
+    pthread_join(writeback->thread, NULL);
+
+    pthread_mutex_destroy(&(writeback->lock));
+    pthread_cond_destroy(&(writeback->wake));
+    free(writeback);
+    table->writeback                        = NULL;
+    table->pager->background_checkpoints    = false;
+}
+
+/*
+*function to close the db, writes back the dirty pages and frees the buffer pool
+*an open transaction is dropped, the committed frames before it are recovered on the next open
+*@param     table       pointer to the Table contents
+*/
+void db_close(Table* table){
+    Pager* pager            = table->pager;
+    writeback_stop(table);
+
+    if(pager->wal != NULL){
+        if(!table->in_transaction)
+            pager_checkpoint(pager);
+        wal_close(pager->wal);
+        pager->wal = NULL;
+        //nothing left to write back, committed pages are in the db file or in the log
+        for(uint32_t i = 0; i < pager->num_frames; i++)
+            pager->frames[i].dirty = false;
+    }
+
+    //the mapping grows in extents, cut the file back to the pages in use
+    if(pager->mode == PAGER_MMAP){
+        pager_checkpoint(pager);
+        munmap(pager->map, MMAP_MAX_SIZE);
+        if(ftruncate(pager->file_descriptor, (off_t)pager->num_pages * PAGE_SIZE) == -1){
+            printf("Error truncating db file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(pager->io != NULL){
+        pager_write_dirty_frames(pager);
+        page_io_close(pager->io);
+    }
+    if(pager->frame_slab_hugetlb)
+        munmap(pager->frame_slab, pager->frame_slab_length);
+    else
+        free(pager->frame_slab);
+    pager_truncate_file(pager);
+
+    int result = close(pager->file_descriptor);
+    if(result == -1){
+        printf("Error closing db file.\n");
+        exit(EXIT_FAILURE);
+    }
+    if(pager->versions_fd != -1)
+        close(pager->versions_fd);
+
+    for(uint32_t column = COLUMN_USERNAME; column < NUM_COLUMNS; column++)
+        free(table->indexes[column]);
+    pthread_mutex_destroy(&(pager->lock));
+    pthread_cond_destroy(&(pager->versions_released));
+    pthread_rwlock_destroy(&(table->lock));
+    pthread_mutex_destroy(&(table->write_lock));
+    free (pager->held_pages);
+    free (pager->unlogged_pages);
+    free (pager->private_pages);
+    free (pager->old_versions);
+    free (pager->stored_versions);
+    free (pager->free_slots);
+    free (pager->snapshots);
+    free (pager->frames);
+    free (pager->page_table);
+    free (pager);
+    free (table);
+}
+
+/*
+*function to find the least recently used frame no thread has pinned
+*@param     pager       pointer to Pager with the buffer pool
+*@returns index of the frame, -1 if there is none
+*/
+int32_t pager_find_victim(Pager* pager){
+    for(int32_t victim = pager->lru_tail; victim != -1; victim = pager->frames[victim].lru_prev)
+        if(pager->frames[victim].pin_count == 0)
+            return victim;
+    return -1;
+}
+
+/*
+*function to get a frame for a new page, uses an empty frame while there is one,
+*else evicts the least recently used unpinned page, writing it back if it is dirty,
+*then an old version, moving it to the version store,
+*with every frame pinned it waits for a snapshot to end, letting go of the pager lock
+*@param     pager       pointer to Pager with the buffer pool, its lock held once
+*@returns index of a frame that is free to use
+*/
+int32_t pager_get_free_frame(Pager* pager){
+    if(pager->num_used_frames < pager->num_frames)
+        return pager->num_used_frames++;
+
+    int32_t victim;
+    while((victim = pager_find_victim(pager)) == -1){
+        victim = pager_spill_version(pager);
+        if(victim != -1)
+            return victim;
+        //a snapshot holder still running lets go of its pins when it ends
+        uint32_t holder = (snapshot_pager == pager) ? 1 : 0;
+        if(pager->num_snapshots <= pager->num_waiting_snapshots + holder){
+            printf("Buffer pool exhausted, all %d frames are pinned.\n", pager->num_frames);
+            exit(EXIT_FAILURE);
+        }
+        pager->num_waiting_snapshots   += holder;
+        pager->frame_waits++;
+        pthread_cond_wait(&(pager->versions_released), &(pager->lock));
+        pager->num_waiting_snapshots   -= holder;
+    }
+
+    //dropped frames hold no page
+    Frame* frame = &(pager->frames[victim]);
+    if(!frame->in_use){
+        lru_remove(pager, victim);
+        return victim;
+    }
+
+    if(frame->version_begin == VERSION_PENDING && pager->wal == NULL){
+        //without a log the copy is written in place, the committed version is kept for snapshots until the commit
+        uint64_t next       = pager->commit_num + 1;
+        int32_t  committed  = pager_committed_version(pager, victim);
+        if(committed != -1)
+            pager_retire_frame(pager, committed, next);
+        else if(pager_newest_version_end(pager, frame->page_num) != next){
+            ArenaMark   mark    = arena_mark(&statement_arena);
+            void*       image   = arena_alloc(&statement_arena, PAGE_SIZE);
+            pager_read_image(pager, frame->page_num, 0, image);
+            pager_store_version(pager, frame->page_num, pager_newest_version_end(pager, frame->page_num), next, image);
+            arena_release(&statement_arena, mark);
+        }
+        if(frame->dirty)
+            pager_write_frame(pager, frame);
+    }
+    else if(frame->version_begin == VERSION_PENDING){
+        //the writer's changed copy goes to the log past the last commit
+        if(!frame->logged){
+            wal_append(pager->wal, frame->page_num, frame->data, 0);
+            pager->txn_frames++;
+        }
+        //an unchanged one leaves the committed version the newest again
+        else if(!wal_spilled(pager->wal, frame->page_num)){
+            for(int32_t older = frame->older; older != -1; older = pager->frames[older].older)
+                if(pager->frames[older].version_end == VERSION_PENDING)
+                    pager->frames[older].version_end = VERSION_NONE;
+        }
+    }
+    //with a write-ahead log a dirty page goes to the log, the db file is only written at checkpoints
+    else if(frame->dirty && pager->wal != NULL){
+        if(!frame->logged){
+            wal_append(pager->wal, frame->page_num, frame->data, 0);
+            pager->txn_frames++;
+        }
+    }
+    else if(frame->dirty)
+        pager_write_frame(pager, frame);
+
+    pager_chain_unlink(pager, victim);
+    lru_remove(pager, victim);
+    frame->in_use = false;
+    stats_count(STAT_PAGE_EVICTIONS, 1);
+    return victim;
+}
+
+/*
+*function to forget a cached page without writing it back, used for pages cut off the end of the file
+*@param     pager       pointer to Pager with the buffer pool
+*@param     page_num    page number to drop
+*/
+void pager_drop_page(Pager* pager, uint32_t page_num){
+    if(pager->mode == PAGER_MMAP)
+        return;
+    pthread_mutex_lock(&(pager->lock));
+    //readers are kept out, the versions of the page all go
+    int32_t frame_num;
+    while((frame_num = pager_lookup(pager, page_num)) != -1){
+        Frame* frame = &(pager->frames[frame_num]);
+        if(frame->pin_count > 0){
+            printf("Tried to drop page %d which is pinned.\n", page_num);
+            exit(EXIT_FAILURE);
+        }
+        pager_chain_unlink(pager, frame_num);
+        if(frame_is_old(frame)){
+            for(uint32_t i = 0; i < pager->num_old_versions; i++)
+                if(pager->old_versions[i] == frame_num)
+                    pager->old_versions[i] = pager->old_versions[--pager->num_old_versions];
+        }
+        else
+            lru_remove(pager, frame_num);
+        //reuse the empty frame before evicting anything
+        frame->dirty = false;
+        pager_free_frame(pager, frame_num);
+    }
+    for(uint32_t i = 0; i < pager->num_stored_versions;){
+        if(pager->stored_versions[i].page_num == page_num)
+            pager_drop_stored_version(pager, i);
+        else
+            i++;
+    }
+    pthread_mutex_unlock(&(pager->lock));
+}
+
+/*
+*function to mark a cached page as modified, so it is written back on eviction or close
+*@param     pager      pointer to Pager
+*@param     page_num   page number of the modified page
+*/
+void pager_mark_dirty(Pager* pager, uint32_t page_num){
+    //the kernel tracks dirty mapped pages
+    if(pager->mode == PAGER_MMAP)
+        return;
+    pthread_mutex_lock(&(pager->lock));
+    int32_t frame_num = pager_lookup(pager, page_num);
+    if(frame_num == -1){
+        printf("Tried to mark page %d dirty which is not cached.\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+
+    Frame* frame = &(pager->frames[frame_num]);
+    frame->dirty = true;
+
+    //remember the page for the next commit
+    if(pager->wal != NULL && frame->logged){
+        frame->logged = false;
+        if(pager->num_unlogged_pages == pager->unlogged_capacity){
+            pager->unlogged_capacity    = pager->unlogged_capacity ? pager->unlogged_capacity * 2 : 64;
+            pager->unlogged_pages       = (uint32_t*)realloc(pager->unlogged_pages, pager->unlogged_capacity * sizeof(uint32_t));
+        }
+        pager->unlogged_pages[pager->num_unlogged_pages++] = page_num;
+    }
+    pthread_mutex_unlock(&(pager->lock));
+}
+
+/*
+*function to map the db file up to and including a page, the file is grown
+*in extents and mapped in place inside the reserved range so pages never move
+*@param     pager      pointer to Pager in mmap mode
+*@param     page_num   page number that must be mapped
+*/
+void pager_mmap_grow(Pager* pager, uint32_t page_num){
+    uint64_t needed     = ((uint64_t)page_num + 1) * PAGE_SIZE;
+    uint64_t new_length = (needed + MMAP_EXTENT_SIZE - 1) / MMAP_EXTENT_SIZE * MMAP_EXTENT_SIZE;
+    if(new_length > MMAP_MAX_SIZE){
+        printf("Tried to map page %d past the %llu byte mmap limit.\n", page_num, MMAP_MAX_SIZE);
+        exit(EXIT_FAILURE);
+    }
+
+    if(new_length > pager->file_length){
+        if(ftruncate(pager->file_descriptor, new_length) == -1){
+            printf("Error growing db file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        pager->file_length = new_length;
+    }
+
+    void* extent = mmap(pager->map + pager->map_length, new_length - pager->map_length,
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                        pager->file_descriptor, pager->map_length);
+    if(extent == MAP_FAILED){
+        printf("Error mapping db file: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    pager->map_length = new_length;
+}
+
+/*
+*function to copy the committed version of a page for the writer to change, the version stays for snapshots
+*@param     pager       pointer to Pager, the caller holds the pager lock
+*@param     frame_num   frame of the newest committed version
+*@returns frame of the copy, -1 if the lock was let go while waiting for a frame and the page has to be looked up again
+*/
+int32_t pager_copy_frame(Pager* pager, int32_t frame_num){
+    Frame*   frame  = &(pager->frames[frame_num]);
+    uint64_t waits  = pager->frame_waits;
+    //the version being copied must not be the one evicted for the copy
+    frame->pin_count++;
+    int32_t copy_num = pager_get_free_frame(pager);
+    frame->pin_count--;
+    if(pager->frame_waits != waits){
+        pager_free_frame(pager, copy_num);
+        return -1;
+    }
+
+    Frame* copy = &(pager->frames[copy_num]);
+    memcpy(copy->data, frame->data, PAGE_SIZE);
+    pager_init_frame(pager, copy_num, frame->page_num, VERSION_PENDING, VERSION_NONE);
+    copy->dirty         = frame->dirty;
+    frame->version_end  = VERSION_PENDING;
+    pager_chain_push(pager, copy_num);
+    lru_push_front(pager, copy_num);
+    pager_add_private_page(pager, frame->page_num);
+    stats_count(STAT_PAGE_COPIES, 1);
+    return copy_num;
+}
+
+/*
+*function to get the newest version of a page into the buffer pool, the writer's copy if it has one,
+*the writer of a non-exclusive statement gets a copy of its own to change
+*@param     pager      pointer to Pager, the caller holds the pager lock
+*@param     page_num   page number of the page to read
+*@returns frame of the version
+*/
+int32_t pager_fetch_newest(Pager* pager, uint32_t page_num){
+    while(true){
+        int32_t head = pager_lookup(pager, page_num);
+
+        //cache hit
+        if(head != -1 && pager->frames[head].version_end == VERSION_NONE){
+            if(pager_copying(pager) && pager->frames[head].version_begin != VERSION_PENDING){
+                int32_t copy_num = pager_copy_frame(pager, head);
+                if(copy_num == -1)
+                    continue;
+                return copy_num;
+            }
+            stats_count(STAT_PAGE_HITS, 1);
+            return head;
+        }
+
+        //cache miss, the newest version is in the log or the db file
+        uint64_t start      = stats_now();
+        uint64_t waits      = pager->frame_waits;
+        int32_t  frame_num  = pager_get_free_frame(pager);
+        //evicting for the frame may have made the committed version the newest again
+        head = pager_lookup(pager, page_num);
+        if(pager->frame_waits != waits || (head != -1 && pager->frames[head].version_end == VERSION_NONE)){
+            pager_free_frame(pager, frame_num);
+            continue;
+        }
+        stats_count(STAT_PAGE_MISSES, 1);
+
+        uint64_t    file_length = pager->file_length;
+        bool        spilled     = pager->wal != NULL && wal_spilled(pager->wal, page_num);
+        uint64_t    wal_offset  = pager->wal ? wal_lookup(pager->wal, page_num) : 0;
+        Frame*      frame       = &(pager->frames[frame_num]);
+        pager_read_image(pager, page_num, wal_offset, frame->data);
+        stats_time(STAT_LATENCY_PAGE_READ, start);
+
+        //read for the writer it is its copy right away, the committed version stays where it was read from
+        bool copy = spilled || pager_copying(pager);
+        pager_init_frame(pager, frame_num, page_num,
+                         copy ? VERSION_PENDING : (head != -1 ? pager->frames[head].version_end : 0), VERSION_NONE);
+        //a page from the log is newer than the one in the db file
+        frame->dirty = (wal_offset != 0);
+        pager_chain_push(pager, frame_num);
+        lru_push_front(pager, frame_num);
+        if(copy)
+            pager_add_private_page(pager, page_num);
+
+        if(page_num >= pager->num_pages)
+            pager->num_pages = page_num + 1;
+
+        //pages past the end of the file are new and must reach the file
+        if(wal_offset == 0 && (uint64_t)page_num * PAGE_SIZE >= file_length)
+            pager_mark_dirty(pager, page_num);
+        return frame_num;
+    }
+}
+
+/*
+*function to get the version of a page a snapshot sees into the buffer pool
+*@param     pager      pointer to Pager, the caller holds the pager lock
+*@param     page_num   page number of the page to read
+*@param     snapshot   commit number of the snapshot
+*@returns frame of the version
+*/
+int32_t pager_fetch_version(Pager* pager, uint32_t page_num, uint64_t snapshot){
+    while(true){
+        int32_t head = pager_lookup(pager, page_num);
+        for(int32_t frame_num = head; frame_num != -1; frame_num = pager->frames[frame_num].older){
+            Frame* frame = &(pager->frames[frame_num]);
+            if(frame->version_begin <= snapshot && snapshot < frame->version_end){
+                stats_count(STAT_PAGE_HITS, 1);
+                return frame_num;
+            }
+        }
+
+        //cache miss, an old version is in the version store, else the one wanted is the last commit's
+        uint64_t start      = stats_now();
+        uint64_t waits      = pager->frame_waits;
+        int32_t  frame_num  = pager_get_free_frame(pager);
+        if(pager->frame_waits != waits){
+            pager_free_frame(pager, frame_num);
+            continue;
+        }
+        stats_count(STAT_PAGE_MISSES, 1);
+        Frame* frame = &(pager->frames[frame_num]);
+
+        uint32_t stored = 0;
+        while(stored < pager->num_stored_versions &&
+              (pager->stored_versions[stored].page_num != page_num || snapshot < pager->stored_versions[stored].version_begin ||
+               snapshot >= pager->stored_versions[stored].version_end))
+            stored++;
+        if(stored < pager->num_stored_versions){
+            StoredVersion* version = &(pager->stored_versions[stored]);
+            if(pread(pager->versions_fd, frame->data, PAGE_SIZE, (off_t)version->slot * PAGE_SIZE) == -1){
+                printf("Error reading version store: %d\n", errno);
+                exit(EXIT_FAILURE);
+            }
+            stats_time(STAT_LATENCY_PAGE_READ, start);
+            //back in a frame it is an old version again, kept off the LRU list
+            pager_init_frame(pager, frame_num, page_num, version->version_begin, version->version_end);
+            pager_chain_append(pager, frame_num);
+            pager->old_versions[pager->num_old_versions++] = frame_num;
+            pager_drop_stored_version(pager, stored);
+            return frame_num;
+        }
+
+        uint64_t wal_offset = pager->wal ? wal_lookup_committed(pager->wal, page_num) : 0;
+        pager_read_image(pager, page_num, wal_offset, frame->data);
+        stats_time(STAT_LATENCY_PAGE_READ, start);
+
+        //it begins where the newest old version ends, the writer's copy stays in front
+        head = pager_lookup(pager, page_num);
+        pager_init_frame(pager, frame_num, page_num, pager_newest_version_end(pager, page_num),
+                         pager_has_private(pager, page_num) ? VERSION_PENDING : VERSION_NONE);
+        frame->dirty = (wal_offset != 0);
+        if(head != -1 && pager->frames[head].version_begin == VERSION_PENDING){
+            frame->older                = pager->frames[head].older;
+            pager->frames[head].older   = frame_num;
+        }
+        else
+            pager_chain_push(pager, frame_num);
+        lru_push_front(pager, frame_num);
+        return frame_num;
+    }
+}
+
+/*
+*function to get a page into the buffer pool, the caller holds the pager lock
+*a thread holding a snapshot gets the version of its snapshot, any other the newest
+*@param     pager      pointer to Pager, holding file hadles and the pages
+*@param     page_num   page number of the page to read
+*@returns frame of the version
+*/
+int32_t pager_fetch_frame(Pager* pager, uint32_t page_num){
+    int32_t frame_num = (snapshot_pager == pager) ? pager_fetch_version(pager, page_num, snapshot_commit_num)
+                                                  : pager_fetch_newest(pager, page_num);
+    //mark the frame as most recently used, old versions are not on the list
+    if(pager->lru_head != frame_num && !frame_is_old(&(pager->frames[frame_num]))){
+        lru_remove(pager, frame_num);
+        lru_push_front(pager, frame_num);
+    }
+    return frame_num;
+}
+
+/*
+*function to get a page into the buffer pool, the caller holds the pager lock
+*@param     pager      pointer to Pager, holding file hadles and the pages 
+*@param     page_num   page number of the page to read 
+*@returns a pointer to the page
+*/
+void* pager_fetch(Pager* pager, uint32_t page_num){
+
+    //mmap mode, the page is read straight from the mapping
+    if(pager->mode == PAGER_MMAP){
+        if((uint64_t)page_num * PAGE_SIZE >= pager->map_length)
+            pager_mmap_grow(pager, page_num);
+        if(page_num >= pager->num_pages)
+            pager->num_pages = page_num + 1;
+        return pager->map + (uint64_t)page_num * PAGE_SIZE;
+    }
+    return pager->frames[pager_fetch_frame(pager, page_num)].data;
+}
+
+/*
+*function to pin a page for the writer's statement, the caller holds the pager lock
+*@param     pager      pointer to Pager
+*@param     page_num   page number of the page to hold
+*/
+void pager_hold_page(Pager* pager, uint32_t page_num){
+    for(uint32_t i = 0; i < pager->num_held_pages; i++)
+        if(pager->held_pages[i] == page_num)
+            return;
+
+    if(pager->num_held_pages == pager->held_capacity){
+        pager->held_capacity    = pager->held_capacity ? pager->held_capacity * 2 : 32;
+        pager->held_pages       = (uint32_t*)realloc(pager->held_pages, pager->held_capacity * sizeof(uint32_t));
+    }
+    pager->held_pages[pager->num_held_pages++] = page_num;
+    pager->frames[pager_lookup(pager, page_num)].pin_count++;
+}
+
+/*
+*function to get a page
+*the returned pointer stays valid while the page is pinned, until the end of
+*the statement for the writer, or single threaded until PAGER_MIN_FRAMES - 1
+*other pages have been fetched
+*@param     pager      pointer to Pager, holding file hadles and the pages 
+*@param     page_num   page number of the page to read 
+*@returns a pointer to the page
+*/
+void* get_page(Pager* pager, uint32_t page_num){
+    pthread_mutex_lock(&(pager->lock));
+    void* page = pager_fetch(pager, page_num);
+    if(pager->holding && pager->mode == PAGER_BUFFERED && pthread_equal(pager->holder, pthread_self()))
+        pager_hold_page(pager, page_num);
+    pthread_mutex_unlock(&(pager->lock));
+    return page;
+}
+
+/*
+*function to start pinning every page the calling thread fetches,
+*so the writer's page pointers survive evictions done by readers
+*@param     pager      pointer to Pager
+*/
+void pager_hold_pages(Pager* pager){
+    pthread_mutex_lock(&(pager->lock));
+    pager->holding  = true;
+    pager->holder   = pthread_self();
+    pthread_mutex_unlock(&(pager->lock));
+}
+
+/*
+*function to unpin the pages held since pager_hold_pages
+*@param     pager      pointer to Pager
+*/
+void pager_release_pages(Pager* pager){
+    pthread_mutex_lock(&(pager->lock));
+    for(uint32_t i = 0; i < pager->num_held_pages; i++){
+        int32_t frame_num = pager_lookup(pager, pager->held_pages[i]);
+        //pages cut off the end of the file are dropped unpinned by pager_truncate
+        if(frame_num != -1 && pager->frames[frame_num].pin_count > 0)
+            pager->frames[frame_num].pin_count--;
+    }
+    pager->num_held_pages   = 0;
+    pager->holding          = false;
+    pthread_mutex_unlock(&(pager->lock));
+}
+
+/*
+*function to pin a page, a pinned page is never evicted, the writer gets its own copy of the page
+*and a reader the version of its snapshot, so neither waits for the other,
+*in mmap mode the table lock keeps readers and the writer apart
+*@param     pager      pointer to Pager
+*@param     page_num   page number of the page to pin
+*@returns a pointer to the page
+*/
+void* pager_pin(Pager* pager, uint32_t page_num){
+    //mapped pages are never evicted
+    if(pager->mode == PAGER_MMAP){
+        pthread_mutex_lock(&(pager->lock));
+        void* page = pager_fetch(pager, page_num);
+        pthread_mutex_unlock(&(pager->lock));
+        return page;
+    }
+
+    pthread_mutex_lock(&(pager->lock));
+    int32_t frame_num = pager_fetch_frame(pager, page_num);
+    if(num_thread_pins == PAGER_MAX_THREAD_PINS){
+        printf("Tried to pin more than %d pages at once.\n", PAGER_MAX_THREAD_PINS);
+        exit(EXIT_FAILURE);
+    }
+    pager->frames[frame_num].pin_count++;
+    ThreadPin pin                       = {pager, page_num, frame_num};
+    thread_pins[num_thread_pins++]      = pin;
+    pthread_mutex_unlock(&(pager->lock));
+    return pager->frames[frame_num].data;
+}
+
+/*
+*function to release a pin taken by pager_pin, the version pinned is let go even if a newer one was cached since
+*@param     pager      pointer to Pager
+*@param     page_num   page number of the page to unpin
+*/
+void pager_unpin(Pager* pager, uint32_t page_num){
+    if(pager->mode == PAGER_MMAP)
+        return;
+    uint32_t i = num_thread_pins;
+    while(i > 0 && (thread_pins[i - 1].pager != pager || thread_pins[i - 1].page_num != page_num))
+        i--;
+    if(i == 0){
+        printf("Tried to unpin page %d which is not pinned.\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+    int32_t frame_num   = thread_pins[i - 1].frame_num;
+    thread_pins[i - 1]  = thread_pins[--num_thread_pins];
+
+    pthread_mutex_lock(&(pager->lock));
+    Frame* frame = &(pager->frames[frame_num]);
+    frame->pin_count--;
+    //an old version read without a snapshot can go once it is let go
+    if(frame->pin_count == 0 && frame_is_old(frame))
+        pager_reclaim_versions(pager);
+    pthread_mutex_unlock(&(pager->lock));
+}
+
+/*
+*function to take a snapshot, until it ends the calling thread sees the pages as of the last commit
+*@param     pager       pointer to Pager
+*/
+void pager_snapshot_begin(Pager* pager){
+    if(pager->mode == PAGER_MMAP)
+        return;
+    pthread_mutex_lock(&(pager->lock));
+    if(pager->num_snapshots == pager->snapshots_capacity){
+        pager->snapshots_capacity   = pager->snapshots_capacity ? pager->snapshots_capacity * 2 : 16;
+        pager->snapshots            = (uint64_t*)realloc(pager->snapshots, pager->snapshots_capacity * sizeof(uint64_t));
+    }
+    pager->snapshots[pager->num_snapshots++]    = pager->commit_num;
+    snapshot_pager                              = pager;
+    snapshot_commit_num                         = pager->commit_num;
+    pthread_mutex_unlock(&(pager->lock));
+}
+
+/*
+*function to end the snapshot of the calling thread, the old versions only it saw are freed
+*@param     pager       pointer to Pager
+*/
+void pager_snapshot_end(Pager* pager){
+    if(snapshot_pager != pager)
+        return;
+    pthread_mutex_lock(&(pager->lock));
+    for(uint32_t i = 0; i < pager->num_snapshots; i++){
+        if(pager->snapshots[i] == snapshot_commit_num){
+            pager->snapshots[i] = pager->snapshots[--pager->num_snapshots];
+            break;
+        }
+    }
+    snapshot_pager = NULL;
+    pager_reclaim_versions(pager);
+    pthread_cond_broadcast(&(pager->versions_released));
+    pthread_mutex_unlock(&(pager->lock));
+}
+
+/*
+*function to keep the committed versions of the pages the writer copied for the snapshots that see them,
+*the ones not cached are read from the log or the db file while those still hold the last commit
+*@param     pager       pointer to Pager, the caller holds the pager lock once
+*@param     commit_num  number the commit will get
+*/
+void pager_keep_versions(Pager* pager, uint64_t commit_num){
+    bool restart = true;
+    while(restart){
+        restart = false;
+        for(uint32_t i = 0; i < pager->num_private_pages && !restart; i++){
+            uint32_t page_num = pager->private_pages[i];
+            if(!pager_has_private(pager, page_num))
+                continue;
+
+            int32_t head        = pager_lookup(pager, page_num);
+            int32_t committed   = head;
+            while(committed != -1 && pager->frames[committed].version_begin == VERSION_PENDING)
+                committed = pager->frames[committed].older;
+            if(committed != -1 && !frame_is_old(&(pager->frames[committed]))){
+                pager_retire_frame(pager, committed, commit_num);
+                continue;
+            }
+            //kept already, or nobody can see it
+            if(pager_newest_version_end(pager, page_num) == commit_num || pager->num_snapshots == 0)
+                continue;
+
+            uint64_t waits      = pager->frame_waits;
+            int32_t  frame_num  = pager_get_free_frame(pager);
+            //a snapshot may have been taken while waiting, look at all pages again
+            if(pager->frame_waits != waits){
+                pager_free_frame(pager, frame_num);
+                restart = true;
+                continue;
+            }
+            uint64_t wal_offset = pager->wal ? wal_lookup_committed(pager->wal, page_num) : 0;
+            pager_read_image(pager, page_num, wal_offset, pager->frames[frame_num].data);
+            head = pager_lookup(pager, page_num);
+            pager_init_frame(pager, frame_num, page_num, pager_newest_version_end(pager, page_num), commit_num);
+            if(head != -1 && pager->frames[head].version_begin == VERSION_PENDING){
+                pager->frames[frame_num].older  = pager->frames[head].older;
+                pager->frames[head].older       = frame_num;
+            }
+            else
+                pager_chain_push(pager, frame_num);
+            pager->old_versions[pager->num_old_versions++] = frame_num;
+        }
+    }
+}
+
+/*
+*function to publish the writer's copies as the versions of a new commit, snapshots taken from now on see them
+*@param     pager       pointer to Pager, the caller holds the pager lock
+*@param     commit_num  number of the commit
+*/
+void pager_publish_versions(Pager* pager, uint64_t commit_num){
+    for(uint32_t i = 0; i < pager->num_private_pages; i++){
+        for(int32_t frame_num = pager_lookup(pager, pager->private_pages[i]); frame_num != -1;
+            frame_num = pager->frames[frame_num].older){
+            Frame* frame = &(pager->frames[frame_num]);
+            if(frame->version_begin == VERSION_PENDING)
+                frame->version_begin = commit_num;
+            else if(frame->version_end == VERSION_PENDING)
+                pager_retire_frame(pager, frame_num, commit_num);
+        }
+    }
+    pager->num_private_pages    = 0;
+    pager->committed_num_pages  = pager->num_pages;
+    pager->commit_num           = commit_num;
+    pager_reclaim_versions(pager);
+    //readers waiting for a frame can take the copies now
+    pthread_cond_broadcast(&(pager->versions_released));
+}
+
+/*
+*function to check if the calling thread has a transaction open
+*@param     table       pointer to the table
+*@returns true between the thread's begin and commit
+*/
+bool table_in_transaction(Table* table){
+    return transaction_table == table;
+}
+
+/*
+*function to let the calling thread in as a reader, it sees the table as of the last commit until table_read_end
+*while the writer goes on with its own copies of the pages, in a transaction it sees its own changes
+*@param     table       pointer to the table
+*/
+void table_read_begin(Table* table){
+    pthread_rwlock_rdlock(&(table->lock));
+    if(!table_in_transaction(table))
+        pager_snapshot_begin(table->pager);
+}
+
+/*
+*function to let a reader out, the page versions only its snapshot saw are freed
+*@param     table       pointer to the table
+*/
+void table_read_end(Table* table){
+    pager_snapshot_end(table->pager);
+    pthread_rwlock_unlock(&(table->lock));
+}
+
+/*
+*function to commit the pages modified since the last commit, the writer's copies become the
+*versions new snapshots see, with a log their images are appended to it and the log synced
+*@param     pager      pointer to Pager
+*/
+void pager_commit(Pager* pager){
+    Wal* wal = pager->wal;
+    if(pager->mode == PAGER_MMAP)
+        return;
+
+    uint64_t start      = stats_now();
+    uint64_t commit_end = 0;
+    pthread_mutex_lock(&(pager->lock));
+    uint64_t commit_num = pager->commit_num + 1;
+    //the only step that may wait for a frame, the rest of the commit is seen at once
+    pager_keep_versions(pager, commit_num);
+
+    if(wal != NULL){
+        //the last frame carries the commit mark, so hold each page back by one
+        int32_t last = -1;
+        for(uint32_t i = 0; i < pager->num_unlogged_pages; i++){
+            int32_t frame_num = pager_lookup(pager, pager->unlogged_pages[i]);
+            if(frame_num == -1 || pager->frames[frame_num].logged)
+                continue;
+            if(last != -1)
+                wal_append(wal, pager->frames[last].page_num, pager->frames[last].data, 0);
+            pager->frames[frame_num].logged = true;
+            last = frame_num;
+        }
+
+        if(last != -1){
+            wal_append(wal, pager->frames[last].page_num, pager->frames[last].data, pager->num_pages);
+            commit_end = wal->length;
+        }
+        else if(pager->txn_frames > 0){
+            //all changes were spilled to the log already, commit with the newest header page
+            int32_t header = pager_lookup(pager, DB_HEADER_PAGE_NUM);
+            if(header != -1 && pager->frames[header].version_end == VERSION_NONE)
+                wal_append(wal, DB_HEADER_PAGE_NUM, pager->frames[header].data, pager->num_pages);
+            else{
+                ArenaMark   mark    = arena_mark(&statement_arena);
+                void*       image   = arena_alloc(&statement_arena, PAGE_SIZE);
+                pager_read_image(pager, DB_HEADER_PAGE_NUM, wal_lookup(wal, DB_HEADER_PAGE_NUM), image);
+                wal_append(wal, DB_HEADER_PAGE_NUM, image, pager->num_pages);
+                arena_release(&statement_arena, mark);
+            }
+            commit_end = wal->length;
+        }
+        pager->num_unlogged_pages   = 0;
+        pager->txn_frames           = 0;
+    }
+    pager_publish_versions(pager, commit_num);
+    //readers keep using the buffer pool while the log is synced
+    pthread_mutex_unlock(&(pager->lock));
+    if(commit_end == 0)
+        return;
+
+    wal_sync_to(wal, commit_end);
+    stats_time(STAT_LATENCY_COMMIT, start);
+
+    //with a background writer the commits only step in when it falls behind
+    if(wal->num_frames >= WAL_AUTOCHECKPOINT * (pager->background_checkpoints ? WAL_CHECKPOINT_BACKLOG : 1))
+        pager_checkpoint(pager);
+}
+
+/*
+*function to put the committed version of a page back in the db file, without a log an evicted copy
+*of the writer was written in place and the committed version kept for snapshots until the commit
+*@param     pager       pointer to Pager, the caller holds the pager lock
+*@param     page_num    page number of the copy
+*/
+void pager_restore_page(Pager* pager, uint32_t page_num){
+    uint64_t next = pager->commit_num + 1;
+    for(int32_t frame_num = pager_lookup(pager, page_num); frame_num != -1; frame_num = pager->frames[frame_num].older){
+        Frame* frame = &(pager->frames[frame_num]);
+        if(frame->version_end != next)
+            continue;
+        for(uint32_t i = 0; i < pager->num_old_versions; i++)
+            if(pager->old_versions[i] == frame_num)
+                pager->old_versions[i] = pager->old_versions[--pager->num_old_versions];
+        //the newest version again, written back like any dirty page
+        frame->version_end  = VERSION_NONE;
+        frame->dirty        = true;
+        lru_push_front(pager, frame_num);
+        return;
+    }
+    for(uint32_t i = 0; i < pager->num_stored_versions; i++){
+        StoredVersion* version = &(pager->stored_versions[i]);
+        if(version->page_num != page_num || version->version_end != next)
+            continue;
+        ArenaMark   mark    = arena_mark(&statement_arena);
+        void*       image   = arena_alloc(&statement_arena, PAGE_SIZE);
+        if(pread(pager->versions_fd, image, PAGE_SIZE, (off_t)version->slot * PAGE_SIZE) == -1 ||
+           pwrite(pager->file_descriptor, image, PAGE_SIZE, (off_t)page_num * PAGE_SIZE) == -1){
+            printf("Error restoring page %d: %d\n", page_num, errno);
+            exit(EXIT_FAILURE);
+        }
+        arena_release(&statement_arena, mark);
+        pager_drop_stored_version(pager, i);
+        return;
+    }
+}
+
+/*
+*function to roll back the pages modified since the last commit, the writer's copies are dropped
+*and the committed versions are the newest again, pages added at the end of the file are given up,
+*mapped pages are changed in place and stay as they are
+*@param     pager      pointer to Pager
+*/
+void pager_rollback(Pager* pager){
+    if(pager->mode == PAGER_MMAP)
+        return;
+
+    pthread_mutex_lock(&(pager->lock));
+    uint64_t next = pager->commit_num + 1;
+    for(uint32_t i = 0; i < pager->num_private_pages; i++){
+        uint32_t page_num   = pager->private_pages[i];
+        //the db file holds the copy once a committed version was kept for it, the cached versions newer than that go too
+        bool     written    = pager->wal == NULL && pager_newest_version_end(pager, page_num) == next;
+        int32_t  frame_num  = pager_lookup(pager, page_num);
+        while(frame_num != -1){
+            Frame*  frame   = &(pager->frames[frame_num]);
+            int32_t older   = frame->older;
+            if(frame->version_begin == VERSION_PENDING || (written && !frame_is_old(frame))){
+                pager_chain_unlink(pager, frame_num);
+                lru_remove(pager, frame_num);
+                frame->dirty = false;
+                pager_free_frame(pager, frame_num);
+            }
+            else if(frame->version_end == VERSION_PENDING)
+                frame->version_end = VERSION_NONE;
+            frame_num = older;
+        }
+        if(written)
+            pager_restore_page(pager, page_num);
+    }
+    pager->num_private_pages    = 0;
+    pager->num_unlogged_pages   = 0;
+    pager->txn_frames           = 0;
+    if(pager->wal != NULL)
+        wal_rollback(pager->wal);
+
+    for(uint32_t page_num = pager->committed_num_pages; page_num < pager->num_pages; page_num++)
+        pager_drop_page(pager, page_num);
+    pager->num_pages = pager->committed_num_pages;
+    pager_truncate_file(pager);
+
+    pager_reclaim_versions(pager);
+    pthread_cond_broadcast(&(pager->versions_released));
+    pthread_mutex_unlock(&(pager->lock));
+}
+
+/*
+*function to compare two page numbers or row ids for qsort
+*/
+int compare_page_nums(const void* a, const void* b){
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+*function to ask the kernel to start reading pages a scan is about to visit, it does not wait for them
+*pages in the buffer pool or in the log are skipped, neighbouring pages are advised as one range
+*@param     pager       pointer to Pager
+*@param     page_nums   pages to read ahead, sorted in place
+*@param     count       number of pages
+*/
+void pager_read_ahead(Pager* pager, uint32_t* page_nums, uint32_t count){
+    qsort(page_nums, count, sizeof(uint32_t), compare_page_nums);
+
+    uint32_t num_needed = 0;
+    pthread_mutex_lock(&(pager->lock));
+    for(uint32_t i = 0; i < count; i++){
+        uint32_t page_num = page_nums[i];
+        if(pager->mode == PAGER_MMAP){
+            if((uint64_t)page_num * PAGE_SIZE < pager->map_length)
+                page_nums[num_needed++] = page_num;
+            continue;
+        }
+        if((uint64_t)page_num * PAGE_SIZE >= pager->file_length || pager_lookup(pager, page_num) != -1 ||
+           (pager->wal != NULL && wal_lookup(pager->wal, page_num) != 0))
+            continue;
+        page_nums[num_needed++] = page_num;
+    }
+    pthread_mutex_unlock(&(pager->lock));
+
+    for(uint32_t i = 0; i < num_needed;){
+        uint32_t first = i++;
+        while(i < num_needed && page_nums[i] == page_nums[i - 1] + 1)
+            i++;
+        uint64_t offset = (uint64_t)page_nums[first] * PAGE_SIZE;
+        uint64_t length = (uint64_t)(i - first) * PAGE_SIZE;
+        //only a hint, a failure costs nothing but the read-ahead
+        if(pager->mode == PAGER_MMAP)
+            madvise(pager->map + offset, length, MADV_WILLNEED);
+        else
+            posix_fadvise(pager->file_descriptor, offset, length, POSIX_FADV_WILLNEED);
+    }
+}
+
+/*
+*function to unpin the leaf a cursor holds, the cursor itself belongs to the caller
+*@param     cursor      pointer to the cursor to be closed
+*/
+void cursor_close(Cursor* cursor){
+    pager_unpin(cursor->table->pager, cursor->page_num);
+}
+
+/*
+*function to add the change in rows of a write to the counts of the writer's path from the root down,
+*the nodes are pinned again one at a time by page number, the writer gets its own copies of them
+*@param     cursor      pointer to the writer's cursor
+*@param     levels      number of levels to change, from the root
+*@param     delta       rows added, -1 for a delete
+*/
+void cursor_path_add_to_counts(Cursor* cursor, uint32_t levels, int32_t delta){
+    Pager* pager = cursor->table->pager;
+    for(uint32_t level = 0; level < levels; level++){
+        void* node = pager_pin(pager, cursor->path[level]);
+        *internal_node_count(node, cursor->path_index[level]) += delta;
+        pager_mark_dirty(pager, cursor->path[level]);
+        pager_unpin(pager, cursor->path[level]);
+    }
+}
+
+/*
+*function to close the writer's cursor and add the change in rows of its write to the counts of its path
+*@param     cursor      pointer to the writer's cursor
+*@param     levels      depth of the highest node the write changed, the counts of the levels above it are changed
+*@param     delta       rows added, -1 for a delete
+*/
+void cursor_close_counted(Cursor* cursor, uint32_t levels, int32_t delta){
+    cursor_close(cursor);
+    cursor_path_add_to_counts(cursor, levels, delta);
+}
+
+/*
+*function to print the correct indentations
+*/
+void indent(uint32_t level){
+    for(uint32_t i = 0 ; i < level; i++)
+        printf("  ");
+}
+
+/*
+*function to recursively print a node and its childrens
+*@param pager
+*@param page_num
+*@param indentation_level
+*/
+void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level){
+    void* node = get_page(pager, page_num);
+    uint32_t num_keys, child;
+
+    switch(get_node_type(node)){
+        case NODE_LEAF:
+            num_keys = *(leaf_node_num_cells(node));
+            indent(indentation_level);
+            printf("- leaf %d\n", num_keys);
+            for(uint32_t i = 0; i < num_keys; i++){
+                indent(indentation_level+1);
+                printf("- %d\n", *leaf_node_key(node, i));
+            }
+            break;
+        case NODE_INTERNAL:
+            num_keys = *(internal_node_num_keys(node));
+            indent(indentation_level);
+            printf("- internal %d\n", num_keys);
+            for(uint32_t i = 0; i < num_keys; i++){
+                child = *internal_node_child(node, i);
+                print_tree(pager, child, indentation_level+1);
+                indent(indentation_level+1);
+                printf("- key %d\n", *internal_node_key(node, i));
+            }
+            child = *(internal_node_right_child(node));
+            print_tree(pager, child, indentation_level+1);
+            break;
+    }
+}
+
+/*
+*function to add a subtree to the shape of the tree, the nodes are read at the snapshot
+*of .stats like a reader reads them, so the writer can go on around the walk
+*@param     pager       pointer to Pager
+*@param     page_num    page number of the root of the subtree
+*@param     level       level of the node, 1 for the root
+*@param     stats       pointer to the shape to add to
+*/
+void tree_stats_walk(Pager* pager, uint32_t page_num, uint32_t level, TreeStats* stats){
+    void* node = pager_pin(pager, page_num);
+    if(level > stats->height)
+        stats->height = level;
+
+    if(get_node_type(node) == NODE_LEAF){
+        stats->leaf_nodes++;
+        stats->rows             += *leaf_node_num_cells(node);
+        stats->leaf_bytes_used  += leaf_node_used_space(node);
+    }
+    else{
+        stats->internal_nodes++;
+        uint32_t num_keys = *internal_node_num_keys(node);
+        for(uint32_t i = 0; i <= num_keys; i++)
+            tree_stats_walk(pager, *internal_node_child(node, i), level + 1, stats);
+    }
+    pager_unpin(pager, page_num);
+}
+
+/*
+*function to find the shape of the table's tree for .stats
+*@param     table       pointer to the table
+*@param     stats       pointer to the shape to fill
+*/
+void table_tree_stats(Table* table, TreeStats* stats){
+    memset(stats, 0, sizeof(TreeStats));
+    table_read_begin(table);
+    stats->num_pages    = table->pager->num_pages;
+    stats->free_pages   = *db_header_freelist_count(pager_pin(table->pager, 0));
+    pager_unpin(table->pager, 0);
+    tree_stats_walk(table->pager, table->root_page_num, 1, stats);
+    table_read_end(table);
+}
+
+/*
+*function to get the size of a row once serialized
+*@param     source          pointer to the row
+*@returns size of the row payload in bytes
+*/
+uint32_t row_payload_size(Row* source){
+    return ROW_STRINGS_OFFSET + strlen(source->username) + strlen(source->email);
+}
+
+/*
+*function for inserting a row
+*writes the lengths of the strings and their bytes, the id is the key of the cell
+*@param     source          source pointer of type Row
+*@param     destination     destination pointer to the payload of a cell, row_payload_size bytes
+*/
+void serialize_row(Row* source, void* destination){
+    uint8_t username_length = strlen(source->username);
+    uint8_t email_length    = strlen(source->email);
+    *((uint8_t*)destination + ROW_USERNAME_LENGTH_OFFSET)   = username_length;
+    *((uint8_t*)destination + ROW_EMAIL_LENGTH_OFFSET)      = email_length;
+    memcpy((uint8_t*)destination + ROW_STRINGS_OFFSET, source->username, username_length);
+    memcpy((uint8_t*)destination + ROW_STRINGS_OFFSET + username_length, source->email, email_length);
+}
+
+/*
+*function for read a row
+*read from a leaf cell and store it in a Row, the id is the key of the cell
+*@param     source          pointer to the payload of a leaf cell
+*@param     destination     destination pointer of type Row
+*/
+void deserialize_row(void* source, Row* destination){
+    uint8_t username_length = *((uint8_t*)source + ROW_USERNAME_LENGTH_OFFSET);
+    uint8_t email_length    = *((uint8_t*)source + ROW_EMAIL_LENGTH_OFFSET);
+    memcpy(destination->username, (uint8_t*)source + ROW_STRINGS_OFFSET, username_length);
+    destination->username[username_length] = '\0';
+    memcpy(destination->email, (uint8_t*)source + ROW_STRINGS_OFFSET + username_length, email_length);
+    destination->email[email_length] = '\0';
+}
+
+/*
+*function to get the value of the node pointed by the cursor
+*@param     cursor      pointer to the cursor
+*@returns a pointer to node value
+*/
+void* cursor_value(Cursor* cursor){
+    return leaf_node_value(cursor->node, cursor->cell_num);
+}
+
+/*
+*function to view a stored row in place, nothing is copied
+*@param     id          id of the row
+*@param     payload     the row as stored in its cell
+*@param     view        pointer to the view to fill
+*/
+void row_view_init(uint32_t id, const void* payload, RowView* view){
+    view->id                = id;
+    view->payload           = (const uint8_t*)payload;
+    view->username_length   = view->payload[ROW_USERNAME_LENGTH_OFFSET];
+    view->email_length      = view->payload[ROW_EMAIL_LENGTH_OFFSET];
+    view->username          = (const char*)view->payload + ROW_STRINGS_OFFSET;
+    view->email             = view->username + view->username_length;
+}
+
+/*
+*function to view the row at the cursor, valid until the cursor moves to another leaf or is closed
+*@param     cursor      pointer to the cursor, not at the end of the table
+*@param     view        pointer to the view to fill
+*/
+void cursor_row_view(Cursor* cursor, RowView* view){
+    row_view_init(*leaf_node_key(cursor->node, cursor->cell_num), leaf_node_value(cursor->node, cursor->cell_num), view);
+}
+
+/*
+*function to get the size of the stored row a view looks at
+*@param     view        pointer to the view
+*@returns the payload size in bytes
+*/
+uint32_t row_view_payload_size(RowView* view){
+    return ROW_STRINGS_OFFSET + view->username_length + view->email_length;
+}
+
+/*
+*function to get a text column of a view
+*@param     view        pointer to the view
+*@param     column      COLUMN_USERNAME or COLUMN_EMAIL
+*@param     length      set to the length of the value
+*@returns pointer to the value, not terminated
+*/
+const char* row_view_column(RowView* view, Column column, uint32_t* length){
+    *length = (column == COLUMN_USERNAME) ? view->username_length : view->email_length;
+    return (column == COLUMN_USERNAME) ? view->username : view->email;
+}
+
+/*
+*function to start reading ahead along the leaf chain, for a scan that will visit the leaves after the cursor
+*@param     cursor      pointer to a reader's cursor
+*@param     key_hi      highest key the scan wants, no leaf past the one holding it is read ahead
+*/
+void cursor_read_ahead_start(Cursor* cursor, uint32_t key_hi){
+    if(cursor->depth == 0)
+        return;
+    cursor->readahead_window    = PAGER_READAHEAD_MIN;
+    cursor->readahead_ahead     = 0;
+    cursor->readahead_key_hi    = key_hi;
+    memcpy(cursor->readahead_path, cursor->path, cursor->depth * sizeof(uint32_t));
+    memcpy(cursor->readahead_path_index, cursor->path_index, cursor->depth * sizeof(uint32_t));
+    cursor->readahead_path_index[cursor->depth - 1]++;
+}
+
+/*
+*function to move the read-ahead path to the next parent of leaves once all children of the current one are advised
+*@param     cursor      pointer to the cursor
+*@returns false if there is nothing more to read ahead, read-ahead is turned off then
+*/
+bool cursor_read_ahead_next_parent(Cursor* cursor){
+    Pager*      pager   = cursor->table->pager;
+    uint32_t    path[BTREE_MAX_DEPTH];
+    uint32_t    path_index[BTREE_MAX_DEPTH];
+    int32_t     level   = (int32_t)cursor->depth - 2;
+    uint32_t    child   = 0;
+    memcpy(path, cursor->readahead_path, cursor->depth * sizeof(uint32_t));
+    memcpy(path_index, cursor->readahead_path_index, cursor->depth * sizeof(uint32_t));
+
+    //lowest ancestor with a subtree to the right of the path, unless the scan ends in the one on the path
+    for(; level >= 0; level--){
+        void*       node        = pager_pin(pager, path[level]);
+        uint32_t    num_keys    = *internal_node_num_keys(node);
+        bool        has_next    = path_index[level] < num_keys;
+        bool        past_end    = has_next && *internal_node_key(node, path_index[level]) >= cursor->readahead_key_hi;
+        if(has_next && !past_end)
+            child = *internal_node_child(node, ++path_index[level]);
+        pager_unpin(pager, path[level]);
+        if(past_end)
+            level = -1;
+        if(has_next)
+            break;
+    }
+    if(level < 0){
+        cursor->readahead_window = 0;
+        return false;
+    }
+
+    //then the leftmost path down from it
+    for(uint32_t i = level + 1; i < cursor->depth; i++){
+        path[i]         = child;
+        path_index[i]   = 0;
+        if(i == cursor->depth - 1)
+            break;
+        void* node = pager_pin(pager, child);
+        child = *internal_node_child(node, 0);
+        pager_unpin(pager, path[i]);
+    }
+
+    memcpy(cursor->readahead_path, path, cursor->depth * sizeof(uint32_t));
+    memcpy(cursor->readahead_path_index, path_index, cursor->depth * sizeof(uint32_t));
+    return true;
+}
+
+/*
+*function to read ahead the leaves after the cursor's leaf, called each time a scan moves to the next leaf
+*the leaves are the children of the parents on the read-ahead path, a new batch is advised once half of the
+*leaves advised before were visited and the window doubles with each batch up to PAGER_READAHEAD_MAX
+*the tree may change under a scan, a stale path only costs useless hints
+*@param     cursor      pointer to the cursor
+*/
+void cursor_read_ahead(Cursor* cursor){
+    if(cursor->readahead_window == 0)
+        return;
+    if(cursor->readahead_ahead > 0)
+        cursor->readahead_ahead--;
+    if(cursor->readahead_ahead > cursor->readahead_window / 2)
+        return;
+
+    Pager*      pager   = cursor->table->pager;
+    uint32_t    level   = cursor->depth - 1;
+    uint32_t    wanted  = cursor->readahead_window - cursor->readahead_ahead;
+    uint32_t    count   = 0;
+    uint32_t    page_nums[PAGER_READAHEAD_MAX];
+    while(count < wanted && cursor->readahead_window != 0){
+        void*    parent     = pager_pin(pager, cursor->readahead_path[level]);
+        uint32_t num_keys   = *internal_node_num_keys(parent);
+        uint32_t child      = cursor->readahead_path_index[level];
+        for(; child <= num_keys && count < wanted; child++){
+            //the child before holds keys up to its separator, past the scan's end nothing more is needed
+            if(child > 0 && *internal_node_key(parent, child - 1) >= cursor->readahead_key_hi){
+                cursor->readahead_window = 0;
+                break;
+            }
+            page_nums[count++] = *internal_node_child(parent, child);
+        }
+        cursor->readahead_path_index[level] = child;
+        pager_unpin(pager, cursor->readahead_path[level]);
+
+        if(cursor->readahead_window != 0 && child > num_keys && !cursor_read_ahead_next_parent(cursor))
+            break;
+    }
+
+    cursor->readahead_ahead += count;
+    if(cursor->readahead_window != 0 && cursor->readahead_window < PAGER_READAHEAD_MAX)
+        cursor->readahead_window *= 2;
+    pager_read_ahead(pager, page_nums, count);
+}
+
+/*
+*function to advance the cursor to the next row
+*@param     cursor      pointer to the cursor to be advanced
+*/
+void advance_cursor(Cursor* cursor){
+    
+    void* node = cursor->node;
+    cursor->cell_num += 1;
+
+    if(cursor->cell_num >= *(leaf_node_num_cells(node))){
+        uint32_t next_page_num = *leaf_node_next_leaf(node);
+        if(next_page_num == 0)
+            cursor->end_of_table = true;
+        else{
+            //pin the next leaf before letting go of this one
+            void* next_node = pager_pin(cursor->table->pager, next_page_num);
+            pager_unpin(cursor->table->pager, cursor->page_num);
+            cursor->page_num = next_page_num;
+            cursor->node     = next_node;
+            cursor->cell_num = 0;
+            cursor_read_ahead(cursor);
+        }
+    }
+}
+
+/*
+*function to print data from a row
+*@param     row     pointer to row to be printed
+*/
+void print_row(RowView* row){
+    if(row == NULL)
+        printf("Error: Empty Row.\n");
+    else
+        printf("{ %u %.*s %.*s }\n", row->id, row->username_length, row->username, row->email_length, row->email);
+}
+
+/*
+*function to print a row found by a select, the default row callback
+*@param row         pointer to the row
+*@param context     unused
+*/
+void print_selected_row(RowView* row, void* context){
+    print_row(row);
+}
+
+/*
+*function to print a result of an aggregate, the default value callback
+*@param group       pointer to the group, NULL without group by
+*@param value       the result
+*@param context     unused
+*/
+void print_value(uint32_t* group, uint64_t value, void* context){
+    if(group == NULL)
+        printf("{ %llu }\n", (unsigned long long)value);
+    else
+        printf("{ %u %llu }\n", *group, (unsigned long long)value);
+}
+
+/*
+*function to allocate a page, takes one from the free list if there is one,
+*else the page after the end of the db file
+*the caller must initialize the page, a recycled page holds old contents
+*@param pager   pointer to pager
+*@returns next page number
+*/
+uint32_t get_unused_page_num(Pager* pager){
+    void*    header     = get_page(pager, DB_HEADER_PAGE_NUM);
+    uint32_t trunk_num  = *db_header_freelist_trunk(header);
+    if(trunk_num == 0)
+        return pager->num_pages;
+
+    pager_mark_dirty(pager, DB_HEADER_PAGE_NUM);
+    *db_header_freelist_count(header) -= 1;
+
+    //take the last entry of the first trunk, an empty trunk is handed out itself
+    void*    trunk      = get_page(pager, trunk_num);
+    uint32_t count      = *freelist_trunk_count(trunk);
+    if(count > 0){
+        *freelist_trunk_count(trunk) = count - 1;
+        pager_mark_dirty(pager, trunk_num);
+        return *freelist_trunk_entry(trunk, count - 1);
+    }
+
+    uint32_t next_trunk = *freelist_trunk_next(trunk);
+    header = get_page(pager, DB_HEADER_PAGE_NUM);
+    *db_header_freelist_trunk(header) = next_trunk;
+    return trunk_num;
+}
+
+/*
+*function to release a page that is no longer used, it is put on the free list
+*@param pager       pointer to pager
+*@param page_num    page number to release
+*/
+void free_page(Pager* pager, uint32_t page_num){
+    void*    header     = get_page(pager, DB_HEADER_PAGE_NUM);
+    uint32_t trunk_num  = *db_header_freelist_trunk(header);
+    *db_header_freelist_count(header) += 1;
+    pager_mark_dirty(pager, DB_HEADER_PAGE_NUM);
+
+    if(trunk_num != 0){
+        void*    trunk  = get_page(pager, trunk_num);
+        uint32_t count  = *freelist_trunk_count(trunk);
+        if(count < FREELIST_TRUNK_MAX_ENTRIES){
+            *freelist_trunk_entry(trunk, count) = page_num;
+            *freelist_trunk_count(trunk)        = count + 1;
+            pager_mark_dirty(pager, trunk_num);
+            return;
+        }
+    }
+
+    //no trunk or the first one is full, the released page becomes the new first trunk
+    void* trunk = get_page(pager, page_num);
+    *freelist_trunk_next(trunk)     = trunk_num;
+    *freelist_trunk_count(trunk)    = 0;
+    pager_mark_dirty(pager, page_num);
+
+    header = get_page(pager, DB_HEADER_PAGE_NUM);
+    *db_header_freelist_trunk(header) = page_num;
+}
+
+/*
+*function to shrink the db file by cutting off free pages at its end (incremental truncate)
+*the remaining free pages are listed again so the lowest ones are handed out first
+*@param pager       pointer to pager
+*@param max_pages   most pages to cut off in this call
+*@returns the number of pages cut off
+*/
+uint32_t pager_truncate(Pager* pager, uint32_t max_pages){
+    void*    header     = get_page(pager, DB_HEADER_PAGE_NUM);
+    uint32_t num_free   = *db_header_freelist_count(header);
+    uint32_t trunk_num  = *db_header_freelist_trunk(header);
+    if(num_free == 0 || max_pages == 0)
+        return 0;
+
+    //collect every free page, the trunks included
+    uint32_t* free_pages    = (uint32_t*)malloc(num_free * sizeof(uint32_t));
+    uint32_t  count         = 0;
+    while(trunk_num != 0 && count < num_free){
+        void* trunk = get_page(pager, trunk_num);
+        free_pages[count++] = trunk_num;
+        for(uint32_t i = 0; i < *freelist_trunk_count(trunk) && count < num_free; i++)
+            free_pages[count++] = *freelist_trunk_entry(trunk, i);
+        trunk_num = *freelist_trunk_next(trunk);
+    }
+    qsort(free_pages, count, sizeof(uint32_t), compare_page_nums);
+
+    //free pages that run up to the end of the file can go
+    uint32_t num_cut = 0;
+    while(num_cut < count && num_cut < max_pages &&
+          free_pages[count - 1 - num_cut] == pager->num_pages - 1 - num_cut)
+        num_cut++;
+
+    if(num_cut == 0){
+        free(free_pages);
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < num_cut; i++)
+        pager_drop_page(pager, pager->num_pages - 1 - i);
+    pager->num_pages -= num_cut;
+
+    //list the rest again from the highest page down, so allocation takes the lowest first
+    header = get_page(pager, DB_HEADER_PAGE_NUM);
+    *db_header_freelist_trunk(header) = 0;
+    *db_header_freelist_count(header) = 0;
+    pager_mark_dirty(pager, DB_HEADER_PAGE_NUM);
+    for(uint32_t i = count - num_cut; i > 0; i--)
+        free_page(pager, free_pages[i - 1]);
+
+    //without a log the file can be cut now, else at the next checkpoint
+    if(pager->wal == NULL)
+        pager_truncate_file(pager);
+
+    free(free_pages);
+    return num_cut;
+}
+
+/*
+*we have already allocated the rigth child, 
+*this function takes the rigth child as input 
+*and allocates a new page to store the left child
+*@param table                   pointer to table
+*@param right_child_page_num    right child page number
+*@param left_child_max_key      largest key left in the old root, becomes the separator
+*/
+void create_new_root(Table* table, uint32_t right_child_page_num, uint32_t left_child_max_key){
+    /*
+    *Splitting the root is handled by
+    *old root is copied to the new page, becomes the left child
+    *address of the rigth child is passed in 
+    *reinitialize the root page to contain the new root node
+    *new root node points to two children 
+    */
+   void* root                   = get_page(table->pager, table->root_page_num);
+   uint32_t left_child_page_num = get_unused_page_num(table->pager);
+   void* left_child             = get_page(table->pager, left_child_page_num); 
+
+    //copy old node as left child
+    memcpy(left_child, root, PAGE_SIZE);
+    set_node_root(left_child, false);
+
+    //root node is new internal node with one key and two children
+    initialize_internal_node(root);
+    set_node_root(root, true);
+    *(internal_node_num_keys(root))    = 1;
+    *(internal_node_child(root, 0))    = left_child_page_num;
+    *(internal_node_key(root, 0))      = left_child_max_key;
+    *(internal_node_right_child(root)) = right_child_page_num; 
+    *(internal_node_count(root, 0))    = node_row_count(left_child);
+    *(internal_node_count(root, 1))    = node_row_count(get_page(table->pager, right_child_page_num));
+
+    pager_mark_dirty(table->pager, table->root_page_num);
+    pager_mark_dirty(table->pager, left_child_page_num);
+}
+
+/*
+*function to add the new right half of a split node to its parent,
+*splitting the parents up the cursor's path as long as they are full,
+*the counts of the parents changed are taken from the split nodes
+*@param cursor          cursor holding the path from the root to the split node
+*@param level           depth of the split node, 0 for the root
+*@param new_page_num    page number of the new right node
+*@param separator_key   largest key left in the old (left) node
+*@returns depth of the highest parent changed, the counts above it do not have the change yet
+*/
+uint32_t internal_node_insert(Cursor* cursor, uint32_t level, uint32_t new_page_num, uint32_t separator_key){
+    Table* table = cursor->table;
+
+    while(level > 0){
+        uint32_t parent_page_num = cursor->path[level - 1];
+        uint32_t index           = cursor->path_index[level - 1];
+        void*    parent          = get_page(table->pager, parent_page_num);
+        uint32_t num_keys        = *internal_node_num_keys(parent);
+        pager_mark_dirty(table->pager, parent_page_num);
+
+        //room in the parent, old node keeps its child slot with the separator as key,
+        //the new node takes the next slot which keeps the old node's previous key
+        uint32_t old_page_num    = *internal_node_child(parent, index);
+        uint32_t old_count       = node_row_count(get_page(table->pager, old_page_num));
+        uint32_t new_count       = node_row_count(get_page(table->pager, new_page_num));
+        if(num_keys < INTERNAL_NODE_MAX_KEYS){
+            memmove(internal_node_count(parent, index + 1), internal_node_count(parent, index),
+                    (num_keys - index + 1) * INTERNAL_NODE_COUNT_SIZE);
+            if(index == num_keys)
+                *internal_node_right_child(parent) = new_page_num;
+            else{
+                memmove(internal_node_cell(parent, index + 1), internal_node_cell(parent, index),
+                        (num_keys - index) * INTERNAL_NODE_CHILD_SIZE);
+                memmove(internal_node_key(parent, index + 1), internal_node_key(parent, index),
+                        (num_keys - index) * INTERNAL_NODE_KEY_SIZE);
+                *internal_node_cell(parent, index + 1) = new_page_num;
+            }
+            *internal_node_cell(parent, index)      = old_page_num;
+            *internal_node_key(parent, index)       = separator_key;
+            *internal_node_count(parent, index)     = old_count;
+            *internal_node_count(parent, index + 1) = new_count;
+            *internal_node_num_keys(parent)         = num_keys + 1;
+            return level - 1;
+        }
+
+        //parent is full, lay out all keys, children and counts with the new one in place
+        uint32_t keys[INTERNAL_NODE_MAX_KEYS + 1];
+        uint32_t children[INTERNAL_NODE_MAX_KEYS + 2];
+        uint32_t counts[INTERNAL_NODE_MAX_KEYS + 2];
+        for(uint32_t i = 0; i < num_keys; i++){
+            keys[i]     = *internal_node_key(parent, i);
+            children[i] = *internal_node_cell(parent, i);
+        }
+        children[num_keys] = *internal_node_right_child(parent);
+        memcpy(counts, internal_node_count(parent, 0), (num_keys + 1) * sizeof(uint32_t));
+
+        memmove(keys + index + 1, keys + index, (num_keys - index) * sizeof(uint32_t));
+        memmove(children + index + 2, children + index + 1, (num_keys - index) * sizeof(uint32_t));
+        memmove(counts + index + 2, counts + index + 1, (num_keys - index) * sizeof(uint32_t));
+        keys[index]         = separator_key;
+        children[index + 1] = new_page_num;
+        counts[index]       = old_count;
+        counts[index + 1]   = new_count;
+
+        //left half stays in the parent, the middle key moves up, right half goes to a new node
+        stats_count(STAT_INTERNAL_SPLITS, 1);
+        uint32_t sibling_page_num = get_unused_page_num(table->pager);
+        void*    sibling          = get_page(table->pager, sibling_page_num);
+        initialize_internal_node(sibling);
+        pager_mark_dirty(table->pager, sibling_page_num);
+
+        for(uint32_t i = 0; i < INTERNAL_NODE_LEFT_SPLIT_COUNT; i++){
+            *internal_node_cell(parent, i)  = children[i];
+            *internal_node_key(parent, i)   = keys[i];
+        }
+        *internal_node_num_keys(parent)     = INTERNAL_NODE_LEFT_SPLIT_COUNT;
+        *internal_node_right_child(parent)  = children[INTERNAL_NODE_LEFT_SPLIT_COUNT];
+        memcpy(internal_node_count(parent, 0), counts, (INTERNAL_NODE_LEFT_SPLIT_COUNT + 1) * sizeof(uint32_t));
+
+        for(uint32_t i = 0; i < INTERNAL_NODE_RIGHT_SPLIT_COUNT; i++){
+            *internal_node_cell(sibling, i) = children[INTERNAL_NODE_LEFT_SPLIT_COUNT + 1 + i];
+            *internal_node_key(sibling, i)  = keys[INTERNAL_NODE_LEFT_SPLIT_COUNT + 1 + i];
+        }
+        *internal_node_num_keys(sibling)    = INTERNAL_NODE_RIGHT_SPLIT_COUNT;
+        *internal_node_right_child(sibling) = children[INTERNAL_NODE_MAX_KEYS + 1];
+        memcpy(internal_node_count(sibling, 0), counts + INTERNAL_NODE_LEFT_SPLIT_COUNT + 1,
+               (INTERNAL_NODE_RIGHT_SPLIT_COUNT + 1) * sizeof(uint32_t));
+
+        new_page_num    = sibling_page_num;
+        separator_key   = keys[INTERNAL_NODE_LEFT_SPLIT_COUNT];
+        level--;
+    }
+
+    create_new_root(table, new_page_num, separator_key);
+    return 0;
+}
+
+/*
+*Create a new node and move half of the cells over,
+*Insert the new value to one of the two nodes,
+*update parent or create a new parent
+*@param cursor      cursor pointing to the position where the new node to be inserted
+*@param key         key of the new node to be inserted
+*@param value       pointert to the value to be inserted
+*@returns depth of the highest parent changed, the counts above it do not have the new row yet
+*/
+uint32_t leaf_node_split_and_insert(Cursor* cursor, uint32_t key, Row* value){
+
+    stats_count(STAT_LEAF_SPLITS, 1);
+    void* old_node          = get_page(cursor->table->pager, cursor->page_num);
+    uint32_t new_page_num   = get_unused_page_num(cursor->table->pager);
+    void* new_node          = get_page(cursor->table->pager, new_page_num);
+    initialize_leaf_node(new_node);
+
+    //the old leafs sibling becomes the new leaf 
+    //and the new leaf's sibling becomes whatever used to be the old leaf's sibling
+    *leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
+    *leaf_node_next_leaf(old_node) = new_page_num;
+
+    //the cells are rebuilt from a copy of the old node, the new row is placed at the cursor
+    char     copy[PAGE_SIZE];
+    uint32_t num_cells      = *leaf_node_num_cells(old_node);
+    uint32_t payload_size   = row_payload_size(value);
+    uint32_t total          = leaf_node_used_space(old_node) + leaf_node_cell_size(payload_size) + LEAF_NODE_CELL_OVERHEAD;
+    memcpy(copy, old_node, PAGE_SIZE);
+    *leaf_node_num_cells(old_node)      = 0;
+    *leaf_node_content_start(old_node)  = PAGE_SIZE;
+    *leaf_node_fragmented(old_node)     = 0;
+
+    /*
+    *All exisiting keys + new key should be 
+    *divided evenly by size between old (left) and the new(right) nodes,
+    *each node keeps at least one cell.
+    */
+    void* destination_node = old_node;
+    for(uint32_t i = 0; i <= num_cells; i++){
+        if(i == num_cells || (i > 0 && leaf_node_used_space(old_node) >= total / 2))
+            destination_node = new_node;
+
+        if(i == cursor->cell_num){
+            uint32_t index = *leaf_node_num_cells(destination_node);
+            leaf_node_insert_cell(destination_node, index, key, payload_size);
+            serialize_row(value, leaf_node_value(destination_node, index));
+        }
+        else
+            leaf_node_append_cell(destination_node, copy, i < cursor->cell_num ? i : i - 1);
+    }
+    pager_mark_dirty(cursor->table->pager, cursor->page_num);
+    pager_mark_dirty(cursor->table->pager, new_page_num);
+
+    //update the parent node, if the parent was a root node, create a new root node
+    uint32_t left_max_key = *leaf_node_key(old_node, *leaf_node_num_cells(old_node) - 1);
+    return internal_node_insert(cursor, cursor->depth, new_page_num, left_max_key);
+}
+
+/*
+*insert a row based on the key
+*@param cursor  pointer the the cursor
+*@param key     key to be inserted
+*@param value   value of type Row to be inserted
+*@returns depth of the highest node changed, the counts above it do not have the new row yet
+*/
+uint32_t leaf_node_insert(Cursor* cursor, uint32_t key, Row* value){
+    void* node = get_page(cursor->table->pager, cursor->page_num);
+    uint32_t payload_size = row_payload_size(value);
+
+    //check if the node has room for the cell and its slot
+    if(!leaf_node_fits(node, payload_size))
+        return leaf_node_split_and_insert(cursor, key, value);
+
+    //later slots shift right, the cell goes in the free space
+    leaf_node_insert_cell(node, cursor->cell_num, key, payload_size);
+    serialize_row(value, leaf_node_value(node, cursor->cell_num));
+    pager_mark_dirty(cursor->table->pager, cursor->page_num);
+    return cursor->depth;
+}
+
+/*
+*function to find the position of the key or the position of the key to be moved or the one past the last key
+*@param table       pointer to the table
+*@param page_num    page number of the page to search, pinned by the caller
+*@param key         key to be find
+*@param cursor      pointer to the cursor to set
+*/
+void leaf_node_find(Table* table, uint32_t page_num, uint32_t key, Cursor* cursor){
+    
+    TRACE("in leaf node find\n");
+    void* node          = get_page(table->pager, page_num);
+    uint32_t num_cells  = *(leaf_node_num_cells(node));
+
+    cursor->table       = table;
+    cursor->page_num    = page_num;
+    cursor->node        = node;
+    cursor->end_of_table = false;
+    cursor->depth       = 0;
+    cursor->readahead_window = 0;
+
+    //first key not smaller than the one searched
+    cursor->cell_num    = key_lower_bound(leaf_node_key(node, 0), num_cells, key);
+}
+/*
+*function to search the internal nodes and find a position for insertion,
+*walks down to the leaf recording the path taken in the cursor by page number,
+*each child is pinned before its parent is unpinned and only the leaf stays pinned
+*@param table       pointer to table
+*@param page_num    page number of the page to search, pinned by the caller
+*@param key         key to search
+*@param cursor      pointer to the cursor to set
+*/
+void internal_node_find(Table* table, uint32_t page_num, uint32_t key, Cursor* cursor){
+    TRACE("in internal node find\n");
+    uint32_t path[BTREE_MAX_DEPTH];
+    uint32_t path_index[BTREE_MAX_DEPTH];
+    uint32_t depth  = 0;
+    void*    node   = get_page(table->pager, page_num);
+
+    //node can have either leaves or more internal nodes as children
+    while(get_node_type(node) == NODE_INTERNAL){
+        if(depth == BTREE_MAX_DEPTH){
+            printf("Tree is deeper than %d levels.\n", BTREE_MAX_DEPTH);
+            exit(EXIT_FAILURE);
+        }
+        uint32_t child_index = internal_node_find_child(node, key);
+        path[depth]         = page_num;
+        path_index[depth]   = child_index;
+        depth++;
+
+        uint32_t child_page_num = *internal_node_child(node, child_index);
+        node = pager_pin(table->pager, child_page_num);
+        pager_unpin(table->pager, page_num);
+        page_num = child_page_num;
+    }
+
+    leaf_node_find(table, page_num, key, cursor);
+    cursor->depth   = depth;
+    memcpy(cursor->path, path, depth * sizeof(uint32_t));
+    memcpy(cursor->path_index, path_index, depth * sizeof(uint32_t));
+}
+/*
+*function to find the position to insert a node
+*@param table   pointer to the table
+*@key   key     key to be inserted
+*@param cursor  pointer to the cursor to set, usually on the caller's stack, closed with cursor_close
+*sets the cursor to the position of the key passed, if key not present to the position where it should be inserted.
+*/
+void table_find(Table* table, uint32_t key, Cursor* cursor){
+    uint32_t root_page_num = table->root_page_num;
+    void* root_node = pager_pin(table->pager, root_page_num);
+    TRACE("get page in table find\n");
+    if(get_node_type(root_node) == NODE_LEAF)
+        leaf_node_find(table, root_page_num, key, cursor);
+    else
+        internal_node_find(table, root_page_num, key, cursor);
+    stats_count(STAT_DESCENTS, 1);
+    stats_count(STAT_DESCENT_LEVELS, cursor->depth + 1);
+}
+
+/*
+*function to get a cursor at the first row with an id not below a key
+*@param     table      pointer to the Table
+*@param     key        smallest id wanted
+*@param     cursor     pointer to the Cursor to set, at the end of the table if every id is smaller
+*/
+void table_seek(Table* table, uint32_t key, Cursor* cursor){
+    table_find(table, key, cursor);
+    uint32_t num_cells = *leaf_node_num_cells(cursor->node);
+
+    //key is past the last cell of this leaf, the next row is at the start of the next leaf
+    if(num_cells == 0)
+        cursor->end_of_table = true;
+    else if(cursor->cell_num >= num_cells){
+        cursor->cell_num = num_cells - 1;
+        advance_cursor(cursor);
+    }
+}
+
+/*
+*function to count the rows with an id below a key, from the counts of the children left of the path to it
+*@param     table      pointer to the Table
+*@param     key        the key
+*@returns number of rows with a smaller id
+*/
+uint32_t table_rank(Table* table, uint32_t key){
+    Pager*      pager       = table->pager;
+    uint32_t    page_num    = table->root_page_num;
+    void*       node        = pager_pin(pager, page_num);
+    uint32_t    rank        = 0;
+
+    while(get_node_type(node) == NODE_INTERNAL){
+        uint32_t child_index = internal_node_find_child(node, key);
+        for(uint32_t i = 0; i < child_index; i++)
+            rank += *internal_node_count(node, i);
+        uint32_t child_page_num = *internal_node_child(node, child_index);
+        node = pager_pin(pager, child_page_num);
+        pager_unpin(pager, page_num);
+        page_num = child_page_num;
+    }
+    rank += key_lower_bound(leaf_node_key(node, 0), *leaf_node_num_cells(node), key);
+    pager_unpin(pager, page_num);
+    return rank;
+}
+
+/*
+*function to count the rows in a range of ids without visiting the leaves between its ends
+*@param     table      pointer to the Table
+*@param     key_lo     smallest id counted
+*@param     key_hi     largest id counted
+*@returns number of rows in the range
+*/
+uint32_t table_count_range(Table* table, uint32_t key_lo, uint32_t key_hi){
+    uint32_t below_hi;
+    if(key_lo > key_hi)
+        return 0;
+    uint32_t below_lo = table_rank(table, key_lo);
+    if(key_hi == UINT32_MAX){
+        below_hi = node_row_count(pager_pin(table->pager, table->root_page_num));
+        pager_unpin(table->pager, table->root_page_num);
+    }
+    else
+        below_hi = table_rank(table, key_hi + 1);
+    //the two walks can see a writer's change in between
+    return (below_hi > below_lo) ? below_hi - below_lo : 0;
+}
+
+/*
+*function to get a cursor at the row a number of rows into the table, walking down by the counts of the children
+*@param     table      pointer to the Table
+*@param     position   rows before the one wanted
+*@param     cursor     pointer to the Cursor to set, at the end of the table if it has fewer rows
+*/
+void table_find_position(Table* table, uint32_t position, Cursor* cursor){
+    uint32_t path[BTREE_MAX_DEPTH];
+    uint32_t path_index[BTREE_MAX_DEPTH];
+    uint32_t depth      = 0;
+    uint32_t page_num   = table->root_page_num;
+    void*    node       = pager_pin(table->pager, page_num);
+
+    while(get_node_type(node) == NODE_INTERNAL){
+        if(depth == BTREE_MAX_DEPTH){
+            printf("Tree is deeper than %d levels.\n", BTREE_MAX_DEPTH);
+            exit(EXIT_FAILURE);
+        }
+        //the child holding the position, the right child takes whatever is past the others
+        uint32_t num_keys       = *internal_node_num_keys(node);
+        uint32_t child_index    = 0;
+        while(child_index < num_keys && position >= *internal_node_count(node, child_index))
+            position -= *internal_node_count(node, child_index++);
+        path[depth]         = page_num;
+        path_index[depth]   = child_index;
+        depth++;
+
+        uint32_t child_page_num = *internal_node_child(node, child_index);
+        node = pager_pin(table->pager, child_page_num);
+        pager_unpin(table->pager, page_num);
+        page_num = child_page_num;
+    }
+
+    leaf_node_find(table, page_num, 0, cursor);
+    uint32_t num_cells  = *leaf_node_num_cells(node);
+    cursor->depth       = depth;
+    memcpy(cursor->path, path, depth * sizeof(uint32_t));
+    memcpy(cursor->path_index, path_index, depth * sizeof(uint32_t));
+    if(num_cells == 0)
+        cursor->end_of_table = true;
+    else if(position >= num_cells){
+        cursor->cell_num = num_cells - 1;
+        advance_cursor(cursor);
+    }
+    else
+        cursor->cell_num = position;
+}
+
+/*
+*function to get the cursor at the start of the table
+*@param     table      pointer to the Table
+*@param     cursor     pointer to the Cursor to set
+*/
+void table_start(Table* table, Cursor* cursor){
+    table_seek(table, 0, cursor);
+}
+
+/*
+*function to get the id of the row the cursor points to
+*@param     cursor      pointer to the cursor
+*@returns the id
+*/
+uint32_t cursor_key(Cursor* cursor){
+    return *leaf_node_key(cursor->node, cursor->cell_num);
+}
+
+/*
+*function to get the value of a text column of a row
+*@param     row         pointer to the row
+*@param     column      COLUMN_USERNAME or COLUMN_EMAIL
+*@returns the value
+*/
+const char* row_column_value(Row* row, Column column){
+    return (column == COLUMN_USERNAME) ? row->username : row->email;
+}
+
+/*
+*function to check if a row has the value a select matches
+*@param     statement   pointer to a select on a text column
+*@param     row         pointer to the row
+*@returns true if the row is selected
+*/
+bool row_matches(Statement* statement, RowView* row){
+    uint32_t    length;
+    const char* value           = row_view_column(row, statement->match_column, &length);
+    uint32_t    match_length    = strlen(statement->match);
+    if(statement->match_prefix ? length < match_length : length != match_length)
+        return false;
+    return memcmp(value, statement->match, match_length) == 0;
+}
+
+/*
+*function to set up the index of a column
+*@param     column          COLUMN_USERNAME or COLUMN_EMAIL
+*@param     root_page_num   page number of the index's root node
+*@returns a pointer to the index
+*/
+Index* index_open(Column column, uint32_t root_page_num){
+    Index* index                = (Index*)malloc(sizeof(Index));
+    index->column               = column;
+    index->root_page_num        = root_page_num;
+    index->value_size           = (column == COLUMN_USERNAME) ? INDEX_USERNAME_VALUE_SIZE : INDEX_EMAIL_VALUE_SIZE;
+    index->key_size             = index->value_size + INDEX_ID_SIZE;
+    index->leaf_max_keys        = (PAGE_SIZE - INDEX_NODE_BODY_OFFSET) / index->key_size;
+    index->internal_max_keys    = (PAGE_SIZE - INDEX_NODE_BODY_OFFSET) / (index->key_size + INTERNAL_NODE_CHILD_SIZE);
+
+    return index;
+}
+
+/*
+*function to build the key of an index entry, the value cut or padded with zeros to the value size
+*followed by the id big endian, so comparing keys byte by byte orders them by value then id
+*@param     index       pointer to the index
+*@param     value       column value of the row
+*@param     id          id of the row
+*@param     key         buffer of the index's key size to build the key in
+*/
+void index_make_key(Index* index, const char* value, uint32_t id, uint8_t* key){
+    uint32_t length = strnlen(value, index->value_size);
+    memcpy(key, value, length);
+    memset(key + length, 0, index->value_size - length);
+    key[index->value_size]      = id >> 24;
+    key[index->value_size + 1]  = id >> 16;
+    key[index->value_size + 2]  = id >> 8;
+    key[index->value_size + 3]  = id;
+}
+
+/*
+*function to get the row id of an index key
+*@param     index       pointer to the index
+*@param     key         pointer to the key
+*@returns the id
+*/
+uint32_t index_key_id(Index* index, const uint8_t* key){
+    const uint8_t* id = key + index->value_size;
+    return ((uint32_t)id[0] << 24) | ((uint32_t)id[1] << 16) | ((uint32_t)id[2] << 8) | id[3];
+}
+
+/*
+*function to compare two index keys for qsort_r
+*@param     key_size    pointer to the size of the keys
+*/
+int compare_index_keys(const void* a, const void* b, void* key_size){
+    return memcmp(a, b, *(uint32_t*)key_size);
+}
+
+/*
+*function to find the leaf of an index a key belongs to, for the writer
+*@param     pager       pointer to Pager
+*@param     index       pointer to the index
+*@param     key         key to search
+*@param     path        filled with the internal nodes passed from the root
+*@param     path_index  filled with the child taken in each of them
+*@param     depth       set to the number of internal nodes passed
+*@returns page number of the leaf
+*/
+uint32_t index_find_leaf(Pager* pager, Index* index, const uint8_t* key, uint32_t* path, uint32_t* path_index, uint32_t* depth){
+    uint32_t page_num   = index->root_page_num;
+    void*    node       = get_page(pager, page_num);
+    *depth              = 0;
+    while(get_node_type(node) == NODE_INTERNAL){
+        uint32_t child      = index_node_find(index, node, key);
+        path[*depth]        = page_num;
+        path_index[*depth]  = child;
+        (*depth)++;
+        page_num            = *index_internal_child(node, child);
+        node                = get_page(pager, page_num);
+    }
+    return page_num;
+}
+
+/*
+*function to write the children and keys of an index internal node
+*@param     index       pointer to the index
+*@param     node        pointer to the internal node
+*@param     children    num_keys + 1 children, the last one becomes the right child
+*@param     keys        the keys
+*@param     num_keys    number of keys
+*/
+void index_internal_node_write(Index* index, void* node, uint32_t* children, uint8_t* keys, uint32_t num_keys){
+    *internal_node_num_keys(node)       = num_keys;
+    *internal_node_right_child(node)    = children[num_keys];
+    memcpy((uint8_t*)node + INDEX_NODE_BODY_OFFSET, children, num_keys * INTERNAL_NODE_CHILD_SIZE);
+    memcpy(index_internal_key(index, node, 0), keys, num_keys * index->key_size);
+}
+
+/*
+*function to add a level to an index after its root split in place,
+*the root's left half moves to a new child so the root page never changes
+*@param     pager           pointer to Pager
+*@param     index           pointer to the index
+*@param     separator       highest key of the left half, not inside the root page
+*@param     right_page_num  page holding the right half
+*/
+void index_grow_root(Pager* pager, Index* index, const uint8_t* separator, uint32_t right_page_num){
+    uint32_t left_page_num  = get_unused_page_num(pager);
+    void*    left           = get_page(pager, left_page_num);
+    void*    root           = get_page(pager, index->root_page_num);
+    memcpy(left, root, PAGE_SIZE);
+    set_node_root(left, false);
+    pager_mark_dirty(pager, left_page_num);
+
+    uint32_t children[2] = {left_page_num, right_page_num};
+    initialize_internal_node(root);
+    set_node_root(root, true);
+    index_internal_node_write(index, root, children, (uint8_t*)separator, 1);
+    pager_mark_dirty(pager, index->root_page_num);
+}
+
+/*
+*function to add the new right sibling of a split node to its parent, splitting parents up the path as needed
+*@param     pager           pointer to Pager
+*@param     index           pointer to the index
+*@param     path            internal nodes from the root to the split node
+*@param     path_index      child taken in each of them
+*@param     level           depth of the parent of the split node
+*@param     separator       highest key left in the split node
+*@param     new_page_num    page number of the new sibling
+*/
+void index_insert_child(Pager* pager, Index* index, uint32_t* path, uint32_t* path_index, uint32_t level,
+                        const uint8_t* separator, uint32_t new_page_num){
+    uint32_t    key_size = index->key_size;
+    uint32_t    children[PAGE_SIZE / INTERNAL_NODE_CHILD_SIZE];
+    uint8_t     keys[PAGE_SIZE + INDEX_MAX_KEY_SIZE];
+    uint8_t     carried[INDEX_MAX_KEY_SIZE];
+    memcpy(carried, separator, key_size);
+
+    while(true){
+        uint32_t page_num   = path[level];
+        uint32_t position   = path_index[level];
+        void*    node       = get_page(pager, page_num);
+        uint32_t num_keys   = *internal_node_num_keys(node);
+        pager_mark_dirty(pager, page_num);
+
+        //the split node keeps its place under the separator, its old key goes to the new node right of it
+        memcpy(children, (uint8_t*)node + INDEX_NODE_BODY_OFFSET, num_keys * INTERNAL_NODE_CHILD_SIZE);
+        children[num_keys] = *internal_node_right_child(node);
+        memcpy(keys, index_internal_key(index, node, 0), num_keys * key_size);
+        memmove(children + position + 2, children + position + 1, (num_keys - position) * INTERNAL_NODE_CHILD_SIZE);
+        children[position + 1] = new_page_num;
+        memmove(keys + (position + 1) * key_size, keys + position * key_size, (num_keys - position) * key_size);
+        memcpy(keys + position * key_size, carried, key_size);
+        num_keys++;
+
+        if(num_keys <= index->internal_max_keys){
+            index_internal_node_write(index, node, children, keys, num_keys);
+            return;
+        }
+
+        //split around the middle key, it moves up to the parent
+        uint32_t left_count     = num_keys / 2;
+        uint32_t right_page_num = get_unused_page_num(pager);
+        void*    right          = get_page(pager, right_page_num);
+        initialize_internal_node(right);
+        index_internal_node_write(index, right, children + left_count + 1, keys + (left_count + 1) * key_size,
+                                  num_keys - left_count - 1);
+        pager_mark_dirty(pager, right_page_num);
+        index_internal_node_write(index, get_page(pager, page_num), children, keys, left_count);
+        memcpy(carried, keys + left_count * key_size, key_size);
+
+        if(page_num == index->root_page_num){
+            index_grow_root(pager, index, carried, right_page_num);
+            return;
+        }
+        level--;
+        new_page_num = right_page_num;
+    }
+}
+
+/*
+*function to add a key to an index, a full leaf is split in two
+*@param     pager       pointer to Pager
+*@param     index       pointer to the index
+*@param     key         key to add, nothing changes if it is there already
+*/
+void index_insert(Pager* pager, Index* index, const uint8_t* key){
+    uint32_t    key_size = index->key_size;
+    uint32_t    path[BTREE_MAX_DEPTH];
+    uint32_t    path_index[BTREE_MAX_DEPTH];
+    uint32_t    depth;
+    uint32_t    page_num    = index_find_leaf(pager, index, key, path, path_index, &depth);
+    void*       node        = get_page(pager, page_num);
+    uint32_t    num_keys    = *leaf_node_num_cells(node);
+    uint32_t    position    = index_node_find(index, node, key);
+
+    if(position < num_keys && memcmp(index_leaf_key(index, node, position), key, key_size) == 0)
+        return;
+    pager_mark_dirty(pager, page_num);
+
+    if(num_keys < index->leaf_max_keys){
+        memmove(index_leaf_key(index, node, position + 1), index_leaf_key(index, node, position),
+                (num_keys - position) * key_size);
+        memcpy(index_leaf_key(index, node, position), key, key_size);
+        *leaf_node_num_cells(node) = num_keys + 1;
+        return;
+    }
+
+    //the full leaf and the new key are split evenly between the leaf and a new right sibling
+    uint8_t keys[PAGE_SIZE + INDEX_MAX_KEY_SIZE];
+    uint8_t separator[INDEX_MAX_KEY_SIZE];
+    memcpy(keys, index_leaf_key(index, node, 0), position * key_size);
+    memcpy(keys + position * key_size, key, key_size);
+    memcpy(keys + (position + 1) * key_size, index_leaf_key(index, node, position), (num_keys - position) * key_size);
+    num_keys++;
+
+    uint32_t left_count     = (num_keys + 1) / 2;
+    uint32_t right_page_num = get_unused_page_num(pager);
+    void*    right          = get_page(pager, right_page_num);
+    node                    = get_page(pager, page_num);
+    initialize_index_leaf_node(right);
+    *leaf_node_num_cells(right) = num_keys - left_count;
+    *leaf_node_next_leaf(right) = *leaf_node_next_leaf(node);
+    memcpy(index_leaf_key(index, right, 0), keys + left_count * key_size, (num_keys - left_count) * key_size);
+    pager_mark_dirty(pager, right_page_num);
+
+    *leaf_node_num_cells(node)  = left_count;
+    *leaf_node_next_leaf(node)  = right_page_num;
+    memcpy(index_leaf_key(index, node, 0), keys, left_count * key_size);
+    memcpy(separator, keys + (left_count - 1) * key_size, key_size);
+
+    if(page_num == index->root_page_num)
+        index_grow_root(pager, index, separator, right_page_num);
+    else
+        index_insert_child(pager, index, path, path_index, depth - 1, separator, right_page_num);
+}
+
+/*
+*function to find the leaf before a leaf of an index in its leaf chain
+*@param     pager       pointer to Pager
+*@param     index       pointer to the index
+*@param     path        internal nodes from the root to the leaf
+*@param     path_index  child taken in each of them
+*@param     depth       number of internal nodes on the path
+*@returns page number of the previous leaf, 0 for the first leaf
+*/
+uint32_t index_prev_leaf(Pager* pager, Index* index, uint32_t* path, uint32_t* path_index, uint32_t depth){
+    int32_t level = depth - 1;
+    while(level >= 0 && path_index[level] == 0)
+        level--;
+    if(level < 0)
+        return 0;
+
+    void*    node       = get_page(pager, path[level]);
+    uint32_t page_num   = *index_internal_child(node, path_index[level] - 1);
+    node = get_page(pager, page_num);
+    while(get_node_type(node) == NODE_INTERNAL){
+        page_num    = *internal_node_right_child(node);
+        node        = get_page(pager, page_num);
+    }
+    return page_num;
+}
+
+/*
+*function to remove an emptied node of an index from its parent, parents left without children are
+*freed up the path, a root left with a single child is collapsed by index_root_collapse
+*@param     pager       pointer to Pager
+*@param     index       pointer to the index
+*@param     path        internal nodes from the root to the removed node
+*@param     path_index  child taken in each of them
+*@param     level       depth of the removed node
+*/
+void index_remove_child(Pager* pager, Index* index, uint32_t* path, uint32_t* path_index, uint32_t level){
+    while(level > 0){
+        uint32_t parent_page_num = path[level - 1];
+        uint32_t position        = path_index[level - 1];
+        void*    parent          = get_page(pager, parent_page_num);
+        uint32_t num_keys        = *internal_node_num_keys(parent);
+        pager_mark_dirty(pager, parent_page_num);
+
+        if(num_keys == 0){
+            if(parent_page_num == index->root_page_num){
+                initialize_index_leaf_node(parent);
+                set_node_root(parent, true);
+                return;
+            }
+            free_page(pager, parent_page_num);
+            level--;
+            continue;
+        }
+
+        if(position == num_keys)
+            *internal_node_right_child(parent) = *index_internal_child(parent, num_keys - 1);
+        else{
+            memmove(index_internal_child(parent, position), index_internal_child(parent, position + 1),
+                    (num_keys - position - 1) * INTERNAL_NODE_CHILD_SIZE);
+            memmove(index_internal_key(index, parent, position), index_internal_key(index, parent, position + 1),
+                    (num_keys - position - 1) * index->key_size);
+        }
+        *internal_node_num_keys(parent) = num_keys - 1;
+        break;
+    }
+}
+
+/*
+*function to collapse the root of an index left with a single child into that child
+*@param     pager       pointer to Pager
+*@param     index       pointer to the index
+*/
+void index_root_collapse(Pager* pager, Index* index){
+    void* root = get_page(pager, index->root_page_num);
+    while(get_node_type(root) == NODE_INTERNAL && *internal_node_num_keys(root) == 0){
+        uint32_t child_page_num = *internal_node_right_child(root);
+        void*    child          = get_page(pager, child_page_num);
+        root                    = get_page(pager, index->root_page_num);
+        memcpy(root, child, PAGE_SIZE);
+        set_node_root(root, true);
+        pager_mark_dirty(pager, index->root_page_num);
+        free_page(pager, child_page_num);
+        root = get_page(pager, index->root_page_num);
+    }
+}
+
+/*
+*function to remove a key from an index, a leaf left empty is unlinked and its page freed
+*@param     pager       pointer to Pager
+*@param     index       pointer to the index
+*@param     key         key to remove, nothing changes if it is not there
+*/
+void index_delete(Pager* pager, Index* index, const uint8_t* key){
+    uint32_t    key_size = index->key_size;
+    uint32_t    path[BTREE_MAX_DEPTH];
+    uint32_t    path_index[BTREE_MAX_DEPTH];
+    uint32_t    depth;
+    uint32_t    page_num    = index_find_leaf(pager, index, key, path, path_index, &depth);
+    void*       node        = get_page(pager, page_num);
+    uint32_t    num_keys    = *leaf_node_num_cells(node);
+    uint32_t    position    = index_node_find(index, node, key);
+
+    if(position >= num_keys || memcmp(index_leaf_key(index, node, position), key, key_size) != 0)
+        return;
+    pager_mark_dirty(pager, page_num);
+
+    if(num_keys > 1 || depth == 0){
+        memmove(index_leaf_key(index, node, position), index_leaf_key(index, node, position + 1),
+                (num_keys - position - 1) * key_size);
+        *leaf_node_num_cells(node) = num_keys - 1;
+        return;
+    }
+
+    //the leaf empties, take it out of the leaf chain and the tree
+    uint32_t next_page_num  = *leaf_node_next_leaf(node);
+    uint32_t prev_page_num  = index_prev_leaf(pager, index, path, path_index, depth);
+    if(prev_page_num != 0){
+        *leaf_node_next_leaf(get_page(pager, prev_page_num)) = next_page_num;
+        pager_mark_dirty(pager, prev_page_num);
+    }
+    index_remove_child(pager, index, path, path_index, depth);
+    free_page(pager, page_num);
+    index_root_collapse(pager, index);
+}
+
+/*
+*function to add the entries of a new row to the indexes of the table
+*@param     table       pointer to the table
+*@param     row         pointer to the row
+*/
+void index_insert_row(Table* table, Row* row){
+    uint8_t key[INDEX_MAX_KEY_SIZE];
+    for(uint32_t column = COLUMN_USERNAME; column < NUM_COLUMNS; column++){
+        Index* index = table->indexes[column];
+        if(index == NULL)
+            continue;
+        index_make_key(index, row_column_value(row, (Column)column), row->id, key);
+        index_insert(table->pager, index, key);
+    }
+}
+
+/*
+*function to remove the entries of a deleted row from the indexes of the table
+*@param     table       pointer to the table
+*@param     row         pointer to the row as it was before the delete
+*/
+void index_delete_row(Table* table, Row* row){
+    uint8_t key[INDEX_MAX_KEY_SIZE];
+    for(uint32_t column = COLUMN_USERNAME; column < NUM_COLUMNS; column++){
+        Index* index = table->indexes[column];
+        if(index == NULL)
+            continue;
+        index_make_key(index, row_column_value(row, (Column)column), row->id, key);
+        index_delete(table->pager, index, key);
+    }
+}
+
+/*
+*function to collect the ids of the index entries that can hold a value, the leaves are pinned
+*one at a time, the rows are read after
+*@param     table       pointer to the table
+*@param     index       pointer to the index
+*@param     value       value to look up
+*@param     prefix      true for the entries starting with the value, else the ones equal to it
+*@param     num_ids     set to the number of ids
+*@returns the ids in the order of the index, in the statement arena, values cut to the value size can match more rows than wanted
+*/
+uint32_t* index_collect_ids(Table* table, Index* index, const char* value, bool prefix, uint32_t* num_ids){
+    Pager*      pager       = table->pager;
+    uint32_t    capacity    = 256;
+    uint32_t*   ids         = (uint32_t*)arena_alloc(&statement_arena, capacity * sizeof(uint32_t));
+    uint8_t     key[INDEX_MAX_KEY_SIZE];
+    bool        done        = false;
+    *num_ids                = 0;
+
+    //an equal value fills the whole value part of the key, a prefix only its own bytes
+    index_make_key(index, value, 0, key);
+    uint32_t length = prefix ? strnlen(value, index->value_size) : index->value_size;
+
+    uint32_t page_num   = index->root_page_num;
+    void*    node       = pager_pin(pager, page_num);
+    while(get_node_type(node) == NODE_INTERNAL){
+        uint32_t child_page_num = *index_internal_child(node, index_node_find(index, node, key));
+        pager_unpin(pager, page_num);
+        page_num    = child_page_num;
+        node        = pager_pin(pager, page_num);
+    }
+
+    uint32_t position = index_node_find(index, node, key);
+    while(true){
+        uint32_t num_keys = *leaf_node_num_cells(node);
+        for(; position < num_keys; position++){
+            uint8_t* entry = index_leaf_key(index, node, position);
+            if(memcmp(entry, key, length) != 0){
+                done = true;
+                break;
+            }
+            if(*num_ids == capacity){
+                ids         = (uint32_t*)arena_grow(&statement_arena, ids, capacity * sizeof(uint32_t),
+                                                    2 * capacity * sizeof(uint32_t));
+                capacity   *= 2;
+            }
+            ids[(*num_ids)++] = index_key_id(index, entry);
+        }
+
+        uint32_t next_page_num = *leaf_node_next_leaf(node);
+        pager_unpin(pager, page_num);
+        if(done || next_page_num == 0)
+            break;
+        page_num    = next_page_num;
+        node        = pager_pin(pager, page_num);
+        position    = 0;
+    }
+    return ids;
+}
+
+/*
+*function to build the tree of an index from the rows of the table, the keys are sorted
+*and packed into leaves left to right, then the levels above are built bottom-up
+*@param     table       pointer to the table, held exclusively
+*@param     index       pointer to the index
+*@returns page number of the root of the new tree
+*/
+uint32_t index_build(Table* table, Index* index){
+    Pager*      pager       = table->pager;
+    uint32_t    key_size    = index->key_size;
+    uint32_t    capacity    = 1024;
+    uint32_t    num_keys    = 0;
+    uint8_t*    keys        = (uint8_t*)malloc(capacity * key_size);
+    Row         row;
+    Cursor      scan;
+    Cursor*     cursor      = &scan;
+
+    table_start(table, cursor);
+    cursor_read_ahead_start(cursor, UINT32_MAX);
+    while(!cursor->end_of_table){
+        if(num_keys == capacity){
+            capacity   *= 2;
+            keys        = (uint8_t*)realloc(keys, (size_t)capacity * key_size);
+        }
+        row.id = cursor_key(cursor);
+        deserialize_row(cursor_value(cursor), &row);
+        index_make_key(index, row_column_value(&row, index->column), row.id, keys + (size_t)num_keys * key_size);
+        num_keys++;
+        advance_cursor(cursor);
+    }
+    cursor_close(cursor);
+    qsort_r(keys, num_keys, key_size, compare_index_keys, &key_size);
+
+    //nodes are left as full as a bulk load leaves them, the page and highest key of each node of a level
+    uint32_t    leaf_fill       = index->leaf_max_keys * BULK_LOAD_DEFAULT_FILL / 100;
+    uint32_t    internal_fill   = (index->internal_max_keys + 1) * BULK_LOAD_DEFAULT_FILL / 100;
+    uint32_t    num_nodes       = 0;
+    uint32_t*   node_pages      = (uint32_t*)malloc((num_keys / leaf_fill + 1) * sizeof(uint32_t));
+    uint8_t*    node_keys       = (uint8_t*)malloc((size_t)(num_keys / leaf_fill + 1) * key_size);
+    uint32_t    prev_page_num   = 0;
+    uint32_t    first           = 0;
+    do{
+        uint32_t count      = (num_keys - first < leaf_fill) ? num_keys - first : leaf_fill;
+        uint32_t page_num   = get_unused_page_num(pager);
+        void*    node       = get_page(pager, page_num);
+        initialize_index_leaf_node(node);
+        *leaf_node_num_cells(node) = count;
+        memcpy(index_leaf_key(index, node, 0), keys + (size_t)first * key_size, count * key_size);
+        pager_mark_dirty(pager, page_num);
+        if(prev_page_num != 0){
+            *leaf_node_next_leaf(get_page(pager, prev_page_num)) = page_num;
+            pager_mark_dirty(pager, prev_page_num);
+        }
+        if(count > 0)
+            memcpy(node_keys + (size_t)num_nodes * key_size, keys + (size_t)(first + count - 1) * key_size, key_size);
+        node_pages[num_nodes++] = page_num;
+        prev_page_num           = page_num;
+        first                  += count;
+    }while(first < num_keys);
+    free(keys);
+
+    //each level is written over the one below it, a node only reads the entries at or after its own
+    while(num_nodes > 1){
+        uint32_t num_parents = 0;
+        for(first = 0; first < num_nodes;){
+            uint32_t count = (num_nodes - first < internal_fill) ? num_nodes - first : internal_fill;
+            //a last node with a single child would have no keys, it takes one from the node before it
+            if(num_nodes - first - count == 1)
+                count--;
+            uint32_t page_num   = get_unused_page_num(pager);
+            void*    node       = get_page(pager, page_num);
+            initialize_internal_node(node);
+            index_internal_node_write(index, node, node_pages + first, node_keys + (size_t)first * key_size, count - 1);
+            pager_mark_dirty(pager, page_num);
+            memmove(node_keys + (size_t)num_parents * key_size, node_keys + (size_t)(first + count - 1) * key_size, key_size);
+            node_pages[num_parents++] = page_num;
+            first += count;
+        }
+        num_nodes = num_parents;
+    }
+
+    uint32_t root_page_num = node_pages[0];
+    set_node_root(get_page(pager, root_page_num), true);
+    pager_mark_dirty(pager, root_page_num);
+    free(node_pages);
+    free(node_keys);
+    return root_page_num;
+}
+
+/*
+*function to free every page of an index tree
+*@param     pager       pointer to Pager
+*@param     index       pointer to the index
+*@param     page_num    root of the subtree to free
+*/
+void index_free_tree(Pager* pager, Index* index, uint32_t page_num){
+    void* node = get_page(pager, page_num);
+    if(get_node_type(node) == NODE_INTERNAL){
+        uint32_t num_keys = *internal_node_num_keys(node);
+        for(uint32_t i = 0; i <= num_keys; i++)
+            index_free_tree(pager, index, *index_internal_child(get_page(pager, page_num), i));
+    }
+    free_page(pager, page_num);
+}
+
+/*
+*function to point an index and the db header at a new root
+*@param     table           pointer to the table
+*@param     index           pointer to the index
+*@param     root_page_num   page number of the root
+*/
+void index_set_root(Table* table, Index* index, uint32_t root_page_num){
+    index->root_page_num = root_page_num;
+    *db_header_index_root(get_page(table->pager, DB_HEADER_PAGE_NUM), index->column) = root_page_num;
+    pager_mark_dirty(table->pager, DB_HEADER_PAGE_NUM);
+}
+
+/*
+*function to rebuild every index of the table from its rows, after the rows were replaced wholesale
+*@param     table       pointer to the table, held exclusively
+*/
+void index_rebuild_all(Table* table){
+    for(uint32_t column = COLUMN_USERNAME; column < NUM_COLUMNS; column++){
+        Index* index = table->indexes[column];
+        if(index == NULL)
+            continue;
+        index_free_tree(table->pager, index, index->root_page_num);
+        index_set_root(table, index, index_build(table, index));
+    }
+}
+
+/*
+*function to execute create index, the index is built from the rows already in the table
+*@param     statement       pointer to statement to be executed
+*@param     table           pointer to the table, held exclusively
+*@returns an enum of type ExecuteResult
+*/
+ExecuteResult execute_create_index(Statement* statement, Table* table){
+    if(table->indexes[statement->match_column] != NULL)
+        return EXECUTE_INDEX_EXISTS;
+    Index* index = index_open(statement->match_column, 0);
+    index_set_root(table, index, index_build(table, index));
+    table->indexes[statement->match_column] = index;
+    return EXECUTE_SUCCESS;
+}
+
+/*
+*function to execute insert operation
+*@param     statement       pointer to statement to be executed
+*@param     table           pointer to the table on which the statements should be executed
+*@returns an enum of type ExecuteResult
+*/
+ExecuteResult execute_insert (Statement* statement, Table* table){
+
+    uint32_t    key         = statement->row_to_insert.id;
+    Cursor      position;
+    Cursor*     cursor      = &position;
+    table_find(table, key, cursor);
+
+    //check the leaf the key belongs to for a duplicate
+    void*       node        = get_page (table->pager, cursor->page_num);
+    uint32_t    num_cells   = *(leaf_node_num_cells (node));
+
+    if(cursor->cell_num < num_cells){
+        uint32_t ket_at_cursor = *leaf_node_key(node, cursor->cell_num);
+        if(ket_at_cursor == key){
+            cursor_close (cursor);
+            return EXECUTE_DUPLICATE_KEY;
+        }
+    }
+
+    uint32_t    levels      = leaf_node_insert (cursor, key, &(statement->row_to_insert));
+
+    cursor_close_counted (cursor, levels, 1);
+    index_insert_row(table, &(statement->row_to_insert));
+    stats_count(STAT_ROWS_INSERTED, 1);
+    return EXECUTE_SUCCESS;
+    
+}
+
+/*
+*function to find the leaf before the cursor's leaf in the leaf chain, using the cursor's path
+*@param cursor      cursor on a non-root leaf
+*@returns page number of the previous leaf, 0 for the first leaf
+*/
+uint32_t leaf_node_prev_leaf(Cursor* cursor){
+    Pager*  pager = cursor->table->pager;
+    int32_t level = cursor->depth - 1;
+
+    //climb to the closest ancestor where the path did not take the leftmost child
+    while(level >= 0 && cursor->path_index[level] == 0)
+        level--;
+    if(level < 0)
+        return 0;
+
+    //then down the rightmost edge of the subtree left of the path
+    void*    node       = get_page(pager, cursor->path[level]);
+    uint32_t page_num   = *internal_node_child(node, cursor->path_index[level] - 1);
+    node = get_page(pager, page_num);
+    while(get_node_type(node) == NODE_INTERNAL){
+        page_num    = *internal_node_right_child(node);
+        node        = get_page(pager, page_num);
+    }
+    return page_num;
+}
+
+/*
+*function to remove an emptied node from its parent, parents left without children are
+*freed up the path, a root left with a single child is collapsed by root_node_collapse
+*@param cursor      cursor holding the path from the root to the removed node
+*@param level       depth of the removed node
+*@returns depth of the parent the node was removed from, the counts above it still have the removed rows
+*/
+uint32_t internal_node_remove_child(Cursor* cursor, uint32_t level){
+    Table* table = cursor->table;
+    Pager* pager = table->pager;
+
+    while(level > 0){
+        uint32_t parent_page_num = cursor->path[level - 1];
+        uint32_t index           = cursor->path_index[level - 1];
+        void*    parent          = get_page(pager, parent_page_num);
+        uint32_t num_keys        = *internal_node_num_keys(parent);
+        pager_mark_dirty(pager, parent_page_num);
+
+        //the removed node was the only child, the parent goes as well
+        if(num_keys == 0){
+            if(parent_page_num == table->root_page_num){
+                initialize_leaf_node(parent);
+                set_node_root(parent, true);
+                return 0;
+            }
+            free_page(pager, parent_page_num);
+            level--;
+            continue;
+        }
+
+        //keys are upper bounds, the remaining ones still route every key correctly,
+        //the count of the last child left is already in the right child's place
+        if(index == num_keys)
+            *internal_node_right_child(parent) = *internal_node_child(parent, num_keys - 1);
+        else{
+            memmove(internal_node_cell(parent, index), internal_node_cell(parent, index + 1),
+                    (num_keys - index - 1) * INTERNAL_NODE_CHILD_SIZE);
+            memmove(internal_node_key(parent, index), internal_node_key(parent, index + 1),
+                    (num_keys - index - 1) * INTERNAL_NODE_KEY_SIZE);
+            memmove(internal_node_count(parent, index), internal_node_count(parent, index + 1),
+                    (num_keys - index) * INTERNAL_NODE_COUNT_SIZE);
+        }
+        *internal_node_num_keys(parent) = num_keys - 1;
+        return level - 1;
+    }
+    return 0;
+}
+
+/*
+*function to collapse a root left with a single child into that child, the writer changes its own copies
+*of the root and the child, readers keep the versions of their snapshots
+*@param table       pointer to the table
+*/
+void root_node_collapse(Table* table){
+    Pager* pager = table->pager;
+    void*  root  = get_page(pager, table->root_page_num);
+    while(get_node_type(root) == NODE_INTERNAL && *internal_node_num_keys(root) == 0){
+        uint32_t child_page_num = *internal_node_right_child(root);
+        memcpy(root, pager_pin(pager, child_page_num), PAGE_SIZE);
+        set_node_root(root, true);
+        pager_mark_dirty(pager, table->root_page_num);
+        free_page(pager, child_page_num);
+        pager_unpin(pager, child_page_num);
+        root = get_page(pager, table->root_page_num);
+    }
+}
+
+/*
+*function to execute delete operation, a leaf left empty is unlinked and its page freed
+*@param     statement       pointer to statement to be executed
+*@param     table           pointer to the table on which the statements should be executed
+*@returns an enum of type ExecuteResult
+*/
+ExecuteResult execute_delete(Statement* statement, Table* table){
+    uint32_t    key         = statement->key;
+    Cursor      position;
+    Cursor*     cursor      = &position;
+    table_find(table, key, cursor);
+    uint32_t    page_num    = cursor->page_num;
+    void*       node        = get_page(table->pager, page_num);
+    uint32_t    num_cells   = *leaf_node_num_cells(node);
+
+    if(cursor->cell_num >= num_cells || *leaf_node_key(node, cursor->cell_num) != key){
+        cursor_close(cursor);
+        return EXECUTE_KEY_NOT_FOUND;
+    }
+
+    //the index entries are found by the values the row had
+    Row row;
+    row.id = key;
+    deserialize_row(leaf_node_value(node, cursor->cell_num), &row);
+
+    if(num_cells - 1 > 0 || cursor->depth == 0){
+        leaf_node_remove_cell(node, cursor->cell_num);
+        pager_mark_dirty(table->pager, page_num);
+        cursor_close_counted(cursor, cursor->depth, -1);
+        index_delete_row(table, &row);
+        stats_count(STAT_ROWS_DELETED, 1);
+        return EXECUTE_SUCCESS;
+    }
+
+    //the leaf empties, the previous leaf links past it, pin that one as well
+    uint32_t prev_page_num = leaf_node_prev_leaf(cursor);
+    if(prev_page_num != 0)
+        pager_pin(table->pager, prev_page_num);
+    leaf_node_remove_cell(node, cursor->cell_num);
+    pager_mark_dirty(table->pager, page_num);
+
+    //take the leaf out of the leaf chain and the tree
+    uint32_t next_page_num = *leaf_node_next_leaf(node);
+    if(prev_page_num != 0){
+        *leaf_node_next_leaf(get_page(table->pager, prev_page_num)) = next_page_num;
+        pager_mark_dirty(table->pager, prev_page_num);
+    }
+    uint32_t levels = internal_node_remove_child(cursor, cursor->depth);
+
+    //nothing links to the page anymore, it is freed before the pin goes
+    free_page(table->pager, page_num);
+    pager_unpin(table->pager, page_num);
+    if(prev_page_num != 0)
+        pager_unpin(table->pager, prev_page_num);
+
+    //only a root left without keys collapses, then no level is above the removal
+    root_node_collapse(table);
+    cursor_path_add_to_counts(cursor, levels, -1);
+    index_delete_row(table, &row);
+    stats_count(STAT_ROWS_DELETED, 1);
+    return EXECUTE_SUCCESS;
+}
+
+/*
+*function to execute a select on a text column through the column's index,
+*the ids are taken from the index and the rows looked up by id
+*@param     statement       pointer to statement to be executed
+*@param     table           pointer to the table on which the statements should be executed
+*@returns an enum of type ExecuteResult
+*/
+ExecuteResult execute_index_select(Statement* statement, Table* table){
+    RowView     row;
+    RowCallback on_row  = statement->on_row ? statement->on_row : print_selected_row;
+    Index*      index   = table->indexes[statement->match_column];
+    uint32_t    num_ids;
+    uint32_t*   ids     = index_collect_ids(table, index, statement->match, statement->match_prefix, &num_ids);
+
+    uint32_t    skipped = 0;
+    uint32_t    sent    = 0;
+
+    //the index is in value order, the rows go out in id order like a scan sends them
+    qsort(ids, num_ids, sizeof(uint32_t), compare_page_nums);
+    for(uint32_t i = 0; i < num_ids && sent < statement->limit; i++){
+        if(ids[i] < statement->key_lo || ids[i] > statement->key_hi)
+            continue;
+        //the row can be gone or changed since the index was read, it is checked like a scan checks it
+        Cursor   cursor;
+        table_find(table, ids[i], &cursor);
+        void*    node       = cursor.node;
+        bool     found      = cursor.cell_num < *leaf_node_num_cells(node) && *leaf_node_key(node, cursor.cell_num) == ids[i];
+        if(found){
+            cursor_row_view(&cursor, &row);
+            found = row_matches(statement, &row);
+        }
+        if(found && skipped < statement->offset)
+            skipped++;
+        else if(found){
+            on_row(&row, statement->on_row_context);
+            sent++;
+        }
+        cursor_close(&cursor);
+    }
+    if(statement->aggregate == AGGREGATE_NONE)
+        stats_count(STAT_ROWS_SENT, sent);
+    return EXECUTE_SUCCESS;
+}
+
+/*
+*function to execute a select of single ids, "where id = A" or "where id in (A, B, ...)",
+*the ids are sorted and looked up in order, an id in the leaf the one before it was found in
+*is searched for in that leaf without descending from the root again
+*@param     statement       pointer to statement to be executed
+*@param     table           pointer to the table on which the statements should be executed
+*@returns an enum of type ExecuteResult
+*/
+ExecuteResult execute_key_select(Statement* statement, Table* table){
+    RowView     row;
+    RowCallback on_row      = statement->on_row ? statement->on_row : print_selected_row;
+    uint32_t    keys[STATEMENT_MAX_KEYS];
+    uint32_t    num_keys    = statement->num_keys;
+    if(num_keys == 0){
+        keys[0]     = statement->key_lo;
+        num_keys    = 1;
+    }
+    else{
+        memcpy(keys, statement->keys, num_keys * sizeof(uint32_t));
+        qsort(keys, num_keys, sizeof(uint32_t), compare_page_nums);
+    }
+
+    Cursor      position;
+    Cursor*     cursor      = NULL;
+    void*       node        = NULL;
+    uint32_t    num_cells   = 0;
+    uint32_t    skipped     = 0;
+    uint32_t    sent        = 0;
+    for(uint32_t i = 0; i < num_keys && sent < statement->limit; i++){
+        if(i > 0 && keys[i] == keys[i - 1])
+            continue;
+        //the leaf holds the id if any leaf does as long as the id is not past its last key
+        if(cursor != NULL && (num_cells == 0 || keys[i] > *leaf_node_key(node, num_cells - 1))){
+            cursor_close(cursor);
+            cursor = NULL;
+        }
+        if(cursor == NULL){
+            cursor      = &position;
+            table_find(table, keys[i], cursor);
+            node        = cursor->node;
+            num_cells   = *leaf_node_num_cells(node);
+        }
+        else
+            cursor->cell_num += key_lower_bound(leaf_node_key(node, cursor->cell_num), num_cells - cursor->cell_num, keys[i]);
+
+        if(cursor->cell_num >= num_cells || *leaf_node_key(node, cursor->cell_num) != keys[i])
+            continue;
+        cursor_row_view(cursor, &row);
+        if(skipped < statement->offset)
+            skipped++;
+        else{
+            on_row(&row, statement->on_row_context);
+            sent++;
+        }
+    }
+    if(cursor != NULL)
+        cursor_close(cursor);
+    if(statement->aggregate == AGGREGATE_NONE)
+        stats_count(STAT_ROWS_SENT, sent);
+    return EXECUTE_SUCCESS;
+}
+
+/*
+*function to execute a select computing an aggregate, the leaves in the range are decoded
+*into column batches and the aggregate runs over whole batches, a select on an indexed
+*column feeds the rows its index finds into the batches instead
+*@param     statement       pointer to statement to be executed
+*@param     table           pointer to the table on which the statements should be executed
+*@returns an enum of type ExecuteResult
+*/
+ExecuteResult execute_aggregate(Statement* statement, Table* table){
+    ValueCallback   on_value    = statement->on_value ? statement->on_value : print_value;
+    Aggregation*    aggregation = (Aggregation*)arena_alloc(&statement_arena, sizeof(Aggregation));
+    aggregation_init(aggregation, statement);
+
+    //a count of an id range comes from the counts of the internal nodes
+    if(statement->aggregate == AGGREGATE_COUNT && statement->match_column == COLUMN_ID &&
+       statement->group_column == COLUMN_ID && statement->num_keys == 0){
+        on_value(NULL, table_count_range(table, statement->key_lo, statement->key_hi), statement->on_row_context);
+        return EXECUTE_SUCCESS;
+    }
+
+    if(statement->key_lo > statement->key_hi)
+        ;
+    else if(statement->num_keys > 0 ||
+            (statement->match_column != COLUMN_ID && table->indexes[statement->match_column] != NULL)){
+        Statement lookup        = *statement;
+        lookup.on_row           = aggregation_add_row;
+        lookup.on_row_context   = aggregation;
+        if(statement->num_keys > 0)
+            execute_key_select(&lookup, table);
+        else
+            execute_index_select(&lookup, table);
+    }
+    else{
+        Cursor  scan;
+        Cursor* cursor = &scan;
+        table_seek(table, statement->key_lo, cursor);
+        cursor_read_ahead_start(cursor, statement->key_hi);
+        while(!cursor->end_of_table){
+            void*    node       = cursor->node;
+            uint32_t num_cells  = *leaf_node_num_cells(node);
+            //cells of the leaf up to the high end of the range
+            uint32_t end        = (statement->key_hi == UINT32_MAX) ? num_cells :
+                                  key_lower_bound(leaf_node_key(node, 0), num_cells, statement->key_hi + 1);
+            if(aggregation->batch.count + (end - cursor->cell_num) > COLUMN_BATCH_SIZE)
+                aggregation_flush(aggregation);
+            column_batch_append_leaf(&(aggregation->batch), node, cursor->cell_num, end, statement);
+            if(end < num_cells)
+                break;
+            cursor->cell_num = num_cells - 1;
+            advance_cursor(cursor);
+        }
+        cursor_close(cursor);
+    }
+
+    aggregation_flush(aggregation);
+    aggregation_finish(aggregation, on_value, statement->on_row_context);
+    return EXECUTE_SUCCESS;
+}
+
+/*
+*function to execute select operation, a select of single ids looks each one up, a select on an
+*indexed column goes through its index, an offset into an id range is found by the counts of the
+*internal nodes instead of walking the rows
+*@param     statement       pointer to statement to be executed
+*@param     table           pointer to the table on which the statements should be executed
+*@returns an enum of type ExecuteResult
+*/
+ExecuteResult execute_select(Statement* statement, Table* table){
+    RowView     row;
+    RowCallback on_row  = statement->on_row ? statement->on_row : print_selected_row;
+    Cursor      scan;
+    Cursor*     cursor  = &scan;
+    uint32_t    skipped = 0;
+    uint32_t    sent    = 0;
+    if(statement->aggregate != AGGREGATE_NONE)
+        return execute_aggregate(statement, table);
+    if(statement->key_lo > statement->key_hi || statement->limit == 0)
+        return EXECUTE_SUCCESS;
+    if(statement->match_column == COLUMN_ID && (statement->num_keys > 0 || statement->key_lo == statement->key_hi))
+        return execute_key_select(statement, table);
+    if(statement->match_column != COLUMN_ID && table->indexes[statement->match_column] != NULL)
+        return execute_index_select(statement, table);
+
+    //seek to the low end of the range, or past the offset into it, and walk the leaves until the high end
+    if(statement->match_column == COLUMN_ID && statement->offset > 0){
+        uint32_t position = table_rank(table, statement->key_lo);
+        position = (position > UINT32_MAX - statement->offset) ? UINT32_MAX : position + statement->offset;
+        table_find_position(table, position, cursor);
+        skipped  = statement->offset;
+    }
+    else
+        table_seek(table, statement->key_lo, cursor);
+    cursor_read_ahead_start(cursor, statement->key_hi);
+    TRACE("table start\n");
+    while(cursor->end_of_table != true && cursor_key(cursor) <= statement->key_hi && sent < statement->limit){
+        cursor_row_view(cursor, &row);
+        //a writer can move rows between finding the rank and the position, the range still holds
+        if(row.id >= statement->key_lo && (statement->match_column == COLUMN_ID || row_matches(statement, &row))){
+            if(skipped < statement->offset)
+                skipped++;
+            else{
+                on_row(&row, statement->on_row_context);
+                sent++;
+            }
+        }
+        TRACE("adv cur\n");
+        advance_cursor(cursor);
     }
 
-    //seek to the page index on the file
-    off_t offset = lseek (pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
+    cursor_close(cursor);
+    stats_count(STAT_ROWS_SENT, sent);
+    return EXECUTE_SUCCESS;
+}
 
-    if(offset == -1){
-        printf("Error seeking: %d\n.",errno);
-        exit(EXIT_FAILURE);
-    }
+/*
+*function to parse an integer value of a statement
+*@param     text        token holding the value
+*@param     value       set to the value, out of range values are clamped to the int64_t range
+*returns true if the whole token is a decimal number
+*/
+bool parse_int(const char* text, int64_t* value){
+    char* end;
+    long long parsed = strtoll(text, &end, 10);
+    if(end == text || *end != '\0')
+        return false;
+    *value = parsed;
+    return true;
+}
 
-    //write page contents into the file
-    ssize_t bytes_written = write(pager->file_descriptor, pager->pages[page_num], PAGE_SIZE);
+/*
+*function to parse the values of a row, "id username email"
+*@param     text        row values separated by spaces, tokenized in place
+*@param     row         pointer to the row to fill
+*returns an enum of type PrepareResult
+*/
+PrepareResult prepare_row(char* text, Row* row){
+    char* id_str    = strtok(text," ");
+    char* username  = strtok(NULL," ");
+    char* email     = strtok(NULL," ");    
 
-    if(bytes_written == -1){
-        printf("Error writing:%d\n", errno);
-        exit(EXIT_FAILURE);
-    }
+    if (id_str == NULL || username == NULL || email == NULL)
+        return PREPARE_SYNTAX_ERROR;
 
+    int64_t id;
+    if(!parse_int(id_str, &id)) return PREPARE_SYNTAX_ERROR;
+    if(id < 0) return PREPARE_NEGATIVE_ID;
+    if(id > UINT32_MAX) return PREPARE_ID_OUT_OF_RANGE;
+    if(strlen(username) > COLUMN_USERNAME_SIZE) return PREPARE_STRING_TOO_LONG;
+    if(strlen(email) > COLUMN_EMAIL_SIZE) return PREPARE_STRING_TOO_LONG;
+
+    row->id = id;
+    strcpy(row->username, username);
+    strcpy(row->email, email);
+    return PREPARE_SUCCESS;
 }
 
 /*
-*function to close the db
-*@param     table       pointer to the Table contents
+*function to record a finished node of the level being built
+*@param     loader      pointer to the bulk loader
+*@param     page_num    page number of the node
+*@param     max_key     largest key in the node's subtree
+*@param     count       rows in the node's subtree
 */
-void db_close(Table* table){
-    Pager* pager            = table->pager;
-
-    for(uint32_t i = 0; i < pager->num_pages; i++){
-      
-        if(pager->pages[i] == NULL)
-            continue;
-        pager_flush (pager, i);
-        free (pager->pages[i]);
-        pager->pages[i] = NULL;
+void bulk_load_push_node(BulkLoader* loader, uint32_t page_num, uint32_t max_key, uint32_t count){
+    if(loader->num_nodes == loader->capacity){
+        loader->capacity    = loader->capacity ? loader->capacity * 2 : 64;
+        loader->node_pages  = (uint32_t*)realloc(loader->node_pages, loader->capacity * sizeof(uint32_t));
+        loader->node_keys   = (uint32_t*)realloc(loader->node_keys, loader->capacity * sizeof(uint32_t));
+        loader->node_counts = (uint32_t*)realloc(loader->node_counts, loader->capacity * sizeof(uint32_t));
     }
+    loader->node_pages[loader->num_nodes]   = page_num;
+    loader->node_keys[loader->num_nodes]    = max_key;
+    loader->node_counts[loader->num_nodes]  = count;
+    loader->num_nodes++;
+}
+
+/*
+*function to set up a bulk loader with no nodes yet
+*@param     loader          pointer to the bulk loader to initialize
+*@param     table           pointer to the table
+*@param     fill_percent    how full to pack the leaves and internal nodes, 1-100
+*/
+void bulk_load_init(BulkLoader* loader, Table* table, uint32_t fill_percent){
+    loader->table           = table;
+    loader->leaf_fill       = LEAF_NODE_SPACE_FOR_CELLS * fill_percent / 100;
+    loader->internal_fill   = (INTERNAL_NODE_MAX_KEYS + 1) * fill_percent / 100;
+    if(loader->leaf_fill < 1)       loader->leaf_fill = 1;
+    if(loader->internal_fill < 2)   loader->internal_fill = 2;
+    loader->num_rows        = 0;
+    loader->last_key        = 0;
+    loader->num_nodes       = 0;
+    loader->capacity        = 0;
+    loader->node_pages      = NULL;
+    loader->node_keys       = NULL;
+    loader->node_counts     = NULL;
+}
 
-  /*  //partial pages in the end
-    uint32_t num_additional_pages = table->num_rows % ROWS_PER_PAGE;
-    if(num_additional_pages > 0){
-        uint32_t page_num = num_full_pages;
-        if(pager->pages[page_num] != NULL){
+/*
+*function to start a bulk load into an empty table
+*@param     table           pointer to the table
+*@param     fill_percent    how full to pack the leaves and internal nodes, 1-100
+*@param     loader          pointer to the bulk loader to initialize
+*@returns EXECUTE_TABLE_NOT_EMPTY if the table already has rows
+*/
+ExecuteResult bulk_load_begin(Table* table, uint32_t fill_percent, BulkLoader* loader){
+    void* root = get_page(table->pager, table->root_page_num);
+    if(get_node_type(root) != NODE_LEAF || *leaf_node_num_cells(root) != 0)
+        return EXECUTE_TABLE_NOT_EMPTY;
 
-            pager_flush(pager, page_num, num_additional_pages * ROW_SIZE);
-            free(pager->pages[page_num]);
-            pager->pages[page_num] = NULL;
-        }
-    }
+    bulk_load_init(loader, table, fill_percent);
+    return EXECUTE_SUCCESS;
+}
+
+/*
+*function to append a row to the bulk load, rows must come in increasing id order
+*the row is written straight into the last leaf, a new leaf is started when it is full
+*@param     loader      pointer to the bulk loader
+*@param     row         pointer to the row to append
+*@returns EXECUTE_KEY_OUT_OF_ORDER if the id is not larger than the previous one
 */
-    int result = close(pager->file_descriptor);
-    if(result == -1){
-        printf("Error closing db file.\n");
-        exit(EXIT_FAILURE);
+ExecuteResult bulk_load_add(BulkLoader* loader, Row* row){
+    Pager* pager = loader->table->pager;
+    if(loader->num_rows > 0 && row->id <= loader->last_key)
+        return EXECUTE_KEY_OUT_OF_ORDER;
+
+    uint32_t page_num       = 0;
+    void*    leaf           = NULL;
+    uint32_t payload_size   = row_payload_size(row);
+    bool     leaf_full      = true;
+    if(loader->num_nodes > 0){
+        page_num    = loader->node_pages[loader->num_nodes - 1];
+        leaf        = get_page(pager, page_num);
+        leaf_full   = !leaf_node_fits(leaf, payload_size) ||
+                      leaf_node_used_space(leaf) + leaf_node_cell_size(payload_size) + LEAF_NODE_CELL_OVERHEAD > loader->leaf_fill;
     }
 
-    for (uint32_t i=0; i< TABLE_MAX_PAGES; i++){
-        void* page = pager->pages[i];
-        if(page){
-            free(page);
-            pager->pages[i] = NULL;
+    //start the next leaf, pages are allocated in key order so they are written sequentially
+    if(leaf_full){
+        uint32_t new_page_num = get_unused_page_num(pager);
+        if(loader->num_nodes > 0){
+            *leaf_node_next_leaf(leaf) = new_page_num;
+            pager_mark_dirty(pager, page_num);
         }
+        page_num    = new_page_num;
+        leaf        = get_page(pager, page_num);
+        initialize_leaf_node(leaf);
+        bulk_load_push_node(loader, page_num, row->id, 0);
     }
 
-    free  (pager);
-    free (table);
+    uint32_t num_cells = *leaf_node_num_cells(leaf);
+    leaf_node_insert_cell(leaf, num_cells, row->id, payload_size);
+    serialize_row(row, leaf_node_value(leaf, num_cells));
+    pager_mark_dirty(pager, page_num);
+
+    loader->node_keys[loader->num_nodes - 1] = row->id;
+    loader->node_counts[loader->num_nodes - 1]++;
+    loader->last_key = row->id;
+    loader->num_rows++;
+    return EXECUTE_SUCCESS;
 }
 
 /*
-*function to get a page
-*@param     pager      pointer to Pager, holding file hadles and the pages 
-*@param     page_num   page number of the page to read 
-*@returns a pointer to the page
+*function to evenly share the cells of the last two leaves,
+*so the tree does not end in a nearly empty leaf
+*@param     loader      pointer to the bulk loader
 */
-void* get_page(Pager* pager, uint32_t page_num){
+void bulk_load_balance_last_leaf(BulkLoader* loader){
+    if(loader->num_nodes < 2)
+        return;
 
-    printf("page-num = %d.\n", page_num);
-    if(page_num > TABLE_MAX_PAGES){
-        printf("Tried to fetch page number out of bound. %d > %d\n.",page_num, TABLE_MAX_PAGES);
-        exit(EXIT_FAILURE);
+    Pager*   pager      = loader->table->pager;
+    uint32_t left_num   = loader->node_pages[loader->num_nodes - 2];
+    uint32_t right_num  = loader->node_pages[loader->num_nodes - 1];
+    void*    left       = get_page(pager, left_num);
+    void*    right      = get_page(pager, right_num);
+
+    //move cells from the end of the left leaf while that brings the two closer in size
+    bool moved = false;
+    while(leaf_node_used_space(right) < loader->leaf_fill / 2){
+        uint32_t last   = *leaf_node_num_cells(left) - 1;
+        uint32_t size   = *leaf_node_payload_size(left, last);
+        uint32_t bytes  = leaf_node_cell_size(size) + LEAF_NODE_CELL_OVERHEAD;
+        if(last == 0 || leaf_node_used_space(right) + bytes > leaf_node_used_space(left) - bytes ||
+           !leaf_node_fits(right, size))
+            break;
+        leaf_node_insert_cell(right, 0, *leaf_node_key(left, last), size);
+        memcpy(leaf_node_value(right, 0), leaf_node_value(left, last), size);
+        leaf_node_remove_cell(left, last);
+        loader->node_counts[loader->num_nodes - 2]--;
+        loader->node_counts[loader->num_nodes - 1]++;
+        moved = true;
     }
+    if(!moved)
+        return;
 
-    //cache miss, allocate memory and read from file
-    if(pager->pages[page_num] == NULL){
-        void*       page        = malloc(PAGE_SIZE);
-        uint32_t    num_pages   = pager->file_length / PAGE_SIZE;
+    loader->node_keys[loader->num_nodes - 2] = *leaf_node_key(left, *leaf_node_num_cells(left) - 1);
+    pager_mark_dirty(pager, left_num);
+    pager_mark_dirty(pager, right_num);
+}
 
-        //in case of partial pages, add them in the end
-        if(pager->file_length % PAGE_SIZE){
-            num_pages += 1;
-        }
+/*
+*function to write the children node_pages[from, to) into an internal node
+*@param     loader      pointer to the bulk loader
+*@param     node        pointer to an initialized internal node
+*@param     from        first child
+*@param     to          one past the last child
+*@returns rows under the node
+*/
+uint32_t bulk_load_fill_internal_node(BulkLoader* loader, void* node, uint32_t from, uint32_t to){
+    uint32_t count = 0;
+    for(uint32_t i = from; i < to - 1; i++){
+        *internal_node_cell(node, i - from) = loader->node_pages[i];
+        *internal_node_key(node, i - from)  = loader->node_keys[i];
+    }
+    *internal_node_num_keys(node)       = to - from - 1;
+    *internal_node_right_child(node)    = loader->node_pages[to - 1];
+    for(uint32_t i = from; i < to; i++){
+        *internal_node_count(node, i - from) = loader->node_counts[i];
+        count += loader->node_counts[i];
+    }
+    return count;
+}
 
-        if(page_num <= num_pages){
-            //seek to page offset
-            lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
-            //read from file to memory
-            ssize_t bytes_read  = read(pager->file_descriptor, page, PAGE_SIZE);
+/*
+*function to finish a bulk load, builds the internal levels bottom-up
+*from the collected leaves and installs the top level in the root page
+*@param     loader      pointer to the bulk loader
+*/
+void bulk_load_finish(BulkLoader* loader){
+    Table*  table   = loader->table;
+    Pager*  pager   = table->pager;
+    void*   root;
 
-            if( bytes_read == -1){
-                printf("Error reading file: %d\n.", errno);
-                exit(EXIT_FAILURE);
-            }
-        }
+    bulk_load_balance_last_leaf(loader);
 
-        printf("adding-%d\n", page_num);
-        pager->pages[page_num] = page;
-        printf("page\n");
+    if(loader->num_nodes == 1){
+        root = get_page(pager, table->root_page_num);
+        //everything fits in one leaf, it becomes the root
+        memcpy(root, get_page(pager, loader->node_pages[0]), PAGE_SIZE);
+        set_node_root(root, true);
+        pager_mark_dirty(pager, table->root_page_num);
+        free_page(pager, loader->node_pages[0]);
+    }
 
-        if(page_num >= pager->num_pages)
-            pager->num_pages = page_num + 1;
+    //each pass replaces the nodes of one level by their parents, spread evenly
+    while(loader->num_nodes > INTERNAL_NODE_MAX_KEYS + 1){
+        uint32_t num_children   = loader->num_nodes;
+        uint32_t num_parents    = (num_children + loader->internal_fill - 1) / loader->internal_fill;
+        uint32_t from           = 0;
+        loader->num_nodes       = 0;
 
+        for(uint32_t i = 0; i < num_parents; i++){
+            uint32_t to         = from + num_children / num_parents + (i < num_children % num_parents);
+            uint32_t page_num   = get_unused_page_num(pager);
+            void*    node       = get_page(pager, page_num);
+            initialize_internal_node(node);
+            uint32_t count      = bulk_load_fill_internal_node(loader, node, from, to);
+            pager_mark_dirty(pager, page_num);
+            //the parents overwrite the entries of the children already consumed
+            uint32_t max_key    = loader->node_keys[to - 1];
+            loader->node_pages[loader->num_nodes]   = page_num;
+            loader->node_keys[loader->num_nodes]    = max_key;
+            loader->node_counts[loader->num_nodes]  = count;
+            loader->num_nodes++;
+            from = to;
+        }
+    }
+
+    if(loader->num_nodes > 1){
+        root = get_page(pager, table->root_page_num);
+        initialize_internal_node(root);
+        set_node_root(root, true);
+        bulk_load_fill_internal_node(loader, root, 0, loader->num_nodes);
+        pager_mark_dirty(pager, table->root_page_num);
     }
 
-    return pager->pages[page_num];
+    free(loader->node_pages);
+    free(loader->node_keys);
+    free(loader->node_counts);
 }
 
 /*
-*function to get the cursor at the end of the table
-*@param     table      pointer to the Table
-*@returns a pointer to the Cursor 
+*function to drop a bulk load that failed, the table is left unchanged
+*and the leaves written so far are released
+*@param     loader      pointer to the bulk loader
 */
-Cursor* table_end(Table* table){ //not used
-    Cursor* cursor = (Cursor*)malloc(sizeof(Cursor));
+void bulk_load_abort(BulkLoader* loader){
+    for(uint32_t i = 0; i < loader->num_nodes; i++)
+        free_page(loader->table->pager, loader->node_pages[i]);
+    free(loader->node_pages);
+    free(loader->node_keys);
+    free(loader->node_counts);
+}
+
+/*
+*function to bulk load a file of rows sorted by id, one "id username email" per line
+*@param     table           pointer to the empty table
+*@param     filename        name of the file to read
+*@param     fill_percent    how full to pack the nodes, 1-100
+*/
+void load_rows(Table* table, const char* filename, uint32_t fill_percent){
+    FILE* input = fopen(filename, "r");
+    if(input == NULL){
+        printf("Unable to open file '%s'.\n", filename);
+        return;
+    }
+
+    BulkLoader loader;
+    if(bulk_load_begin(table, fill_percent, &loader) != EXECUTE_SUCCESS){
+        printf("Error: Table must be empty to bulk load.\n");
+        fclose(input);
+        return;
+    }
 
-    cursor->table        = table;
-    cursor->page_num     = table->root_page_num;
+    char*       line        = NULL;
+    size_t      line_length = 0;
+    uint32_t    line_num    = 0;
+    Row         row;
+    while(getline(&line, &line_length, input) != -1){
+        line_num++;
+        line[strcspn(line, "\r\n")] = 0;
+        if(line[0] == 0)
+            continue;
 
-    void* root_node      = get_page(table->pager, table->root_page_num);
-    uint32_t num_cells   = *(leaf_node_num_cells(root_node));
+        if(prepare_row(line, &row) != PREPARE_SUCCESS){
+            printf("Error: Could not parse line %d.\n", line_num);
+            break;
+        }
+        if(bulk_load_add(&loader, &row) != EXECUTE_SUCCESS){
+            printf("Error: Line %d is not sorted by id.\n", line_num);
+            break;
+        }
+    }
 
-    cursor->cell_num     = num_cells;    
-    cursor->end_of_table = true;
+    if(feof(input)){
+        bulk_load_finish(&loader);
+        index_rebuild_all(table);
+        printf("Loaded %d rows.\n", loader.num_rows);
+    }
+    else
+        bulk_load_abort(&loader);
 
-    return cursor; 
+    free(line);
+    fclose(input);
 }
 
 /*
-*function to print the correct indentations
+*function to let the calling thread in as the single writer, waits for an open transaction of another thread
+*@param     table       pointer to the table
+*@param     exclusive   true to keep readers out as well, for commands that rework the whole file
 */
-void indent(uint32_t level){
-    for(uint32_t i = 0 ; i < level; i++)
-        printf("  ");
+void table_write_begin(Table* table, bool exclusive){
+    if(!table_in_transaction(table))
+        pthread_mutex_lock(&(table->write_lock));
+    //mapped pages are not versioned, the writer runs alone
+    if(exclusive || table->pager->mode == PAGER_MMAP)
+        pthread_rwlock_wrlock(&(table->lock));
+    else{
+        pthread_rwlock_rdlock(&(table->lock));
+        pager_hold_pages(table->pager);
+    }
 }
 
 /*
-*function to recursively print a node and its childrens
-*@param pager
-*@param page_num
-*@param indentation_level
+*function to end a write, outside a transaction it is committed and the next writer let in
+*@param     table       pointer to the table
 */
-void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level){
-    void* node = get_page(pager, page_num);
-    uint32_t num_keys, child;
-
-    switch(get_node_type(node)){
-        case NODE_LEAF:
-            num_keys = *(leaf_node_num_cells(node));
-            indent(indentation_level);
-            printf("- leaf %d\n", num_keys);
-            for(uint32_t i = 0; i < num_keys; i++){
-                indent(indentation_level+1);
-                printf("- %d\n", *leaf_node_key(node, i));
-            }
-            break;
-        case NODE_INTERNAL:
-            num_keys = *(internal_node_num_keys(node));
-            indent(indentation_level);
-            printf("- internal %d\n", num_keys);
-            for(uint32_t i = 0; i < num_keys; i++){
-                child = *internal_node_child(node, i);
-                print_tree(pager, child, indentation_level+1);
-                indent(indentation_level+1);
-                printf("- key %d\n", *internal_node_key(node, i));
-            }
-            child = *(internal_node_right_child(node));
-            print_tree(pager, child, indentation_level+1);
-            break;
+void table_write_end(Table* table){
+    if(table->pager->holding)
+        pager_release_pages(table->pager);
+    pthread_rwlock_unlock(&(table->lock));
+    if(!table_in_transaction(table)){
+        pager_commit(table->pager);
+        pthread_mutex_unlock(&(table->write_lock));
     }
 }
 
@@ -246,6 +4045,42 @@ MetaCmdResult do_meta_command(InputBuffer* input_buffer, Table* table){
         exit(EXIT_SUCCESS);
     }
 
+    else if(strcmp(input_buffer->buffer, ".checkpoint") == 0){
+        if(table_in_transaction(table))
+            printf("Error: Cannot checkpoint inside a transaction.\n");
+        else{
+            table_write_begin(table, true);
+            pager_checkpoint(table->pager);
+            table_write_end(table);
+        }
+        return META_SUCCESS;
+    }
+
+    //.vacuum [N], gives up to N free pages at the end of the file back, all when N is left out
+    else if(strcmp(input_buffer->buffer, ".vacuum") == 0 || strncmp(input_buffer->buffer, ".vacuum ", 8) == 0){
+        uint32_t max_pages = input_buffer->buffer[7] ? atoi(input_buffer->buffer + 8) : UINT32_MAX;
+        table_write_begin(table, true);
+        printf("Truncated %d pages.\n", pager_truncate(table->pager, max_pages));
+        table_write_end(table);
+        return META_SUCCESS;
+    }
+
+    //.stats [json | reset], counters since the start or the last reset and the shape of the tree
+    else if(strcmp(input_buffer->buffer, ".stats") == 0 || strcmp(input_buffer->buffer, ".stats json") == 0){
+        //counted before the walk over the tree adds its own page fetches
+        ThreadStats total;
+        TreeStats   tree;
+        stats_collect(&total);
+        table_tree_stats(table, &tree);
+        stats_print(&total, &tree, input_buffer->buffer[6] != '\0');
+        return META_SUCCESS;
+    }
+
+    else if(strcmp(input_buffer->buffer, ".stats reset") == 0){
+        stats_reset();
+        return META_SUCCESS;
+    }
+
     else if(strcmp(input_buffer->buffer, ".constants") == 0){
         print_constants();
         return META_SUCCESS;
@@ -253,7 +4088,24 @@ MetaCmdResult do_meta_command(InputBuffer* input_buffer, Table* table){
 
     else if(strcmp(input_buffer->buffer,".btree") == 0){
         //print_leaf_node(get_page(table->pager,0));
-        print_tree(table->pager, 0, 1);
+        pthread_rwlock_wrlock(&(table->lock));
+        print_tree(table->pager, table->root_page_num, 1);
+        pthread_rwlock_unlock(&(table->lock));
+        return META_SUCCESS;
+    }
+
+    //.load <file> [fill percent], bulk loads rows sorted by id
+    else if(strncmp(input_buffer->buffer, ".load ", 6) == 0){
+        char* filename  = strtok(input_buffer->buffer + 6, " ");
+        char* fill_str  = strtok(NULL, " ");
+        uint32_t fill   = fill_str ? atoi(fill_str) : BULK_LOAD_DEFAULT_FILL;
+        if(filename == NULL || fill < 1 || fill > 100){
+            printf("Usage: .load <file> [fill percent 1-100]\n");
+            return META_SUCCESS;
+        }
+        table_write_begin(table, true);
+        load_rows(table, filename, fill);
+        table_write_end(table);
         return META_SUCCESS;
     }
 
@@ -262,415 +4114,780 @@ MetaCmdResult do_meta_command(InputBuffer* input_buffer, Table* table){
 }
 
 /*
-*function for inserting a row
-*reads from input buffer and insert to the table
-*@param     source          source pointer of type Row
-*@param     destination     destination pointer of type void
+*function to set the default db options, buffered pager with the default pool size
+*@param     options     pointer to the options to fill
 */
-void serialize_row(Row* source, void* destination){
-    memcpy((destination + ID_OFFSET), &(source->id), ID_SIZE);
-    memcpy((destination + USERNAME_OFFSET), &(source->username),USERNAME_SIZE);
-    memcpy((destination + EMAIL_OFFSET), &(source->email), EMAIL_SIZE);
-    //if the enteres string is smaller than the size, then fill the remaining slots as NULL
-//    strncpy((destination + USERNAME_OFFSET), source->username, USERNAME_SIZE);
-//    strncpy((destination + EMAIL_OFFSET), source->email, EMAIL_SIZE);
+void init_db_options(DbOptions* options){
+    options->pager_mode     = PAGER_BUFFERED;
+    options->num_frames     = PAGER_DEFAULT_FRAMES;
+    options->use_wal        = true;
+    options->use_io_uring   = true;
+    options->writeback_rate = WRITEBACK_DEFAULT_RATE;
 }
 
 /*
-*function for read a row
-*read from the table and store it in a Row 
-*@param     source          source pointer of type void
-*@param     destination     destination pointer of type Row
+*function to allocate the pages of all frames as one slab, from the huge page pool if it has
+*room, else aligned to a huge page and advised so the kernel can back it with transparent huge pages
+*@param     pager       pointer to the pager, its frames already allocated
 */
-void deserialize_row(void* source, Row* destination){
-    memcpy(&(destination->id), source + ID_OFFSET, ID_SIZE);
-    memcpy(&(destination->username), source + USERNAME_OFFSET, USERNAME_SIZE);
-    memcpy(&(destination->email),source + EMAIL_OFFSET, EMAIL_SIZE);
-}
+void pager_open_frame_slab(Pager* pager){
+    size_t length   = (size_t)pager->num_frames * PAGE_SIZE;
+    length          = (length + PAGER_SLAB_ALIGNMENT - 1) & ~(size_t)(PAGER_SLAB_ALIGNMENT - 1);
+    void*  slab     = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
 
-/*
-*function to get the value of the node pointed by the cursor
-*@param     cursor      pointer to the cursor
-*@returns a pointer to node value
-*/
-void* cursor_value(Cursor* cursor){
-    void * page = get_page(cursor->table->pager, cursor->page_num);
-    return leaf_node_value(page, cursor->cell_num);
+    pager->frame_slab_hugetlb = (slab != MAP_FAILED);
+    if(slab == MAP_FAILED){
+        if(posix_memalign(&slab, PAGER_SLAB_ALIGNMENT, length) != 0){
+            printf("Unable to allocate %zu bytes for the buffer pool.\n", length);
+            exit(EXIT_FAILURE);
+        }
+        //a hint only, kernels without transparent huge pages use normal pages
+        madvise(slab, length, MADV_HUGEPAGE);
+    }
+    pager->frame_slab           = (char*)slab;
+    pager->frame_slab_length    = length;
+    for(uint32_t i = 0; i < pager->num_frames; i++)
+        pager->frames[i].data = pager->frame_slab + (size_t)i * PAGE_SIZE;
 }
 
 /*
-*function to advance the cursor to the next row
-*@param     cursor      pointer to the cursor to be advanced
+*function to open the pager, opens the file passed, initialize the page handle & pages
+*@param     filename    name of the file to be opened
+*@param     options     pointer to the options, pager mode and buffer pool size
+*@returns a pointer to the pager with file handles and the pages
 */
-void advance_cursor(Cursor* cursor){
+Pager* open_pager(const char* filename, DbOptions* options){
+
+    //if file exists open it in read/write mode else create the file
+    int fd = open(filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+
+    if(fd == -1){//failed to open/create file
+        printf("Unable to open file\n.");
+        exit(EXIT_FAILURE);
+    }
+
+    off_t file_length = lseek(fd,0,SEEK_END);//find the length of the file
     
-    void* node = get_page(cursor->table->pager, cursor->page_num);
-    cursor->cell_num += 1;
+    Pager* pager    = (Pager*)malloc(sizeof(Pager));
+    pager->file_descriptor  = fd;
+    pager->file_length      = file_length;
+    pager->num_pages        = file_length/PAGE_SIZE;
 
-    if(cursor->cell_num >= *(leaf_node_num_cells(node))){
-        uint32_t next_page_num = *leaf_node_next_leaf(node);
-        if(next_page_num == 0)
-            cursor->end_of_table = true;
-        else{
-            cursor->page_num = next_page_num;
-            cursor->cell_num = 0;
+    if(file_length % PAGE_SIZE != 0){
+        printf("Number of pages in the db is not a whole number.\n Corrupt file.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pager->mode             = options->pager_mode;
+    pager->map              = NULL;
+    pager->map_length       = 0;
+    pager->wal              = NULL;
+    pager->io               = NULL;
+    pager->frame_slab       = NULL;
+    pager->frame_slab_hugetlb = false;
+    pager->unlogged_pages   = NULL;
+    pager->num_unlogged_pages = 0;
+    pager->unlogged_capacity  = 0;
+    pager->txn_frames       = 0;
+    pager->background_checkpoints = false;
+    pager->holding          = false;
+    pager->held_pages       = NULL;
+    pager->num_held_pages   = 0;
+    pager->held_capacity    = 0;
+    pager->commit_num       = 0;
+    pager->private_pages    = NULL;
+    pager->num_private_pages = 0;
+    pager->private_capacity = 0;
+    pager->versions_fd      = -1;
+    pager->stored_versions  = NULL;
+    pager->num_stored_versions = 0;
+    pager->stored_capacity  = 0;
+    pager->free_slots       = NULL;
+    pager->num_free_slots   = 0;
+    pager->num_slots        = 0;
+    pager->slots_capacity   = 0;
+    pager->old_versions     = NULL;
+    pager->num_old_versions = 0;
+    pager->snapshots        = NULL;
+    pager->num_snapshots    = 0;
+    pager->snapshots_capacity = 0;
+    pager->num_waiting_snapshots = 0;
+    pager->frame_waits      = 0;
+
+    //recursive, pager functions call each other with the lock held, e.g. a fetch marking a new page dirty
+    pthread_mutexattr_t lock_attr;
+    pthread_mutexattr_init(&lock_attr);
+    pthread_mutexattr_settype(&lock_attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&(pager->lock), &lock_attr);
+    pthread_mutexattr_destroy(&lock_attr);
+    pthread_cond_init(&(pager->versions_released), NULL);
+
+    //mmap mode, reserve the address range once and map the file into its start
+    if(pager->mode == PAGER_MMAP){
+        void* map = mmap(NULL, MMAP_MAX_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(map == MAP_FAILED){
+            printf("Unable to reserve address space for the mapping: %d\n", errno);
+            exit(EXIT_FAILURE);
         }
+        pager->map          = (char*)map;
+        pager->num_frames   = 0;
+        pager->frames       = NULL;
+        pager->page_table   = NULL;
+        if(pager->num_pages > 0)
+            pager_mmap_grow(pager, pager->num_pages - 1);
+        return pager;
     }
-}
 
-/*
-*function to print data from a row
-*@param     row     pointer to row to be printed
-*/
-void print_row(Row* row){
-    if(row == NULL)
-        printf("Error: Empty Row.\n");
-    else
-        printf("{ %d %s %s }\n", row->id, row->username, row->email);
+    //the btree holds a few page pointers at a time, keep enough frames for them
+    uint32_t num_frames = options->num_frames;
+    if(num_frames < PAGER_MIN_FRAMES)
+        num_frames = PAGER_MIN_FRAMES;
+
+    pager->num_frames       = num_frames;
+    pager->num_used_frames  = 0;
+    pager->frames           = (Frame*)calloc(num_frames, sizeof(Frame));
+    pager_open_frame_slab(pager);
+    pager->page_table_size  = num_frames * 2;
+    pager->page_table       = (int32_t*)malloc(pager->page_table_size * sizeof(int32_t));
+    pager->lru_head         = -1;
+    pager->lru_tail         = -1;
+
+    for(uint32_t i = 0; i < pager->page_table_size; i++)
+        pager->page_table[i] = -1;
+
+    //checkpoints and close write their pages in batches
+    pager->io = page_io_open(options->use_io_uring);
+
+    //frames of replaced versions are all that can pile up, the list never outgrows the pool
+    pager->old_versions     = (int32_t*)malloc(num_frames * sizeof(int32_t));
+
+    //old versions evicted for want of frames go to a scratch file, unlinked so it goes with the process
+    char* versions_name = (char*)malloc(strlen(filename) + 10);
+    sprintf(versions_name, "%s-versions", filename);
+    pager->versions_fd  = open(versions_name, O_RDWR | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+    if(pager->versions_fd == -1){
+        printf("Unable to open the version store.\n");
+        exit(EXIT_FAILURE);
+    }
+    unlink(versions_name);
+    free(versions_name);
+    return pager;
 }
 
 /*
-*until recycling of the free pages is implemented, new pages will be added to the end of the db file
-*@param pager   pointer to pager
-*@returns next page number
+*function to write a fresh db header page with an empty free list and commit it
+*@param     pager           pointer to Pager
+*@param     root_page_num   page number of the table's root node
 */
-uint32_t get_unused_page_num(Pager* pager){
-    return pager->num_pages;
+void initialize_db_header(Pager* pager, uint32_t root_page_num){
+    void* header = get_page(pager, DB_HEADER_PAGE_NUM);
+    memset(header, 0, PAGE_SIZE);
+    *db_header_magic(header)            = DB_HEADER_MAGIC;
+    *db_header_root_page(header)        = root_page_num;
+    *db_header_freelist_trunk(header)   = 0;
+    *db_header_freelist_count(header)   = 0;
+    *db_header_format(header)           = DB_FORMAT_VERSION;
+    pager_mark_dirty(pager, DB_HEADER_PAGE_NUM);
+    pager_commit(pager);
 }
 
 /*
-*we have already allocated the rigth child, 
-*this function takes the rigth child as input 
-*and allocates a new page to store the left child
-*@param table                   pointer to table
-*@param right_child_page_num    right child page number
+*function to rewrite the nodes of a format 0 tree in the format 3 layout, upgraded further by upgrade_subtree_counts,
+*leaves held fixed size rows and internal nodes interleaved children and keys,
+*every node fits again in its own page so each one is rewritten in place
+*@param     pager           pointer to Pager
+*@param     root_page_num   page number of the table's root node
 */
-void create_new_root(Table* table, uint32_t right_child_page_num){
-    /*
-    *Splitting the root is handled by
-    *old root is copied to the new page, becomes the left child
-    *address of the rigth child is passed in 
-    *reinitialize the root page to contain the new root node
-    *new root node points to two children 
-    */
-   void* root                   = get_page(table->pager, table->root_page_num);
-   void* right_child            = get_page(table->pager, right_child_page_num);
-   uint32_t left_child_page_num = get_unused_page_num(table->pager);
-   void* left_child             = get_page(table->pager, left_child_page_num); 
+void upgrade_fixed_rows(Pager* pager, uint32_t root_page_num){
+    char        copy[PAGE_SIZE];
+    uint32_t    capacity    = 64;
+    uint32_t    num_pending = 1;
+    uint32_t*   pending     = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    pending[0]              = root_page_num;
 
-    //copy old node as left child
-    memcpy(left_child, root, PAGE_SIZE);
-    set_node_root(left_child, false);
+    while(num_pending > 0){
+        uint32_t page_num   = pending[--num_pending];
+        void*    node       = get_page(pager, page_num);
+        memcpy(copy, node, PAGE_SIZE);
+        pager_mark_dirty(pager, page_num);
 
-    //root node is new internal node with one key and two children
-    initialize_internal_node(root);
-    set_node_root(root, true);
-    *(internal_node_num_keys(root))    = 1;
-    *(internal_node_child(root, 0))    = left_child_page_num;
-    *(internal_node_key(root, 0))      = get_node_max_key(left_child);
-    *(internal_node_right_child(root)) = right_child_page_num; 
+        if(get_node_type(node) == NODE_INTERNAL){
+            uint32_t num_keys = *internal_node_num_keys(node);
+            if(num_pending + num_keys + 1 > capacity){
+                capacity    = (num_pending + num_keys + 1) * 2;
+                pending     = (uint32_t*)realloc(pending, capacity * sizeof(uint32_t));
+            }
+            for(uint32_t i = 0; i < num_keys; i++){
+                uint32_t* cell = (uint32_t*)(copy + FIXED_INTERNAL_NODE_HEADER_SIZE + i * FIXED_INTERNAL_NODE_CELL_SIZE);
+                *uncounted_internal_node_child(node, i) = cell[0];
+                *internal_node_key(node, i)             = cell[1];
+                pending[num_pending++]          = cell[0];
+            }
+            pending[num_pending++] = *internal_node_right_child(node);
+            continue;
+        }
+
+        uint32_t num_cells              = *leaf_node_num_cells(node);
+        *leaf_node_num_cells(node)      = 0;
+        *leaf_node_content_start(node)  = PAGE_SIZE;
+        *leaf_node_fragmented(node)     = 0;
+        for(uint32_t i = 0; i < num_cells; i++){
+            uint8_t*    cell = (uint8_t*)copy + FIXED_LEAF_NODE_HEADER_SIZE + i * FIXED_LEAF_NODE_CELL_SIZE;
+            uint8_t*    row  = cell + sizeof(uint32_t);
+            Row         value;
+            memcpy(&(value.id), row + ID_OFFSET, ID_SIZE);
+            memcpy(value.username, row + USERNAME_OFFSET, USERNAME_SIZE);
+            memcpy(value.email, row + EMAIL_OFFSET, EMAIL_SIZE);
+            value.username[COLUMN_USERNAME_SIZE]    = '\0';
+            value.email[COLUMN_EMAIL_SIZE]          = '\0';
+
+            leaf_node_insert_cell(node, i, *(uint32_t*)cell, row_payload_size(&value));
+            serialize_row(&value, leaf_node_value(node, i));
+        }
+    }
+    free(pending);
 }
 
 /*
-*Create a new node and move half of the cells over,
-*Insert the new value to one of the two nodes,
-*update parent or create a new parent
-*@param cursor      cursor pointing to the position where the new node to be inserted
-*@param key         key of the new node to be inserted
-*@param value       pointert to the value to be inserted
+*function to give the tree of a format 3 file the counts of rows under each child,
+*a node with counts holds fewer keys so the internal nodes are rebuilt bottom-up
+*over the leaves, which stay where they are
+*@param     table       pointer to the table
 */
-void leaf_node_split_and_insert(Cursor* cursor, uint32_t key, Row* value){
+void upgrade_subtree_counts(Table* table){
+    Pager*  pager   = table->pager;
+    void*   node    = get_page(pager, table->root_page_num);
+    if(get_node_type(node) == NODE_LEAF)
+        return;
 
-    void* old_node          = get_page(cursor->table->pager, cursor->page_num);
-    uint32_t new_page_num   = get_unused_page_num(cursor->table->pager);
-    void* new_node          = get_page(cursor->table->pager, new_page_num);
-    initialize_leaf_node(new_node);
+    //the leftmost path leads to the first leaf
+    uint32_t first_leaf = table->root_page_num;
+    while(get_node_type(node) == NODE_INTERNAL){
+        first_leaf  = *uncounted_internal_node_child(node, 0);
+        node        = get_page(pager, first_leaf);
+    }
 
-    //the old leafs sibling becomes the new leaf 
-    //and the new leaf's sibling becomes whatever used to be the old leaf's sibling
-    *leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
-    *leaf_node_next_leaf(old_node) = new_page_num;
+    //free the internal nodes below the root, their children are read before the page can be reused
+    uint32_t    capacity    = 64;
+    uint32_t    num_pending = 1;
+    uint32_t*   pending     = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    pending[0]              = table->root_page_num;
+    while(num_pending > 0){
+        uint32_t page_num   = pending[--num_pending];
+        node                = get_page(pager, page_num);
+        uint32_t num_keys   = *internal_node_num_keys(node);
+        if(num_pending + num_keys + 1 > capacity){
+            capacity    = (num_pending + num_keys + 1) * 2;
+            pending     = (uint32_t*)realloc(pending, capacity * sizeof(uint32_t));
+        }
+        for(uint32_t i = 0; i <= num_keys; i++){
+            uint32_t child = *uncounted_internal_node_child(node, i);
+            if(get_node_type(get_page(pager, child)) == NODE_INTERNAL)
+                pending[num_pending++] = child;
+            node = get_page(pager, page_num);
+        }
+        if(page_num != table->root_page_num)
+            free_page(pager, page_num);
+    }
+    free(pending);
 
-    /*
-    *All exisiting keys + new key should be 
-    *divided evenly between old (left) and the new(right) nodes.
-    * starting from the right, move each key to correct position. 
-    */
-    for(int32_t i =LEAF_NODE_MAX_CELLS; i >= 0; i--){
-        void* destination_node;
-        if(i >= LEAF_NODE_LEFT_SPLIT_COUNT)
-            destination_node = new_node;
-        else
-            destination_node = old_node;
+    //the leaf chain gives the leaves in key order, the levels above are built like a bulk load's
+    BulkLoader loader;
+    bulk_load_init(&loader, table, BULK_LOAD_DEFAULT_FILL);
+    for(uint32_t page_num = first_leaf; page_num != 0; page_num = *leaf_node_next_leaf(node)){
+        node = get_page(pager, page_num);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        bulk_load_push_node(&loader, page_num, *leaf_node_key(node, num_cells - 1), num_cells);
+    }
+    bulk_load_finish(&loader);
+}
+
+/*
+*function to open the db
+*@param     filename    name of the db file
+*@param     options     pointer to the options, pager mode and buffer pool size
+*@returns pointer to the table 
+*/
+Table* open_db(const char* filename, DbOptions* options){
+    Pager*      pager    = open_pager(filename, options);
+    Table*      table    = (Table*)malloc(sizeof(Table));
+    bool        count_subtrees = false;
+    table->pager         = pager;
+    table->in_transaction = false;
+    table->writeback     = NULL;
+    pthread_mutex_init(&(table->write_lock), NULL);
+    for(uint32_t column = 0; column < NUM_COLUMNS; column++)
+        table->indexes[column] = NULL;
 
-        uint32_t index_within_node = i % LEAF_NODE_LEFT_SPLIT_COUNT;
-        void* destination = leaf_node_cell(destination_node, index_within_node);
+    //writer preferring, selects arriving back to back would otherwise keep out a writer that needs it exclusively
+    pthread_rwlockattr_t lock_attr;
+    pthread_rwlockattr_init(&lock_attr);
+    pthread_rwlockattr_setkind_np(&lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&(table->lock), &lock_attr);
+    pthread_rwlockattr_destroy(&lock_attr);
 
-        if(i == cursor->cell_num){
-            serialize_row(value, leaf_node_value(destination_node, index_within_node));
-            *leaf_node_key(destination_node, index_within_node) = key;
+    //the log works on buffer pool frames, a mapped file is only synced at checkpoints,
+    //a log left by a run with the log on is still recovered when it is turned off
+    if(pager->mode == PAGER_BUFFERED && (options->use_wal || wal_exists(filename))){
+        pager->wal = wal_open(filename);
+        uint32_t num_pages = wal_recover(pager->wal);
+        if(num_pages != 0)
+            pager->num_pages = num_pages;
+        //copy what a previous run committed into the db file and start an empty log
+        pager_checkpoint(pager);
+        if(!options->use_wal){
+            wal_close(pager->wal);
+            pager->wal = NULL;
         }
-        else if(i > cursor->cell_num)
-            memcpy(destination, leaf_node_cell(old_node, i-1), LEAF_NODE_CELL_SIZE);
-        else
-            memcpy(destination, leaf_node_cell(old_node, i), LEAF_NODE_CELL_SIZE);
     }
-    //update the cell count on left and rigth child nodes
-    *(leaf_node_num_cells(old_node)) = LEAF_NODE_LEFT_SPLIT_COUNT;
-    *(leaf_node_num_cells(new_node)) = LEAF_NODE_RIGHT_SPLIT_COUNT;
 
-    //update the parent node, if the parent was a root node, create a new root node
-    if(is_root_node(old_node))
-        return create_new_root(cursor->table, new_page_num);
-    else{
-        printf("Need to implement updating parent after split\n");
+    if(pager->num_pages == 0){
+        //new db file, page 0 is the db header and page 1 the root leaf node
+        void* root_node = get_page(pager, 1);
+        initialize_leaf_node(root_node);
+        set_node_root(root_node, true);
+        pager_mark_dirty(pager, 1);
+        initialize_db_header(pager, 1);
+    }
+    else if(*db_header_magic(get_page(pager, DB_HEADER_PAGE_NUM)) != DB_HEADER_MAGIC){
+        //file from before the header page, the root in page 0 moves behind the header
+        uint32_t root_page_num  = pager->num_pages;
+        void*    root_node      = get_page(pager, root_page_num);
+        memcpy(root_node, get_page(pager, DB_HEADER_PAGE_NUM), PAGE_SIZE);
+        pager_mark_dirty(pager, root_page_num);
+        upgrade_fixed_rows(pager, root_page_num);
+        initialize_db_header(pager, root_page_num);
+        count_subtrees = true;
+    }
+    else if(*db_header_format(get_page(pager, DB_HEADER_PAGE_NUM)) == DB_FORMAT_FIXED_ROWS){
+        upgrade_fixed_rows(pager, *db_header_root_page(get_page(pager, DB_HEADER_PAGE_NUM)));
+        count_subtrees = true;
+    }
+    //the index roots after the format field are zero in a format 2 file
+    else if(*db_header_format(get_page(pager, DB_HEADER_PAGE_NUM)) == DB_FORMAT_NO_INDEXES ||
+            *db_header_format(get_page(pager, DB_HEADER_PAGE_NUM)) == DB_FORMAT_NO_COUNTS)
+        count_subtrees = true;
+    else if(*db_header_format(get_page(pager, DB_HEADER_PAGE_NUM)) != DB_FORMAT_VERSION){
+        printf("Unsupported db file format %d.\n", *db_header_format(get_page(pager, DB_HEADER_PAGE_NUM)));
         exit(EXIT_FAILURE);
     }
 
+    table->root_page_num = *db_header_root_page(get_page(pager, DB_HEADER_PAGE_NUM));
+    if(count_subtrees){
+        upgrade_subtree_counts(table);
+        *db_header_format(get_page(pager, DB_HEADER_PAGE_NUM)) = DB_FORMAT_VERSION;
+        pager_mark_dirty(pager, DB_HEADER_PAGE_NUM);
+        pager_commit(pager);
+    }
+    for(uint32_t column = COLUMN_USERNAME; column < NUM_COLUMNS; column++){
+        uint32_t index_root_page_num = *db_header_index_root(get_page(pager, DB_HEADER_PAGE_NUM), (Column)column);
+        if(index_root_page_num != 0)
+            table->indexes[column] = index_open((Column)column, index_root_page_num);
+    }
+    pager->committed_num_pages = pager->num_pages;
+    //mapped pages are written back by the kernel
+    if(pager->mode == PAGER_BUFFERED && options->writeback_rate > 0)
+        writeback_start(table, options->writeback_rate);
+    return table; 
 }
 
 /*
-*insert a row based on the key
-*@param cursor  pointer the the cursor
-*@param key     key to be inserted
-*@param value   value of type Row to be inserted
+*function to store an integer into the field of a statement a value or a placeholder stands for
+*@param     statement   pointer to the statement
+*@param     target      field the value is for
+*@param     key_num     element of the in list a PARAM_KEY_IN is for
+*@param     value       the value
+*returns an enum of type PrepareResult
 */
-void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value){
-    void* node = get_page(cursor->table->pager, cursor->page_num);
-    uint32_t num_cells = *(leaf_node_num_cells(node));
-
-    //check if the node is already having max cells
-    if(num_cells >= LEAF_NODE_MAX_CELLS){
-        //Node full
-//        printf("Need to implement splitting a leaf node.\n");
-//        exit(EXIT_FAILURE);
-        leaf_node_split_and_insert(cursor, key, value);
-        return;
+PrepareResult statement_set_int(Statement* statement, ParamTarget target, uint32_t key_num, int64_t value){
+    if(target == PARAM_ROW_USERNAME || target == PARAM_ROW_EMAIL || target == PARAM_MATCH || target == PARAM_MATCH_PREFIX)
+        return PREPARE_BAD_PARAMETER;
+    if(value < 0)
+        return PREPARE_NEGATIVE_ID;
+    if(value > UINT32_MAX && target != PARAM_LIMIT && target != PARAM_OFFSET)
+        return PREPARE_ID_OUT_OF_RANGE;
+
+    uint32_t id = (uint32_t)value;
+    switch(target){
+        case PARAM_ROW_ID:
+            statement->row_to_insert.id = id;
+            break;
+        case PARAM_KEY:
+            statement->key = id;
+            break;
+        case PARAM_KEY_LO:
+            statement->key_lo = id;
+            break;
+        case PARAM_KEY_HI:
+            statement->key_hi = id;
+            break;
+        //an empty range is kept as lo > hi
+        case PARAM_KEY_ABOVE:
+            statement->key_lo = (id == UINT32_MAX) ? 1 : id + 1;
+            statement->key_hi = (id == UINT32_MAX) ? 0 : UINT32_MAX;
+            break;
+        case PARAM_KEY_BELOW:
+            statement->key_lo = (id == 0) ? 1 : 0;
+            statement->key_hi = (id == 0) ? 0 : id - 1;
+            break;
+        case PARAM_KEY_EQUAL:
+            statement->key_lo = id;
+            statement->key_hi = id;
+            break;
+        case PARAM_KEY_IN:
+            statement->keys[key_num] = id;
+            break;
+        //a limit or offset past the largest count is as good as the largest
+        case PARAM_LIMIT:
+            statement->limit = (value > UINT32_MAX) ? UINT32_MAX : id;
+            break;
+        case PARAM_OFFSET:
+            statement->offset = (value > UINT32_MAX) ? UINT32_MAX : id;
+            break;
+        default:
+            return PREPARE_BAD_PARAMETER;
     }
+    return PREPARE_SUCCESS;
+}
 
-    //check if the cell num is less than the number of cells in the node
-    //if yes shift the cells to right by leaf node size
-    if(cursor->cell_num < num_cells){
-        for(uint32_t i=num_cells; i > cursor->cell_num; i--){
-            memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i-1), LEAF_NODE_CELL_SIZE);
+/*
+*function to store a string into the field of a statement a value or a placeholder stands for
+*@param     statement   pointer to the statement
+*@param     target      field the value is for
+*@param     value       the string
+*returns an enum of type PrepareResult
+*/
+PrepareResult statement_set_text(Statement* statement, ParamTarget target, const char* value){
+    if(target == PARAM_ROW_USERNAME){
+        if(strlen(value) > COLUMN_USERNAME_SIZE) return PREPARE_STRING_TOO_LONG;
+        strcpy(statement->row_to_insert.username, value);
+        return PREPARE_SUCCESS;
+    }
+    if(target == PARAM_ROW_EMAIL){
+        if(strlen(value) > COLUMN_EMAIL_SIZE) return PREPARE_STRING_TOO_LONG;
+        strcpy(statement->row_to_insert.email, value);
+        return PREPARE_SUCCESS;
+    }
+    if(target == PARAM_MATCH || target == PARAM_MATCH_PREFIX){
+        size_t length = strlen(value);
+        //only prefix patterns, a single % ending the value
+        if(target == PARAM_MATCH_PREFIX){
+            if(length == 0 || value[length - 1] != '%')
+                return PREPARE_SYNTAX_ERROR;
+            length--;
         }
+        if(length > ((statement->match_column == COLUMN_USERNAME) ? COLUMN_USERNAME_SIZE : COLUMN_EMAIL_SIZE))
+            return PREPARE_STRING_TOO_LONG;
+        memcpy(statement->match, value, length);
+        statement->match[length] = '\0';
+        return PREPARE_SUCCESS;
     }
+    return PREPARE_BAD_PARAMETER;
+}
 
-    //increment the number of cells for the node
-    *(leaf_node_num_cells(node)) += 1;
-    //set the key for the cell
-    *(leaf_node_key(node, cursor->cell_num)) = key;
+/*
+*function to parse a value of a statement, a ? is recorded as a placeholder to bind later
+*@param     text        token holding the value
+*@param     statement   pointer to the statement to fill
+*@param     target      field the value is for
+*returns an enum of type PrepareResult
+*/
+PrepareResult prepare_value(char* text, Statement* statement, ParamTarget target){
+    if(text == NULL)
+        return PREPARE_SYNTAX_ERROR;
 
-    serialize_row(value, leaf_node_value(node, cursor->cell_num));
+    if(strcmp(text, "?") == 0){
+        statement->params[statement->num_params].target  = target;
+        statement->params[statement->num_params].key_num = statement->num_keys;
+        statement->params[statement->num_params].bound   = false;
+        statement->num_params++;
+        return PREPARE_SUCCESS;
+    }
 
+    if(target == PARAM_ROW_USERNAME || target == PARAM_ROW_EMAIL || target == PARAM_MATCH || target == PARAM_MATCH_PREFIX)
+        return statement_set_text(statement, target, text);
+    int64_t value;
+    if(!parse_int(text, &value))
+        return PREPARE_SYNTAX_ERROR;
+    return statement_set_int(statement, target, statement->num_keys, value);
 }
 
 /*
-*function to find the position of the key or the position of the key to be moved or the one past the last key
-*@param table       pointer to the table
-*@param page_num    page number of the page to search
-*@param key         key to be find
+*function to parse the name of a text column
+*@param     text        the name
+*@param     column      set to the column
+*returns an enum of type PrepareResult
 */
-Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key){
-    
-    printf("in leaf node find\n");
-    void* node          = get_page(table->pager, page_num);
-    uint32_t num_cells  = *(leaf_node_num_cells(node));
-
-    Cursor* cursor      = (Cursor*)malloc(sizeof(Cursor));
-    cursor->table       = table;
-    cursor->page_num    = page_num;
+PrepareResult prepare_column(char* text, Column* column){
+    if(text != NULL && strcmp(text, "username") == 0)
+        *column = COLUMN_USERNAME;
+    else if(text != NULL && strcmp(text, "email") == 0)
+        *column = COLUMN_EMAIL;
+    else
+        return PREPARE_SYNTAX_ERROR;
+    return PREPARE_SUCCESS;
+}
 
-    uint32_t min        = 0;
-    uint32_t max        = num_cells;
-    //binary search
-    while(min != max){
-        uint32_t index          = (min + max)/2;
-        uint32_t key_at_index   = *(leaf_node_key(node, index));
+/*
+*function to parse the ids of "where id in (A, B, ...)", after the word in, the parentheses and commas
+*can have spaces around them or not
+*@param     statement   pointer to the statement to fill
+*returns an enum of type PrepareResult
+*/
+PrepareResult prepare_key_list(Statement* statement){
+    char* token = strtok(NULL, " ,");
+    if(token == NULL || token[0] != '(')
+        return PREPARE_SYNTAX_ERROR;
+    token++;
 
-        if(key_at_index == key){
-            cursor->cell_num = index;
-            return cursor;
+    while(true){
+        size_t  length  = strlen(token);
+        bool    closed  = (length > 0 && token[length - 1] == ')');
+        if(closed)
+            token[length - 1] = '\0';
+        if(token[0] != '\0'){
+            if(statement->num_keys == STATEMENT_MAX_KEYS)
+                return PREPARE_TOO_MANY_KEYS;
+            PrepareResult result = prepare_value(token, statement, PARAM_KEY_IN);
+            if(result != PREPARE_SUCCESS)
+                return result;
+            statement->num_keys++;
         }
-        else if(key_at_index < key)
-            max = index;
-        else
-            min = index + 1; 
-//        printf("stuck");
+        if(closed)
+            break;
+        token = strtok(NULL, " ,");
+        if(token == NULL)
+            return PREPARE_SYNTAX_ERROR;
     }
-
-    cursor->cell_num = min;
-    return cursor;
+    return (statement->num_keys == 0) ? PREPARE_SYNTAX_ERROR : PREPARE_SUCCESS;
 }
+
 /*
-*function to search the internal nodes and find a position for insertion
-*@param table       pointer to table
-*@param page_num    page number of the page to search
-*@param key         key to search
+*function to parse the where clause of a select into the range of ids or the value to select, after the word where
+*"id = A", "id in (A, B, ...)", "id between A and B", "id >= A", "id > A", "id <= B", "id < B",
+*"username = A", "email like A%" and the same for the other text column
+*@param     statement   pointer to the statement to fill
+*returns an enum of type PrepareResult
 */
-Cursor* internal_node_find(Table* table, uint32_t page_num, uint32_t key){
-    printf("in internal node find\n");
-    void*       node          = get_page(table->pager, page_num);
-    uint32_t    num_keys      = *internal_node_num_keys(node);
-    uint32_t    min           = 0;
-    uint32_t    max           = num_keys;   
-    //binary search
-    while(min != max){
-        uint32_t index = (min + max)/2;
-        uint32_t key_at_index = *internal_node_key(node, index);
-        if(key_at_index >= key)
-            max = index;
+PrepareResult prepare_where(Statement* statement){
+    char* column = strtok(NULL, " ");
+    char* op     = strtok(NULL, " ");
+    if(column == NULL || op == NULL)
+        return PREPARE_SYNTAX_ERROR;
+
+    PrepareResult result;
+    if(strcmp(column, "id") != 0){
+        result = prepare_column(column, &(statement->match_column));
+        if(result != PREPARE_SUCCESS)
+            return result;
+        statement->match_prefix = (strcmp(op, "like") == 0);
+        if(strcmp(op, "=") == 0)
+            result = prepare_value(strtok(NULL, " "), statement, PARAM_MATCH);
+        else if(statement->match_prefix)
+            result = prepare_value(strtok(NULL, " "), statement, PARAM_MATCH_PREFIX);
         else
-            min = index + 1;
+            return PREPARE_SYNTAX_ERROR;
     }
-
-    uint32_t child_num = *internal_node_child(node, min);
-    void*    child     = get_page(table->pager, child_num);
-    //node can have either left or right child or more internal nodes
-    switch(get_node_type(child)){
-        case NODE_LEAF:
-            return leaf_node_find(table, child_num, key);
-        case NODE_INTERNAL:
-            return internal_node_find(table, child_num, key);
+    else if(strcmp(op, "between") == 0){
+        result = prepare_value(strtok(NULL, " "), statement, PARAM_KEY_LO);
+        if(result != PREPARE_SUCCESS)
+            return result;
+        char* and_word = strtok(NULL, " ");
+        if(and_word == NULL || strcmp(and_word, "and") != 0)
+            return PREPARE_SYNTAX_ERROR;
+        result = prepare_value(strtok(NULL, " "), statement, PARAM_KEY_HI);
     }
-}
-/*
-*function to find the position to insert a node
-*@param table   pointer to the table
-*@key   key     key to be inserted
-*@returns the positions of the key passed, if key not present returns the position where it should be inserted.
-*/
-Cursor* table_find(Table* table, uint32_t key){
-    uint32_t root_page_num = table->root_page_num;
-    void* root_node = get_page(table->pager, root_page_num);
-    printf("get page in table find\n");
-    if(get_node_type(root_node) == NODE_LEAF)
-        return leaf_node_find(table, root_page_num, key);
+    else if(strcmp(op, "=") == 0)
+        result = prepare_value(strtok(NULL, " "), statement, PARAM_KEY_EQUAL);
+    else if(strcmp(op, "in") == 0)
+        result = prepare_key_list(statement);
+    else if(strcmp(op, ">=") == 0)
+        result = prepare_value(strtok(NULL, " "), statement, PARAM_KEY_LO);
+    else if(strcmp(op, "<=") == 0)
+        result = prepare_value(strtok(NULL, " "), statement, PARAM_KEY_HI);
+    else if(strcmp(op, ">") == 0)
+        result = prepare_value(strtok(NULL, " "), statement, PARAM_KEY_ABOVE);
+    else if(strcmp(op, "<") == 0)
+        result = prepare_value(strtok(NULL, " "), statement, PARAM_KEY_BELOW);
     else
-        return internal_node_find(table, root_page_num, key);
+        return PREPARE_SYNTAX_ERROR;
+    return result;
 }
 
 /*
-*function to get the cursor at the start of the table
-*@param     table      pointer to the Table
-*@returns a pointer to the Cursor 
+*function to parse what an aggregate works on, id or the length of a text column, "length(email)"
+*@param     text        the text, changed in place
+*@param     column      set to the column
+*returns an enum of type PrepareResult
 */
-Cursor* table_start(Table* table){
-    Cursor* cursor = table_find(table, 0);
-    printf("table find in table start\n");
-    void* node = get_page(table->pager, cursor->page_num);
-    printf("get page in table start\n");
-    uint32_t num_cells = *leaf_node_num_cells(node);
-    cursor->end_of_table = (num_cells == 0);
-    printf(" page num :%d  cell num:%d end of table:%d",cursor->page_num, cursor->cell_num, cursor->end_of_table );
-    return cursor;
+PrepareResult prepare_aggregate_column(char* text, Column* column){
+    size_t length = strlen(text);
+    if(strcmp(text, "id") == 0){
+        *column = COLUMN_ID;
+        return PREPARE_SUCCESS;
+    }
+    if(strncmp(text, "length(", 7) != 0 || text[length - 1] != ')')
+        return PREPARE_SYNTAX_ERROR;
+    text[length - 1] = '\0';
+    return prepare_column(text + 7, column);
 }
 
 /*
-*function to execute insert operation
-*@param     statement       pointer to statement to be executed
-*@param     table           pointer to the table on which the statements should be executed
-*@returns an enum of type ExecuteResult
+*function to parse the aggregate of a select, "count(*)", "count(X)", "min(X)", "max(X)" or "sum(X)"
+*@param     text        the token, changed in place
+*@param     statement   pointer to the statement to fill
+*returns an enum of type PrepareResult
 */
-ExecuteResult execute_insert (Statement* statement, Table* table){
+PrepareResult prepare_aggregate(char* text, Statement* statement){
+    char*   argument    = strchr(text, '(');
+    size_t  length      = strlen(text);
+    if(argument == NULL || text[length - 1] != ')')
+        return PREPARE_SYNTAX_ERROR;
+    *(argument++)       = '\0';
+    text[length - 1]    = '\0';
 
-    void*       node        = get_page (table->pager, table->root_page_num);
-    uint32_t    num_cells   = *(leaf_node_num_cells (node));
+    if(strcmp(text, "count") == 0)
+        statement->aggregate = AGGREGATE_COUNT;
+    else if(strcmp(text, "min") == 0)
+        statement->aggregate = AGGREGATE_MIN;
+    else if(strcmp(text, "max") == 0)
+        statement->aggregate = AGGREGATE_MAX;
+    else if(strcmp(text, "sum") == 0)
+        statement->aggregate = AGGREGATE_SUM;
+    else
+        return PREPARE_SYNTAX_ERROR;
 
-    //check if table is full
-//    if (num_cells >= LEAF_NODE_MAX_CELLS) 
-//        return EXECUTE_TABLE_FULL;
+    if(statement->aggregate == AGGREGATE_COUNT && strcmp(argument, "*") == 0)
+        return PREPARE_SUCCESS;
+    return prepare_aggregate_column(argument, &(statement->aggregate_column));
+}
 
-    //Cursor* cursor = table_end (table);
-    uint32_t    key     = statement->row_to_insert.id;
-    Cursor*     cursor  =  table_find(table, key);
+/*
+*function to parse a select, "select [AGGREGATE] [where ...] [group by length(username|email)] [limit N] [offset M]"
+*group by only goes with an aggregate, limit and offset only without one
+*@param     text        text after the keyword, tokenized in place
+*@param     statement   pointer to the statement to fill
+*returns an enum of type PrepareResult
+*/
+PrepareResult prepare_select(char* text, Statement* statement){
+    statement->key_lo           = 0;
+    statement->key_hi           = UINT32_MAX;
+    statement->num_keys         = 0;
+    statement->match_column     = COLUMN_ID;
+    statement->match_prefix     = false;
+    statement->aggregate        = AGGREGATE_NONE;
+    statement->aggregate_column = COLUMN_ID;
+    statement->group_column     = COLUMN_ID;
+    statement->limit            = UINT32_MAX;
+    statement->offset           = 0;
 
-    if(cursor->cell_num < num_cells){
-        uint32_t ket_at_cursor = *leaf_node_key(node, cursor->cell_num);
-        if(ket_at_cursor == key)
-            return EXECUTE_DUPLICATE_KEY;
+    PrepareResult   result  = PREPARE_SUCCESS;
+    char*           token   = strtok(text, " ");
+    if(token != NULL && strchr(token, '(') != NULL){
+        result = prepare_aggregate(token, statement);
+        if(result != PREPARE_SUCCESS)
+            return result;
+        token = strtok(NULL, " ");
     }
 
-    leaf_node_insert (cursor, key, &(statement->row_to_insert));
+    if(token != NULL && strcmp(token, "where") == 0){
+        result = prepare_where(statement);
+        if(result != PREPARE_SUCCESS)
+            return result;
+        token = strtok(NULL, " ");
+    }
 
-    free (cursor);
-    return EXECUTE_SUCCESS;
-    
-}
+    if(token != NULL && strcmp(token, "group") == 0 && statement->aggregate != AGGREGATE_NONE){
+        char* by_word   = strtok(NULL, " ");
+        char* column    = strtok(NULL, " ");
+        if(by_word == NULL || strcmp(by_word, "by") != 0 || column == NULL ||
+           prepare_aggregate_column(column, &(statement->group_column)) != PREPARE_SUCCESS ||
+           statement->group_column == COLUMN_ID)
+            return PREPARE_SYNTAX_ERROR;
+        token = strtok(NULL, " ");
+    }
 
-/*
-*function to execute select operation
-*@param     statement       pointer to statement to be executed
-*@param     table           pointer to the table on which the statements should be executed
-*@returns an enum of type ExecuteResult
-*/
-ExecuteResult execute_select(Statement* statement, Table* table){
-    Row row;
-    Cursor* cursor = table_start(table);
-    printf("table start\n");
-    while(cursor->end_of_table != true){
-        deserialize_row(cursor_value(cursor),&row);
-        print_row(&row);
-        printf("adv cur\n");
-        advance_cursor(cursor);
+    if(token != NULL && strcmp(token, "limit") == 0 && statement->aggregate == AGGREGATE_NONE){
+        result = prepare_value(strtok(NULL, " "), statement, PARAM_LIMIT);
+        if(result != PREPARE_SUCCESS)
+            return result;
+        token = strtok(NULL, " ");
     }
 
-    free(cursor);
-    return EXECUTE_SUCCESS;
+    if(token != NULL && strcmp(token, "offset") == 0 && statement->aggregate == AGGREGATE_NONE){
+        result = prepare_value(strtok(NULL, " "), statement, PARAM_OFFSET);
+        if(result != PREPARE_SUCCESS)
+            return result;
+        token = strtok(NULL, " ");
+    }
+
+    if(token != NULL)
+        return PREPARE_SYNTAX_ERROR;
+    return PREPARE_SUCCESS;
 }
 
 /*
-*function to open the pager, opens the file passed, initialize the page handle & pages
-*@param     filename    name of the file to be opened
-*@returns a pointer to the pager with file handles and the pages
+*function to parse the text of a statement, the text is tokenized in place
+*@param     text                the statement text
+*@param     statement           pointer to store the statements after preparation
+*returns an enum of type PrepareResult
 */
-Pager* open_pager(const char* filename){
-
-    //if file exists open it in read/write mode else create the file
-    int fd = open(filename, O_RDWR | O_CREAT);
+PrepareResult prepare_text(char* text, Statement* statement){
+    statement->num_params       = 0;
+    statement->on_row           = NULL;
+    statement->on_value         = NULL;
+    statement->on_row_context   = NULL;
+    statement->num_keys         = 0;
+    statement->match_column     = COLUMN_ID;
+    statement->aggregate        = AGGREGATE_NONE;
+    statement->limit            = UINT32_MAX;
+    statement->offset           = 0;
 
-    if(fd == -1){//failed to open/create file
-        printf("Unable to open file\n.");
-        exit(EXIT_FAILURE);
+    if(strncmp(text,"insert",6)==0){
+        statement->type = STATEMENT_INSERT;
+        PrepareResult result = prepare_value(strtok(text + 6, " "), statement, PARAM_ROW_ID);
+        if(result == PREPARE_SUCCESS)
+            result = prepare_value(strtok(NULL, " "), statement, PARAM_ROW_USERNAME);
+        if(result == PREPARE_SUCCESS)
+            result = prepare_value(strtok(NULL, " "), statement, PARAM_ROW_EMAIL);
+        return result;
     }
 
-    off_t file_length = lseek(fd,0,SEEK_END);//find the length of the file
-    
-    Pager* pager    = (Pager*)malloc(sizeof(Pager));
-    pager->file_descriptor  = fd;
-    pager->file_length      = file_length;
-    pager->num_pages        = file_length/PAGE_SIZE;
+    else if(strncmp(text,"select",6)==0){
+        statement->type = STATEMENT_SELECT;
+        return prepare_select(text + 6, statement);
+    }
 
-    if(file_length % PAGE_SIZE != 0){
-        printf("Number of pages in the db is not a whole number.\n Corrupt file.\n");
-        exit(EXIT_FAILURE);
+    else if(strncmp(text,"delete",6)==0){
+        statement->type = STATEMENT_DELETE;
+        return prepare_value(strtok(text + 6, " "), statement, PARAM_KEY);
     }
-    
-    for(uint32_t i = 0; i< TABLE_MAX_PAGES; i++)
-        pager->pages[i] = NULL;
 
-    return pager;
-}
+    else if(strcmp(text,"begin")==0){
+        statement->type = STATEMENT_BEGIN;
+        return PREPARE_SUCCESS;
+    }
 
-/*
-*function to open the db
-*@param     filename    name of the db file
-*@returns pointer to the table 
-*/
-Table* open_db(const char* filename){
-    Pager*      pager    = open_pager(filename);
-    Table*      table    = (Table*)malloc(sizeof(Table));
-    table->pager         = pager;
-    table->root_page_num = 0;
+    else if(strcmp(text,"commit")==0){
+        statement->type = STATEMENT_COMMIT;
+        return PREPARE_SUCCESS;
+    }
 
-    if(pager->num_pages == 0){
-        //new db file, intialize the page 0 as the leaf node
-        void* root_node = get_page(pager, 0);
-        initialize_leaf_node(root_node);
-        set_node_root(root_node, true);
+    //create index on username|email
+    else if(strncmp(text,"create",6)==0){
+        statement->type = STATEMENT_CREATE_INDEX;
+        char* index_word    = strtok(text + 6, " ");
+        char* on_word       = strtok(NULL, " ");
+        if(index_word == NULL || strcmp(index_word, "index") != 0 || on_word == NULL || strcmp(on_word, "on") != 0)
+            return PREPARE_SYNTAX_ERROR;
+        PrepareResult result = prepare_column(strtok(NULL, " "), &(statement->match_column));
+        if(result == PREPARE_SUCCESS && strtok(NULL, " ") != NULL)
+            return PREPARE_SYNTAX_ERROR;
+        return result;
     }
 
-    return table; 
+    else
+        return PREPARE_FAILURE;
 }
 
 /*
@@ -680,55 +4897,176 @@ Table* open_db(const char* filename){
 *returns an enum of type PrepareResult
 */
 PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement){
+    return prepare_text(input_buffer->buffer, statement);
+}
 
-    if(strncmp(input_buffer->buffer,"insert",6)==0){
-        statement->type = STATEMENT_INSERT;
-        char* keyword   = strtok(input_buffer->buffer," ");
-        char* id_str    = strtok(NULL," ");
-        char* username  = strtok(NULL," ");
-        char* email     = strtok(NULL," ");    
+/*
+*function to compile a statement once so it can be bound and stepped many times,
+*each ? in the text is a parameter, numbered from 1 in the order they appear
+*@param     sql                 the statement text, left unchanged
+*@param     statement           pointer to store the prepared statement
+*returns an enum of type PrepareResult
+*/
+PrepareResult statement_prepare(const char* sql, Statement* statement){
+    char*           text    = strdup(sql);
+    PrepareResult   result  = prepare_text(text, statement);
+    free(text);
+    return result;
+}
 
-        if (id_str == NULL || username == NULL || email == NULL)
-            return PREPARE_SYNTAX_ERROR;
+/*
+*function to bind an integer to a parameter of a prepared statement
+*@param     statement   pointer to the prepared statement
+*@param     index       parameter number, from 1
+*@param     value       the value
+*returns PREPARE_BAD_PARAMETER if there is no such parameter or it takes a string
+*/
+PrepareResult statement_bind_int(Statement* statement, uint32_t index, int64_t value){
+    if(index < 1 || index > statement->num_params)
+        return PREPARE_BAD_PARAMETER;
+    StatementParam* param   = &(statement->params[index - 1]);
+    PrepareResult   result  = statement_set_int(statement, param->target, param->key_num, value);
+    param->bound = (result == PREPARE_SUCCESS);
+    return result;
+}
 
-        int id  = atoi(id_str);
-        if(id<0) return PREPARE_NEGATIVE_ID;
-        if(strlen(username) > COLUMN_USERNAME_SIZE) return PREPARE_STRING_TOO_LONG;
-        if(strlen(email) > COLUMN_EMAIL_SIZE) return PREPARE_STRING_TOO_LONG;
+/*
+*function to bind a string to a parameter of a prepared statement
+*@param     statement   pointer to the prepared statement
+*@param     index       parameter number, from 1
+*@param     value       the string, copied into the statement
+*returns PREPARE_BAD_PARAMETER if there is no such parameter or it takes an integer
+*/
+PrepareResult statement_bind_text(Statement* statement, uint32_t index, const char* value){
+    if(index < 1 || index > statement->num_params)
+        return PREPARE_BAD_PARAMETER;
+    StatementParam* param   = &(statement->params[index - 1]);
+    PrepareResult   result  = statement_set_text(statement, param->target, value);
+    param->bound = (result == PREPARE_SUCCESS);
+    return result;
+}
 
-        statement->row_to_insert.id = id;
-        strcpy(statement->row_to_insert.username, username);
-        strcpy(statement->row_to_insert.email, email);
-        return PREPARE_SUCCESS;
-    }
+/*
+*function to clear the bindings of a prepared statement so the next step needs new values
+*@param     statement   pointer to the prepared statement
+*/
+void statement_reset(Statement* statement){
+    for(uint32_t i = 0; i < statement->num_params; i++)
+        statement->params[i].bound = false;
+}
 
-    else if(strcmp(input_buffer->buffer,"select")==0){
-        statement->type = STATEMENT_SELECT;
-        return PREPARE_SUCCESS;
-    }
+/*
+*function to start a transaction, statements are committed together at commit
+*@param     table       pointer to the table
+*@returns an enum of type ExecuteResult
+*/
+ExecuteResult execute_begin(Table* table){
+    if(table_in_transaction(table))
+        return EXECUTE_ALREADY_IN_TRANSACTION;
+    //the write lock is kept until commit, writers of other threads wait for it
+    pthread_mutex_lock(&(table->write_lock));
+    transaction_table       = table;
+    table->in_transaction   = true;
+    return EXECUTE_SUCCESS;
+}
 
-    else
-        return PREPARE_FAILURE;
+/*
+*function to commit the open transaction, one log sync for all its statements
+*@param     table       pointer to the table
+*@returns an enum of type ExecuteResult
+*/
+ExecuteResult execute_commit(Table* table){
+    if(!table_in_transaction(table))
+        return EXECUTE_NO_TRANSACTION;
+    table->in_transaction   = false;
+    transaction_table       = NULL;
+    pager_commit(table->pager);
+    pthread_mutex_unlock(&(table->write_lock));
+    return EXECUTE_SUCCESS;
+}
+
+/*
+*function to roll back the open transaction, none of its statements are kept
+*@param     table       pointer to the table
+*@returns an enum of type ExecuteResult
+*/
+ExecuteResult execute_rollback(Table* table){
+    if(!table_in_transaction(table))
+        return EXECUTE_NO_TRANSACTION;
+    table->in_transaction   = false;
+    transaction_table       = NULL;
+    pager_rollback(table->pager);
+    pthread_mutex_unlock(&(table->write_lock));
+    return EXECUTE_SUCCESS;
 }
 
 /*
-*function to execute the statements prepared
+*function to execute the statements prepared, selects of any number of threads run
+*in parallel with one writer, outside a transaction each write is committed on its own
 *@param     statement   pointer to the prepared statements
 *@param     table       pointer to the table
 *@returns execution results of type ExecuteResult
 */
 ExecuteResult execute_statement(Statement* statement, Table* table){
-    printf("root-page-num: %d.\n", table->root_page_num);
+    TRACE("root-page-num: %d.\n", table->root_page_num);
+    ExecuteResult result = EXECUTE_FAILURE;
+    uint64_t      start  = stats_now();
+    //scratch memory of the statement goes back to the thread's arena when it ends
+    ArenaMark     mark   = arena_mark(&statement_arena);
     switch (statement->type)
     {
     case STATEMENT_INSERT:
-        return execute_insert(statement, table); 
+        table_write_begin(table, false);
+        result = execute_insert(statement, table); 
+        table_write_end(table);
+        stats_time(STAT_LATENCY_INSERT, start);
         break;
     
     case STATEMENT_SELECT:
-        return execute_select(statement, table);
+        //reads change nothing, there is nothing to commit
+        table_read_begin(table);
+        result = execute_select(statement, table);
+        table_read_end(table);
+        stats_time(STAT_LATENCY_SELECT, start);
+        break;
+
+    case STATEMENT_DELETE:
+        table_write_begin(table, false);
+        result = execute_delete(statement, table);
+        table_write_end(table);
+        stats_time(STAT_LATENCY_DELETE, start);
+        break;
+
+    case STATEMENT_BEGIN:
+        result = execute_begin(table);
+        break;
+
+    case STATEMENT_COMMIT:
+        result = execute_commit(table);
+        break;
+
+    case STATEMENT_CREATE_INDEX:
+        //readers are kept out while the index appears
+        table_write_begin(table, true);
+        result = execute_create_index(statement, table);
+        table_write_end(table);
         break;
     }
+    arena_release(&statement_arena, mark);
+    return result;
+}
+
+/*
+*function to execute a prepared statement with its current bindings
+*@param     statement   pointer to the prepared statement
+*@param     table       pointer to the table
+*@returns EXECUTE_UNBOUND_PARAMETER if a parameter has no value, else the execution result
+*/
+ExecuteResult statement_step(Statement* statement, Table* table){
+    for(uint32_t i = 0; i < statement->num_params; i++)
+        if(!statement->params[i].bound)
+            return EXECUTE_UNBOUND_PARAMETER;
+    return execute_statement(statement, table);
 }
 
 #endif
\ No newline at end of file
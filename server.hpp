@@ -0,0 +1,601 @@
+#ifndef SERVER
+#define SERVER
+#include "repl_helpers.hpp"
+
+/*
+*protocol, every message is a u32 length of the rest of the message followed by a u8 type,
+*numbers are in host byte order as the socket is local
+*requests:  SERVER_OP_QUERY     statement text, no terminating zero
+*           SERVER_OP_INSERT    u32 id, row payload ([u8 username length][u8 email length][username][email])
+*           SERVER_OP_SELECT    u32 lowest id, u32 highest id
+*           SERVER_OP_DELETE    u32 id
+*           SERVER_OP_BEGIN, SERVER_OP_COMMIT
+*responses: SERVER_RESPONSE_ROW  u32 id, row payload, one per row a select finds
+*           SERVER_RESPONSE_VALUE u8 grouped, u32 group, u64 value, one per result of an aggregate
+*           SERVER_RESPONSE_DONE u8 ServerStatus, u8 result code, ends every response
+*/
+
+//set by SIGINT and SIGTERM, the event loop stops on its next wake up
+volatile sig_atomic_t server_stop_requested = 0;
+
+/*
+*function to request the server to stop, signal handler
+*@param signal_number   signal received
+*/
+void server_request_stop(int signal_number){
+    server_stop_requested = 1;
+}
+
+/*
+*function to make sure a buffer has room for more bytes
+*@param buffer      pointer to the buffer
+*@param capacity    pointer to its capacity, updated when it grows
+*@param needed      bytes the buffer must hold
+*/
+void server_buffer_reserve(char** buffer, uint32_t* capacity, uint32_t needed){
+    if(needed <= *capacity)
+        return;
+    uint32_t new_capacity = *capacity ? *capacity : SERVER_READ_SIZE;
+    while(new_capacity < needed)
+        new_capacity *= 2;
+    *buffer     = (char*)realloc(*buffer, new_capacity);
+    *capacity   = new_capacity;
+}
+
+/*
+*function to append bytes to the responses of a connection
+*@param connection  pointer to the connection
+*@param data        bytes to append
+*@param length      number of bytes
+*/
+void server_append(ServerConnection* connection, const void* data, uint32_t length){
+    server_buffer_reserve(&(connection->output), &(connection->output_capacity), connection->output_length + length);
+    memcpy(connection->output + connection->output_length, data, length);
+    connection->output_length += length;
+}
+
+/*
+*function to send the pending responses of a connection, waits while the socket is full
+*@param connection  pointer to the connection
+*@returns false if the client is gone
+*/
+bool server_flush(ServerConnection* connection){
+    uint32_t sent = 0;
+    while(sent < connection->output_length){
+        ssize_t bytes_sent = send(connection->fd, connection->output + sent, connection->output_length - sent, MSG_NOSIGNAL);
+        if(bytes_sent > 0){
+            sent += bytes_sent;
+            continue;
+        }
+        if(bytes_sent == -1 && errno == EINTR)
+            continue;
+        if(bytes_sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            struct pollfd writable = {connection->fd, POLLOUT, 0};
+            poll(&writable, 1, -1);
+            continue;
+        }
+        connection->output_length = 0;
+        return false;
+    }
+    connection->output_length = 0;
+    return true;
+}
+
+/*
+*function to append the response to a row found by a select, the row callback of the server
+*large results are sent while the select runs so the output buffer stays bounded
+*@param row         pointer to the row
+*@param context     pointer to the ServerConnection
+*/
+void server_append_row(RowView* row, void* context){
+    ServerConnection*   connection      = (ServerConnection*)context;
+    uint32_t            payload_size    = row_view_payload_size(row);
+    uint32_t            length          = sizeof(uint8_t) + sizeof(uint32_t) + payload_size;
+    uint8_t             type            = SERVER_RESPONSE_ROW;
+
+    server_buffer_reserve(&(connection->output), &(connection->output_capacity),
+                          connection->output_length + sizeof(uint32_t) + length);
+    server_append(connection, &length, sizeof(uint32_t));
+    server_append(connection, &type, sizeof(uint8_t));
+    server_append(connection, &(row->id), sizeof(uint32_t));
+    //the row goes out the way it is stored, straight from the leaf
+    server_append(connection, row->payload, payload_size);
+
+    //a client that went away is noticed when its next request is read
+    if(connection->output_length >= SERVER_FLUSH_SIZE)
+        server_flush(connection);
+}
+
+/*
+*function to append the response to a result of an aggregate, the value callback of the server
+*@param group       pointer to the group, NULL without group by
+*@param value       the result
+*@param context     pointer to the ServerConnection
+*/
+void server_append_value(uint32_t* group, uint64_t value, void* context){
+    ServerConnection*   connection  = (ServerConnection*)context;
+    uint32_t            length      = 2 * sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint64_t);
+    uint8_t             message[2]  = {SERVER_RESPONSE_VALUE, (uint8_t)(group != NULL)};
+    uint32_t            group_value = group ? *group : 0;
+    server_append(connection, &length, sizeof(uint32_t));
+    server_append(connection, message, sizeof(message));
+    server_append(connection, &group_value, sizeof(uint32_t));
+    server_append(connection, &value, sizeof(uint64_t));
+}
+
+/*
+*function to append the response ending a request
+*@param connection  pointer to the connection
+*@param status      which enum the code is from
+*@param code        result of the request
+*/
+void server_append_done(ServerConnection* connection, ServerStatus status, uint8_t code){
+    uint32_t    length      = 3 * sizeof(uint8_t);
+    uint8_t     message[3]  = {SERVER_RESPONSE_DONE, (uint8_t)status, code};
+    server_append(connection, &length, sizeof(uint32_t));
+    server_append(connection, message, sizeof(message));
+}
+
+/*
+*function to add a connection to the queue of the workers, the queue lock must be held
+*@param server      pointer to the server
+*@param connection  pointer to the connection
+*/
+void server_queue_push(Server* server, ServerConnection* connection){
+    if(server->queue_length == server->queue_capacity){
+        //unroll the ring into a buffer twice the size
+        uint32_t            new_capacity    = server->queue_capacity ? server->queue_capacity * 2 : SERVER_MAX_EVENTS;
+        ServerConnection**  queue           = (ServerConnection**)malloc(new_capacity * sizeof(ServerConnection*));
+        for(uint32_t i = 0; i < server->queue_length; i++)
+            queue[i] = server->queue[(server->queue_head + i) % server->queue_capacity];
+        free(server->queue);
+        server->queue           = queue;
+        server->queue_head      = 0;
+        server->queue_capacity  = new_capacity;
+    }
+    server->queue[(server->queue_head + server->queue_length) % server->queue_capacity] = connection;
+    server->queue_length++;
+    pthread_cond_signal(&(server->queue_ready));
+}
+
+/*
+*function to queue a connection with requests waiting for a worker
+*@param server      pointer to the server
+*@param connection  pointer to the connection
+*/
+void server_enqueue(Server* server, ServerConnection* connection){
+    pthread_mutex_lock(&(server->queue_lock));
+    server_queue_push(server, connection);
+    pthread_mutex_unlock(&(server->queue_lock));
+}
+
+/*
+*function to make a connection the writer of the table if no other connection is
+*@param server      pointer to the server
+*@param connection  pointer to the connection about to write
+*@returns false if another connection is writing
+*/
+bool server_claim_writer(Server* server, ServerConnection* connection){
+    pthread_mutex_lock(&(server->queue_lock));
+    bool claimed = server->writer == NULL || server->writer == connection;
+    if(claimed)
+        server->writer = connection;
+    pthread_mutex_unlock(&(server->queue_lock));
+    return claimed;
+}
+
+/*
+*function to give up the table once a connection is done writing, the parked connections are queued again
+*@param server      pointer to the server
+*@param connection  pointer to the connection that wrote
+*/
+void server_release_writer(Server* server, ServerConnection* connection){
+    pthread_mutex_lock(&(server->queue_lock));
+    if(server->writer == connection){
+        server->writer = NULL;
+        for(uint32_t i = 0; i < server->num_waiting; i++)
+            server_queue_push(server, server->waiting[i]);
+        server->num_waiting = 0;
+    }
+    pthread_mutex_unlock(&(server->queue_lock));
+}
+
+/*
+*function to park a connection whose next request writes while another connection holds the table,
+*the worker is free for other clients instead of waiting on the write lock
+*@param server      pointer to the server
+*@param connection  pointer to the connection, not to be touched after it is parked
+*@returns false if the writer was released meanwhile and the request can be retried
+*/
+bool server_park(Server* server, ServerConnection* connection){
+    pthread_mutex_lock(&(server->queue_lock));
+    bool parked = server->writer != NULL && server->writer != connection;
+    if(parked){
+        if(server->num_waiting == server->waiting_capacity){
+            server->waiting_capacity    = server->waiting_capacity ? server->waiting_capacity * 2 : SERVER_MAX_EVENTS;
+            server->waiting             = (ServerConnection**)realloc(server->waiting, server->waiting_capacity * sizeof(ServerConnection*));
+        }
+        server->waiting[server->num_waiting++] = connection;
+    }
+    pthread_mutex_unlock(&(server->queue_lock));
+    return parked;
+}
+
+/*
+*function to execute a statement that writes once the connection holds the table
+*@param server      pointer to the server
+*@param connection  pointer to the connection the statement came from
+*@param statement   pointer to the statement
+*@returns false if another connection is writing and nothing was executed
+*/
+bool server_execute_write(Server* server, ServerConnection* connection, Statement* statement){
+    if(!server_claim_writer(server, connection))
+        return false;
+    server_append_done(connection, SERVER_STATUS_EXECUTED, statement_step(statement, server->table));
+    if(!table_in_transaction(server->table))
+        server_release_writer(server, connection);
+    return true;
+}
+
+/*
+*function to execute one request and append its responses
+*@param server      pointer to the server
+*@param connection  pointer to the connection the request came from
+*@param request     the request after its length, starting with the op
+*@param length      length of the request
+*@returns false if the request writes while another connection is writing, it is left to be retried
+*/
+bool server_execute_request(Server* server, ServerConnection* connection, const char* request, uint32_t length){
+    Statement   statement;
+    const char* body        = request + 1;
+    uint32_t    body_length = length - 1;
+
+    switch((ServerOp)request[0]){
+        case SERVER_OP_QUERY: {
+            //the text is tokenized in place, a copy of it is taken from the worker's statement arena
+            ArenaMark       mark    = arena_mark(&statement_arena);
+            char*           text    = (char*)arena_alloc(&statement_arena, body_length + 1);
+            memcpy(text, body, body_length);
+            text[body_length]       = '\0';
+            PrepareResult   result  = prepare_text(text, &statement);
+            arena_release(&statement_arena, mark);
+            if(result != PREPARE_SUCCESS){
+                server_append_done(connection, SERVER_STATUS_PREPARE_ERROR, result);
+                return true;
+            }
+            statement.on_row            = server_append_row;
+            statement.on_value          = server_append_value;
+            statement.on_row_context    = connection;
+            if(statement.type != STATEMENT_SELECT && statement.type != STATEMENT_COMMIT)
+                return server_execute_write(server, connection, &statement);
+            server_append_done(connection, SERVER_STATUS_EXECUTED, statement_step(&statement, server->table));
+            if(statement.type == STATEMENT_COMMIT)
+                server_release_writer(server, connection);
+            return true;
+        }
+
+        case SERVER_OP_INSERT: {
+            uint32_t header = sizeof(uint32_t) + ROW_STRINGS_OFFSET;
+            if(body_length < header)
+                break;
+            uint8_t username_length = body[ROW_USERNAME_LENGTH_OFFSET + sizeof(uint32_t)];
+            uint8_t email_length    = body[ROW_EMAIL_LENGTH_OFFSET + sizeof(uint32_t)];
+            //an email of any length byte fits its column
+            if(username_length > COLUMN_USERNAME_SIZE || body_length != header + username_length + email_length)
+                break;
+            statement.type          = STATEMENT_INSERT;
+            statement.num_params    = 0;
+            memcpy(&(statement.row_to_insert.id), body, sizeof(uint32_t));
+            deserialize_row((void*)(body + sizeof(uint32_t)), &(statement.row_to_insert));
+            return server_execute_write(server, connection, &statement);
+        }
+
+        case SERVER_OP_SELECT:
+            if(body_length != 2 * sizeof(uint32_t))
+                break;
+            statement.type              = STATEMENT_SELECT;
+            statement.num_params        = 0;
+            statement.num_keys          = 0;
+            statement.match_column      = COLUMN_ID;
+            statement.aggregate         = AGGREGATE_NONE;
+            statement.limit             = UINT32_MAX;
+            statement.offset            = 0;
+            statement.on_row            = server_append_row;
+            statement.on_row_context    = connection;
+            memcpy(&(statement.key_lo), body, sizeof(uint32_t));
+            memcpy(&(statement.key_hi), body + sizeof(uint32_t), sizeof(uint32_t));
+            server_append_done(connection, SERVER_STATUS_EXECUTED, execute_statement(&statement, server->table));
+            return true;
+
+        case SERVER_OP_DELETE:
+            if(body_length != sizeof(uint32_t))
+                break;
+            statement.type          = STATEMENT_DELETE;
+            statement.num_params    = 0;
+            memcpy(&(statement.key), body, sizeof(uint32_t));
+            return server_execute_write(server, connection, &statement);
+
+        case SERVER_OP_BEGIN:
+            if(body_length != 0)
+                break;
+            statement.type          = STATEMENT_BEGIN;
+            statement.num_params    = 0;
+            return server_execute_write(server, connection, &statement);
+
+        case SERVER_OP_COMMIT:
+            if(body_length != 0)
+                break;
+            //committing ends the transaction this connection holds, nothing to wait for
+            server_append_done(connection, SERVER_STATUS_EXECUTED, execute_commit(server->table));
+            server_release_writer(server, connection);
+            return true;
+    }
+    server_append_done(connection, SERVER_STATUS_BAD_REQUEST, 0);
+    return true;
+}
+
+/*
+*function to read what a client sent and execute every complete request, reading stops once
+*more than a request of the largest size is buffered, the rest is read when the socket is polled again
+*@param server      pointer to the server
+*@param connection  pointer to the connection, its socket is non-blocking
+*@returns SERVER_CONNECTION_CLOSED if the client closed the connection or sent a request that is too large,
+*SERVER_CONNECTION_WAITING if the connection was parked behind another writer
+*/
+ServerConnectionState server_read_requests(Server* server, ServerConnection* connection){
+    bool open = true;
+    while(connection->input_length <= sizeof(uint32_t) + SERVER_MAX_REQUEST){
+        server_buffer_reserve(&(connection->input), &(connection->input_capacity), connection->input_length + SERVER_READ_SIZE);
+        ssize_t bytes_read = recv(connection->fd, connection->input + connection->input_length, SERVER_READ_SIZE, 0);
+        if(bytes_read > 0){
+            connection->input_length += bytes_read;
+            continue;
+        }
+        if(bytes_read == -1 && errno == EINTR)
+            continue;
+        if(bytes_read == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            open = false;
+        break;
+    }
+
+    while(true){
+        //execute the complete requests in order, a partial one waits for the rest of its bytes
+        uint32_t    offset  = 0;
+        bool        blocked = false;
+        while(connection->input_length - offset >= sizeof(uint32_t)){
+            uint32_t length;
+            memcpy(&length, connection->input + offset, sizeof(uint32_t));
+            if(length == 0 || length > SERVER_MAX_REQUEST)
+                return SERVER_CONNECTION_CLOSED;
+            if(connection->input_length - offset - sizeof(uint32_t) < length)
+                break;
+            if(!server_execute_request(server, connection, connection->input + offset + sizeof(uint32_t), length)){
+                blocked = true;
+                break;
+            }
+            offset += sizeof(uint32_t) + length;
+        }
+        memmove(connection->input, connection->input + offset, connection->input_length - offset);
+        connection->input_length -= offset;
+
+        if(!server_flush(connection))
+            return SERVER_CONNECTION_CLOSED;
+        if(!blocked)
+            break;
+        //a closed client is parked as well, its writes are still executed before it is closed
+        if(server_park(server, connection))
+            return SERVER_CONNECTION_WAITING;
+    }
+    return open ? SERVER_CONNECTION_OPEN : SERVER_CONNECTION_CLOSED;
+}
+
+/*
+*function to close a connection, an open transaction of the client is rolled back
+*@param server      pointer to the server
+*@param connection  pointer to the connection
+*/
+void server_close_connection(Server* server, ServerConnection* connection){
+    if(table_in_transaction(server->table))
+        execute_rollback(server->table);
+    server_release_writer(server, connection);
+    pthread_mutex_lock(&(server->queue_lock));
+    ServerConnection* last                  = server->connections[--server->num_connections];
+    server->connections[connection->slot]   = last;
+    last->slot                              = connection->slot;
+    pthread_mutex_unlock(&(server->queue_lock));
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    free(connection->input);
+    free(connection->output);
+    free(connection);
+}
+
+/*
+*function to serve a connection with requests waiting, a client with an open transaction
+*keeps the worker until it commits, the transaction belongs to the worker's thread
+*@param server      pointer to the server
+*@param connection  pointer to the connection
+*/
+void server_serve(Server* server, ServerConnection* connection){
+    while(true){
+        ServerConnectionState state = server_read_requests(server, connection);
+        if(state == SERVER_CONNECTION_WAITING)
+            return;
+        if(state == SERVER_CONNECTION_CLOSED){
+            server_close_connection(server, connection);
+            return;
+        }
+        if(!table_in_transaction(server->table))
+            break;
+
+        //wait on this client alone, checking now and then if the server is stopping
+        struct pollfd readable = {connection->fd, POLLIN, 0};
+        while(poll(&readable, 1, 100) == 0)
+            if(server->stopping){
+                server_close_connection(server, connection);
+                return;
+            }
+    }
+
+    //hand the connection back to the event loop
+    struct epoll_event event;
+    event.events    = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr  = connection;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+/*
+*function run by each worker thread, serves queued connections until the server stops
+*@param argument    pointer to the server
+*@returns NULL
+*/
+void* server_worker(void* argument){
+    Server* server = (Server*)argument;
+    while(true){
+        pthread_mutex_lock(&(server->queue_lock));
+        while(server->queue_length == 0 && !server->stopping)
+            pthread_cond_wait(&(server->queue_ready), &(server->queue_lock));
+        if(server->queue_length == 0){
+            pthread_mutex_unlock(&(server->queue_lock));
+            return NULL;
+        }
+        ServerConnection* connection = server->queue[server->queue_head];
+        server->queue_head = (server->queue_head + 1) % server->queue_capacity;
+        server->queue_length--;
+        pthread_mutex_unlock(&(server->queue_lock));
+
+        server_serve(server, connection);
+    }
+}
+
+/*
+*function to accept the clients waiting on the listening socket
+*@param server      pointer to the server
+*/
+void server_accept(Server* server){
+    while(true){
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd == -1)
+            return;
+
+        ServerConnection* connection = (ServerConnection*)calloc(1, sizeof(ServerConnection));
+        connection->fd = fd;
+        pthread_mutex_lock(&(server->queue_lock));
+        if(server->num_connections == server->connections_capacity){
+            server->connections_capacity    = server->connections_capacity ? server->connections_capacity * 2 : SERVER_MAX_EVENTS;
+            server->connections             = (ServerConnection**)realloc(server->connections, server->connections_capacity * sizeof(ServerConnection*));
+        }
+        connection->slot                                = server->num_connections;
+        server->connections[server->num_connections++]  = connection;
+        pthread_mutex_unlock(&(server->queue_lock));
+
+        //one shot, the connection is off the loop while a worker serves it
+        struct epoll_event event;
+        event.events    = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr  = connection;
+        if(epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+            server_close_connection(server, connection);
+    }
+}
+
+/*
+*function to run the server until SIGINT or SIGTERM, the table is shared by all clients
+*@param table           pointer to the table
+*@param socket_path     path of the Unix socket to listen on, an old socket file there is replaced
+*@param num_workers     number of worker threads executing requests
+*/
+void server_run(Table* table, const char* socket_path, uint32_t num_workers){
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(socket_path) >= sizeof(address.sun_path)){
+        printf("Socket path '%s' is too long.\n", socket_path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(address.sun_path, socket_path);
+
+    Server server;
+    server.table                = table;
+    server.num_workers          = num_workers ? num_workers : 1;
+    server.queue                = NULL;
+    server.queue_head           = 0;
+    server.queue_length         = 0;
+    server.queue_capacity       = 0;
+    server.writer               = NULL;
+    server.waiting              = NULL;
+    server.num_waiting          = 0;
+    server.waiting_capacity     = 0;
+    server.connections          = NULL;
+    server.num_connections      = 0;
+    server.connections_capacity = 0;
+    server.stopping             = false;
+    pthread_mutex_init(&(server.queue_lock), NULL);
+    pthread_cond_init(&(server.queue_ready), NULL);
+
+    unlink(socket_path);
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(server.listen_fd == -1 ||
+       bind(server.listen_fd, (struct sockaddr*)&address, sizeof(address)) == -1 ||
+       listen(server.listen_fd, SERVER_BACKLOG) == -1){
+        printf("Unable to listen on '%s': %d\n", socket_path, errno);
+        exit(EXIT_FAILURE);
+    }
+
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    event.events    = EPOLLIN;
+    event.data.ptr  = NULL;
+    if(server.epoll_fd == -1 || epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event) == -1){
+        printf("Unable to create the event loop: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    //no SA_RESTART, a signal wakes epoll_wait up
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = server_request_stop;
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    server.workers = (pthread_t*)malloc(server.num_workers * sizeof(pthread_t));
+    for(uint32_t i = 0; i < server.num_workers; i++)
+        pthread_create(&(server.workers[i]), NULL, server_worker, &server);
+
+    printf("Listening on %s with %d workers.\n", socket_path, server.num_workers);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while(!server_stop_requested){
+        int num_events = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        for(int i = 0; i < num_events; i++){
+            if(events[i].data.ptr == NULL)
+                server_accept(&server);
+            else
+                server_enqueue(&server, (ServerConnection*)events[i].data.ptr);
+        }
+    }
+
+    //let the workers finish what is queued
+    pthread_mutex_lock(&(server.queue_lock));
+    server.stopping = true;
+    pthread_cond_broadcast(&(server.queue_ready));
+    pthread_mutex_unlock(&(server.queue_lock));
+    for(uint32_t i = 0; i < server.num_workers; i++)
+        pthread_join(server.workers[i], NULL);
+    //idle clients still on the loop and the ones parked behind a writer
+    while(server.num_connections > 0)
+        server_close_connection(&server, server.connections[0]);
+
+    close(server.listen_fd);
+    close(server.epoll_fd);
+    unlink(socket_path);
+    pthread_mutex_destroy(&(server.queue_lock));
+    pthread_cond_destroy(&(server.queue_ready));
+    free(server.workers);
+    free(server.queue);
+    free(server.waiting);
+    free(server.connections);
+}
+
+#endif
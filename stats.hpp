@@ -0,0 +1,230 @@
+#ifndef STATS
+#define STATS
+#include "mainrepl_struct.hpp"
+
+//counters of the calling thread, NULL until it counts something
+__thread ThreadStats*   stats_thread    = NULL;
+//blocks of all threads, new ones are pushed at the head under stats_lock
+ThreadStats*            stats_threads   = NULL;
+pthread_mutex_t         stats_lock      = PTHREAD_MUTEX_INITIALIZER;
+//totals at the last .stats reset, subtracted from what is shown
+ThreadStats             stats_baseline;
+
+const char* const STAT_COUNTER_NAMES[NUM_STAT_COUNTERS] = {
+    "page_hits", "page_misses", "page_evictions", "page_copies", "version_spills", "bytes_read",
+    "bytes_written", "wal_bytes_written", "wal_syncs", "leaf_splits", "internal_splits", "descents",
+    "descent_levels", "rows_inserted", "rows_deleted", "rows_sent"
+};
+
+const char* const STAT_HISTOGRAM_NAMES[NUM_STAT_HISTOGRAMS] = {
+    "insert", "select", "delete", "page_read", "commit", "checkpoint"
+};
+
+/*
+*function to get the counters of the calling thread, made on its first use
+*@returns pointer to the thread's block
+*/
+ThreadStats* stats_local(){
+    if(stats_thread != NULL)
+        return stats_thread;
+    stats_thread = (ThreadStats*)calloc(1, sizeof(ThreadStats));
+    pthread_mutex_lock(&stats_lock);
+    stats_thread->next  = stats_threads;
+    stats_threads       = stats_thread;
+    pthread_mutex_unlock(&stats_lock);
+    return stats_thread;
+}
+
+/*
+*function to add to a counter of the calling thread, a plain add other threads read without tearing
+*@param counter     the counter
+*@param amount      how much to add
+*/
+void stats_count(StatCounter counter, uint64_t amount){
+    uint64_t* value = &(stats_local()->counters[counter]);
+    __atomic_store_n(value, *value + amount, __ATOMIC_RELAXED);
+}
+
+/*
+*function to read the monotonic clock for a latency
+*@returns the time in ns
+*/
+uint64_t stats_now(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/*
+*function to add a latency to a histogram of the calling thread
+*@param histogram   the histogram
+*@param start       stats_now() when the timed work started
+*/
+void stats_time(StatHistogram histogram, uint64_t start){
+    uint64_t    ns      = stats_now() - start;
+    uint32_t    bucket  = ns ? 64 - __builtin_clzll(ns) : 0;
+    if(bucket >= STATS_HISTOGRAM_BUCKETS)
+        bucket = STATS_HISTOGRAM_BUCKETS - 1;
+    uint64_t*   value   = &(stats_local()->histograms[histogram][bucket]);
+    __atomic_store_n(value, *value + 1, __ATOMIC_RELAXED);
+    value               = &(stats_local()->latency_sums[histogram]);
+    __atomic_store_n(value, *value + ns, __ATOMIC_RELAXED);
+    //a reset clears it from another thread
+    value               = &(stats_local()->latency_maxes[histogram]);
+    if(ns > __atomic_load_n(value, __ATOMIC_RELAXED))
+        __atomic_store_n(value, ns, __ATOMIC_RELAXED);
+}
+
+/*
+*function to add up the counters of all threads since the last reset
+*@param total       pointer to the block to fill, its next is left alone
+*/
+void stats_collect(ThreadStats* total){
+    memset(total->counters, 0, sizeof(total->counters));
+    memset(total->histograms, 0, sizeof(total->histograms));
+    memset(total->latency_sums, 0, sizeof(total->latency_sums));
+    memset(total->latency_maxes, 0, sizeof(total->latency_maxes));
+
+    pthread_mutex_lock(&stats_lock);
+    for(ThreadStats* block = stats_threads; block != NULL; block = block->next){
+        for(uint32_t i = 0; i < NUM_STAT_COUNTERS; i++)
+            total->counters[i] += __atomic_load_n(&(block->counters[i]), __ATOMIC_RELAXED);
+        for(uint32_t i = 0; i < NUM_STAT_HISTOGRAMS; i++){
+            total->latency_sums[i] += __atomic_load_n(&(block->latency_sums[i]), __ATOMIC_RELAXED);
+            uint64_t max            = __atomic_load_n(&(block->latency_maxes[i]), __ATOMIC_RELAXED);
+            if(max > total->latency_maxes[i])
+                total->latency_maxes[i] = max;
+            for(uint32_t j = 0; j < STATS_HISTOGRAM_BUCKETS; j++)
+                total->histograms[i][j] += __atomic_load_n(&(block->histograms[i][j]), __ATOMIC_RELAXED);
+        }
+    }
+    for(uint32_t i = 0; i < NUM_STAT_COUNTERS; i++)
+        total->counters[i] -= stats_baseline.counters[i];
+    for(uint32_t i = 0; i < NUM_STAT_HISTOGRAMS; i++){
+        total->latency_sums[i] -= stats_baseline.latency_sums[i];
+        for(uint32_t j = 0; j < STATS_HISTOGRAM_BUCKETS; j++)
+            total->histograms[i][j] -= stats_baseline.histograms[i][j];
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+*function to start counting from zero again, the threads keep adding to their blocks
+*and the totals so far are subtracted from then on, a maximum cannot be subtracted so it is cleared
+*/
+void stats_reset(){
+    ThreadStats total;
+    stats_collect(&total);
+    pthread_mutex_lock(&stats_lock);
+    for(uint32_t i = 0; i < NUM_STAT_COUNTERS; i++)
+        stats_baseline.counters[i] += total.counters[i];
+    for(uint32_t i = 0; i < NUM_STAT_HISTOGRAMS; i++){
+        stats_baseline.latency_sums[i] += total.latency_sums[i];
+        for(uint32_t j = 0; j < STATS_HISTOGRAM_BUCKETS; j++)
+            stats_baseline.histograms[i][j] += total.histograms[i][j];
+    }
+    for(ThreadStats* block = stats_threads; block != NULL; block = block->next)
+        for(uint32_t i = 0; i < NUM_STAT_HISTOGRAMS; i++)
+            __atomic_store_n(&(block->latency_maxes[i]), 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+*function to get a percentile of a histogram
+*@param buckets     the buckets of the histogram
+*@param percent     0-100
+*@returns the upper bound of the bucket holding the percentile in ns, 0 for an empty histogram
+*/
+uint64_t stats_percentile(const uint64_t* buckets, double percent){
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+        total += buckets[i];
+    if(total == 0)
+        return 0;
+
+    uint64_t rank   = (uint64_t)(percent / 100.0 * total);
+    if(rank >= total)
+        rank = total - 1;
+    uint64_t seen   = 0;
+    for(uint32_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++){
+        seen += buckets[i];
+        if(seen > rank)
+            return 1ull << i;
+    }
+    return 1ull << (STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+/*
+*function to print the counters, the latencies and the shape of the tree
+*@param total       pointer to the counters of all threads, from stats_collect
+*@param tree        pointer to the shape of the tree
+*@param json        one JSON object on a line instead of the text table
+*/
+void stats_print(ThreadStats* total, TreeStats* tree, bool json){
+    uint64_t*   counters    = total->counters;
+    double      fill        = tree->leaf_nodes ? 100.0 * tree->leaf_bytes_used /
+                              ((double)tree->leaf_nodes * LEAF_NODE_SPACE_FOR_CELLS) : 0;
+    uint64_t    lookups     = counters[STAT_PAGE_HITS] + counters[STAT_PAGE_MISSES];
+    double      hit_rate    = lookups ? 100.0 * counters[STAT_PAGE_HITS] / lookups : 0;
+    double      depth       = counters[STAT_DESCENTS] ?
+                              (double)counters[STAT_DESCENT_LEVELS] / counters[STAT_DESCENTS] : 0;
+
+    if(json){
+        printf("{\"tree\":{\"height\":%u,\"pages\":%u,\"free_pages\":%u,\"internal_nodes\":%u,\"leaf_nodes\":%u,"
+               "\"rows\":%llu,\"leaf_fill_percent\":%.1f},\"counters\":{", tree->height, tree->num_pages,
+               tree->free_pages, tree->internal_nodes, tree->leaf_nodes, (unsigned long long)tree->rows, fill);
+        for(uint32_t i = 0; i < NUM_STAT_COUNTERS; i++)
+            printf("%s\"%s\":%llu", i ? "," : "", STAT_COUNTER_NAMES[i], (unsigned long long)counters[i]);
+        printf("},\"latency_ns\":{");
+        for(uint32_t i = 0; i < NUM_STAT_HISTOGRAMS; i++){
+            uint64_t count = 0;
+            for(uint32_t j = 0; j < STATS_HISTOGRAM_BUCKETS; j++)
+                count += total->histograms[i][j];
+            printf("%s\"%s\":{\"count\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu,\"buckets\":[",
+                   i ? "," : "", STAT_HISTOGRAM_NAMES[i], (unsigned long long)count,
+                   (unsigned long long)(count ? total->latency_sums[i] / count : 0),
+                   (unsigned long long)stats_percentile(total->histograms[i], 50),
+                   (unsigned long long)stats_percentile(total->histograms[i], 90),
+                   (unsigned long long)stats_percentile(total->histograms[i], 99),
+                   (unsigned long long)total->latency_maxes[i]);
+            for(uint32_t j = 0; j < STATS_HISTOGRAM_BUCKETS; j++)
+                printf("%s%llu", j ? "," : "", (unsigned long long)total->histograms[i][j]);
+            printf("]}");
+        }
+        printf("}}\n");
+        return;
+    }
+
+    printf("tree:     height %u, %u pages (%u free), %u internal nodes, %u leaves, %llu rows, leaves %.1f%% full\n",
+           tree->height, tree->num_pages, tree->free_pages, tree->internal_nodes, tree->leaf_nodes,
+           (unsigned long long)tree->rows, fill);
+    printf("pager:    %llu hits, %llu misses (%.1f%% hit rate), %llu evictions, %llu copies, %llu versions spilled, "
+           "%llu bytes read, %llu bytes written\n",
+           (unsigned long long)counters[STAT_PAGE_HITS], (unsigned long long)counters[STAT_PAGE_MISSES], hit_rate,
+           (unsigned long long)counters[STAT_PAGE_EVICTIONS], (unsigned long long)counters[STAT_PAGE_COPIES],
+           (unsigned long long)counters[STAT_VERSION_SPILLS],
+           (unsigned long long)counters[STAT_BYTES_READ], (unsigned long long)counters[STAT_BYTES_WRITTEN]);
+    printf("log:      %llu bytes written, %llu syncs\n",
+           (unsigned long long)counters[STAT_WAL_BYTES_WRITTEN], (unsigned long long)counters[STAT_WAL_SYNCS]);
+    printf("btree:    %llu leaf splits, %llu internal splits, %llu descents of %.2f levels on average\n",
+           (unsigned long long)counters[STAT_LEAF_SPLITS], (unsigned long long)counters[STAT_INTERNAL_SPLITS],
+           (unsigned long long)counters[STAT_DESCENTS], depth);
+    printf("rows:     %llu inserted, %llu deleted, %llu sent by selects\n",
+           (unsigned long long)counters[STAT_ROWS_INSERTED], (unsigned long long)counters[STAT_ROWS_DELETED],
+           (unsigned long long)counters[STAT_ROWS_SENT]);
+    //percentiles are the upper bounds of power of two buckets, max is the slowest latency measured
+    printf("%-12s %10s %10s %10s %10s %10s %10s\n", "latency ns", "count", "mean", "p50", "p90", "p99", "max");
+    for(uint32_t i = 0; i < NUM_STAT_HISTOGRAMS; i++){
+        uint64_t count = 0;
+        for(uint32_t j = 0; j < STATS_HISTOGRAM_BUCKETS; j++)
+            count += total->histograms[i][j];
+        printf("%-12s %10llu %10llu %10llu %10llu %10llu %10llu\n", STAT_HISTOGRAM_NAMES[i], (unsigned long long)count,
+               (unsigned long long)(count ? total->latency_sums[i] / count : 0),
+               (unsigned long long)stats_percentile(total->histograms[i], 50),
+               (unsigned long long)stats_percentile(total->histograms[i], 90),
+               (unsigned long long)stats_percentile(total->histograms[i], 99),
+               (unsigned long long)total->latency_maxes[i]);
+    }
+}
+
+#endif
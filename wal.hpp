@@ -0,0 +1,415 @@
+#ifndef WAL
+#define WAL
+#include "mainrepl_struct.hpp"
+#include "stats.hpp"
+
+/*
+*function to checksum a buffer of 32 bit words
+*@param buffer      pointer to the words
+*@param length      length of the buffer in bytes, a multiple of 8
+*@param seed        checksum to continue from
+*@returns the checksum
+*/
+uint32_t wal_checksum(const void* buffer, uint32_t length, uint32_t seed){
+    const uint32_t* words = (const uint32_t*)buffer;
+    uint32_t s0 = seed;
+    uint32_t s1 = 0;
+    for(uint32_t i = 0; i < length / sizeof(uint32_t); i += 2){
+        s0 += words[i] + s1;
+        s1 += words[i + 1] + s0;
+    }
+    return s0 ^ s1;
+}
+
+/*
+*function to checksum the log header, covers the fields before the checksum
+*@param header  pointer to the log header
+*@returns the checksum
+*/
+uint32_t wal_header_checksum(WalHeader* header){
+    uint32_t fields[4] = {header->magic, header->page_size, header->salt, 0};
+    return wal_checksum(fields, sizeof(fields), 0);
+}
+
+/*
+*function to checksum a frame, covers the header fields before the checksum and the page
+*@param header  pointer to the frame header
+*@param page    pointer to the page image
+*@returns the checksum
+*/
+uint32_t wal_frame_checksum(WalFrameHeader* header, const void* page){
+    uint32_t fields[4] = {header->page_num, header->commit_num_pages, header->salt, 0};
+    return wal_checksum(page, PAGE_SIZE, wal_checksum(fields, sizeof(fields), 0));
+}
+
+/*
+*function to find the index slot of a page
+*@param wal         pointer to the log
+*@param page_num    page number to look for
+*@returns the slot holding the page, or the empty slot where it belongs
+*/
+uint32_t wal_index_slot(Wal* wal, uint32_t page_num){
+    uint32_t slot = (page_num * 2654435761u) & (wal->index_size - 1);
+    while(wal->index_pages[slot] != UINT32_MAX && wal->index_pages[slot] != page_num)
+        slot = (slot + 1) & (wal->index_size - 1);
+    return slot;
+}
+
+/*
+*function to record the offset of the latest frame of a page, the frame it replaces is
+*kept as the page's committed frame when it was committed, for readers of the last commit
+*@param wal         pointer to the log
+*@param page_num    page number of the frame
+*@param offset      offset of the frame in the log file
+*/
+void wal_index_put(Wal* wal, uint32_t page_num, uint64_t offset){
+    //keep the index at most half full, rehash into twice the size
+    if((wal->index_count + 1) * 2 > wal->index_size){
+        uint32_t    old_size        = wal->index_size;
+        uint32_t*   old_pages       = wal->index_pages;
+        uint64_t*   old_offsets     = wal->index_offsets;
+        uint64_t*   old_committed   = wal->index_committed;
+
+        wal->index_size         = old_size * 2;
+        wal->index_pages        = (uint32_t*)malloc(wal->index_size * sizeof(uint32_t));
+        wal->index_offsets      = (uint64_t*)malloc(wal->index_size * sizeof(uint64_t));
+        wal->index_committed    = (uint64_t*)malloc(wal->index_size * sizeof(uint64_t));
+        memset(wal->index_pages, 0xff, wal->index_size * sizeof(uint32_t));
+
+        for(uint32_t i = 0; i < old_size; i++){
+            if(old_pages[i] == UINT32_MAX)
+                continue;
+            uint32_t slot = wal_index_slot(wal, old_pages[i]);
+            wal->index_pages[slot]      = old_pages[i];
+            wal->index_offsets[slot]    = old_offsets[i];
+            wal->index_committed[slot]  = old_committed[i];
+        }
+        free(old_pages);
+        free(old_offsets);
+        free(old_committed);
+    }
+
+    uint32_t slot = wal_index_slot(wal, page_num);
+    if(wal->index_pages[slot] == UINT32_MAX){
+        wal->index_count++;
+        wal->index_committed[slot]  = 0;
+    }
+    else if(wal->index_offsets[slot] < wal->commit_length)
+        wal->index_committed[slot]  = wal->index_offsets[slot];
+    wal->index_pages[slot]      = page_num;
+    wal->index_offsets[slot]    = offset;
+}
+
+/*
+*function to find the latest frame of a page in the log
+*@param wal         pointer to the log
+*@param page_num    page number to look for
+*@returns offset of the frame, 0 if the page is not in the log
+*/
+uint64_t wal_lookup(Wal* wal, uint32_t page_num){
+    uint32_t slot = wal_index_slot(wal, page_num);
+    return wal->index_pages[slot] == UINT32_MAX ? 0 : wal->index_offsets[slot];
+}
+
+/*
+*function to find the frame of a page as of the last commit, frames the open transaction spilled are passed over
+*@param wal         pointer to the log
+*@param page_num    page number to look for
+*@returns offset of the frame, 0 if the committed page is in the db file
+*/
+uint64_t wal_lookup_committed(Wal* wal, uint32_t page_num){
+    uint32_t slot = wal_index_slot(wal, page_num);
+    if(wal->index_pages[slot] == UINT32_MAX)
+        return 0;
+    return wal->index_offsets[slot] < wal->commit_length ? wal->index_offsets[slot] : wal->index_committed[slot];
+}
+
+/*
+*function to check if the open transaction spilled a page to the log
+*@param wal         pointer to the log
+*@param page_num    page number to look for
+*@returns true if the latest frame of the page is past the last commit
+*/
+bool wal_spilled(Wal* wal, uint32_t page_num){
+    uint32_t slot = wal_index_slot(wal, page_num);
+    return wal->index_pages[slot] != UINT32_MAX && wal->index_offsets[slot] >= wal->commit_length;
+}
+
+/*
+*function to read the page image of a frame
+*@param wal         pointer to the log
+*@param offset      offset of the frame in the log file
+*@param page        buffer of PAGE_SIZE bytes to read into
+*/
+void wal_read_page(Wal* wal, uint64_t offset, void* page){
+    ssize_t bytes_read = pread(wal->file_descriptor, page, PAGE_SIZE, offset + sizeof(WalFrameHeader));
+    if(bytes_read != PAGE_SIZE){
+        printf("Error reading the write-ahead log: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+*function to append a page image to the log, it is not synced
+*@param wal                 pointer to the log
+*@param page_num            page number of the image
+*@param page                pointer to the page image
+*@param commit_num_pages    db size in pages if the frame ends a commit, else 0
+*/
+void wal_append(Wal* wal, uint32_t page_num, const void* page, uint32_t commit_num_pages){
+    WalFrameHeader header;
+    header.page_num         = page_num;
+    header.commit_num_pages = commit_num_pages;
+    header.salt             = wal->salt;
+    header.checksum         = wal_frame_checksum(&header, page);
+
+    struct iovec parts[2] = {{&header, sizeof(header)}, {(void*)page, PAGE_SIZE}};
+    ssize_t bytes_written = pwritev(wal->file_descriptor, parts, 2, wal->length);
+    if(bytes_written != (ssize_t)(sizeof(header) + PAGE_SIZE)){
+        printf("Error writing the write-ahead log: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&(wal->lock));
+    wal_index_put(wal, page_num, wal->length);
+    wal->length += sizeof(header) + PAGE_SIZE;
+    wal->num_frames++;
+    if(commit_num_pages != 0)
+        wal->commit_length = wal->length;
+    pthread_mutex_unlock(&(wal->lock));
+    stats_count(STAT_WAL_BYTES_WRITTEN, sizeof(header) + PAGE_SIZE);
+}
+
+/*
+*function to wait until the log is on disk up to an offset (group commit)
+*the first committer to arrive syncs everything appended so far,
+*committers arriving during that sync wait and are covered by the next one
+*@param wal         pointer to the log
+*@param offset      end of the commit that has to be durable
+*/
+void wal_sync_to(Wal* wal, uint64_t offset){
+    pthread_mutex_lock(&(wal->lock));
+    while(wal->synced_length < offset){
+        if(wal->sync_in_progress){
+            pthread_cond_wait(&(wal->synced), &(wal->lock));
+            continue;
+        }
+
+        wal->sync_in_progress   = true;
+        uint64_t target         = wal->length;
+        pthread_mutex_unlock(&(wal->lock));
+
+        if(fdatasync(wal->file_descriptor) == -1){
+            printf("Error syncing the write-ahead log: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        stats_count(STAT_WAL_SYNCS, 1);
+
+        pthread_mutex_lock(&(wal->lock));
+        wal->synced_length      = target;
+        wal->sync_in_progress   = false;
+        pthread_cond_broadcast(&(wal->synced));
+    }
+    pthread_mutex_unlock(&(wal->lock));
+}
+
+/*
+*function to drop the frames the open transaction spilled, the log ends at the last commit again
+*and the index points at the committed frames, pages only the transaction logged leave it
+*@param wal     pointer to the log
+*/
+void wal_rollback(Wal* wal){
+    pthread_mutex_lock(&(wal->lock));
+    if(wal->length > wal->commit_length){
+        uint32_t*   pages   = (uint32_t*)malloc(wal->index_size * sizeof(uint32_t));
+        uint64_t*   offsets = (uint64_t*)malloc(wal->index_size * sizeof(uint64_t));
+        uint32_t    count   = 0;
+        for(uint32_t slot = 0; slot < wal->index_size; slot++){
+            if(wal->index_pages[slot] == UINT32_MAX)
+                continue;
+            uint64_t offset = wal->index_offsets[slot] < wal->commit_length ? wal->index_offsets[slot] : wal->index_committed[slot];
+            if(offset != 0){
+                pages[count]    = wal->index_pages[slot];
+                offsets[count]  = offset;
+                count++;
+            }
+        }
+
+        //rebuilt rather than emptied slot by slot, open addressing leaves no holes
+        memset(wal->index_pages, 0xff, wal->index_size * sizeof(uint32_t));
+        for(uint32_t i = 0; i < count; i++){
+            uint32_t slot = wal_index_slot(wal, pages[i]);
+            wal->index_pages[slot]      = pages[i];
+            wal->index_offsets[slot]    = offsets[i];
+            wal->index_committed[slot]  = 0;
+        }
+        wal->index_count    = count;
+        free(pages);
+        free(offsets);
+
+        wal->num_frames    -= (wal->length - wal->commit_length) / (sizeof(WalFrameHeader) + PAGE_SIZE);
+        wal->length         = wal->commit_length;
+        if(wal->synced_length > wal->length)
+            wal->synced_length = wal->length;
+        if(ftruncate(wal->file_descriptor, wal->length) == -1){
+            printf("Error truncating the write-ahead log: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_mutex_unlock(&(wal->lock));
+}
+
+/*
+*function to empty the log after a checkpoint, a new salt invalidates any stale frames
+*@param wal     pointer to the log
+*/
+void wal_reset(Wal* wal){
+    wal->salt = wal->salt * 1103515245u + 12345u;
+
+    WalHeader header;
+    header.magic        = WAL_MAGIC;
+    header.page_size    = PAGE_SIZE;
+    header.salt         = wal->salt;
+    header.checksum     = wal_header_checksum(&header);
+
+    if(ftruncate(wal->file_descriptor, 0) == -1 ||
+       pwrite(wal->file_descriptor, &header, sizeof(header), 0) != sizeof(header) ||
+       fdatasync(wal->file_descriptor) == -1){
+        printf("Error resetting the write-ahead log: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    wal->length         = sizeof(header);
+    wal->synced_length  = sizeof(header);
+    wal->commit_length  = sizeof(header);
+    wal->num_frames     = 0;
+    wal->index_count    = 0;
+    memset(wal->index_pages, 0xff, wal->index_size * sizeof(uint32_t));
+}
+
+/*
+*function to scan the log for committed frames after a restart,
+*frames after the last commit or after a torn write are ignored
+*@param wal     pointer to the log
+*@returns db size in pages recorded by the last commit, 0 if nothing was committed
+*/
+uint32_t wal_recover(Wal* wal){
+    WalHeader   header;
+    uint32_t    num_pages   = 0;
+    off_t       file_length = lseek(wal->file_descriptor, 0, SEEK_END);
+
+    if(pread(wal->file_descriptor, &header, sizeof(header), 0) != sizeof(header) ||
+       header.magic != WAL_MAGIC || header.page_size != PAGE_SIZE ||
+       header.checksum != wal_header_checksum(&header))
+        return 0;
+
+    wal->salt   = header.salt;
+    wal->length = sizeof(header);
+
+    //frames of the commit being read, only indexed once its commit frame shows up
+    void*       page        = malloc(PAGE_SIZE);
+    uint64_t    offset      = sizeof(header);
+    uint32_t*   pending     = NULL;
+    uint64_t*   pending_at  = NULL;
+    uint32_t    num_pending = 0;
+    uint32_t    capacity    = 0;
+
+    while(offset + sizeof(WalFrameHeader) + PAGE_SIZE <= (uint64_t)file_length){
+        WalFrameHeader frame;
+        if(pread(wal->file_descriptor, &frame, sizeof(frame), offset) != sizeof(frame))
+            break;
+        wal_read_page(wal, offset, page);
+        if(frame.salt != wal->salt || frame.checksum != wal_frame_checksum(&frame, page))
+            break;
+
+        if(num_pending == capacity){
+            capacity    = capacity ? capacity * 2 : 64;
+            pending     = (uint32_t*)realloc(pending, capacity * sizeof(uint32_t));
+            pending_at  = (uint64_t*)realloc(pending_at, capacity * sizeof(uint64_t));
+        }
+        pending[num_pending]    = frame.page_num;
+        pending_at[num_pending] = offset;
+        num_pending++;
+        offset += sizeof(frame) + PAGE_SIZE;
+
+        if(frame.commit_num_pages != 0){
+            for(uint32_t i = 0; i < num_pending; i++)
+                wal_index_put(wal, pending[i], pending_at[i]);
+            wal->num_frames += num_pending;
+            wal->length     = offset;
+            num_pages       = frame.commit_num_pages;
+            num_pending     = 0;
+        }
+    }
+
+    wal->synced_length = wal->length;
+    wal->commit_length = wal->length;
+    free(page);
+    free(pending);
+    free(pending_at);
+    return num_pages;
+}
+
+/*
+*function to check if a db has a write-ahead log file
+*@param filename    name of the db file
+*@returns true if "<db file>-wal" exists
+*/
+bool wal_exists(const char* filename){
+    char* wal_name = (char*)malloc(strlen(filename) + 5);
+    sprintf(wal_name, "%s-wal", filename);
+    bool exists = access(wal_name, F_OK) == 0;
+    free(wal_name);
+    return exists;
+}
+
+/*
+*function to open the write-ahead log of a db, "<db file>-wal"
+*@param filename    name of the db file
+*@returns a pointer to the log, with the committed frames of a previous run indexed
+*/
+Wal* wal_open(const char* filename){
+    char* wal_name = (char*)malloc(strlen(filename) + 5);
+    sprintf(wal_name, "%s-wal", filename);
+    int fd = open(wal_name, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+    free(wal_name);
+
+    if(fd == -1){
+        printf("Unable to open the write-ahead log.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Wal* wal                = (Wal*)malloc(sizeof(Wal));
+    wal->file_descriptor    = fd;
+    wal->salt               = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+    wal->length             = 0;
+    wal->synced_length      = 0;
+    wal->commit_length      = 0;
+    wal->num_frames         = 0;
+    wal->index_size         = 1024;
+    wal->index_count        = 0;
+    wal->index_pages        = (uint32_t*)malloc(wal->index_size * sizeof(uint32_t));
+    wal->index_offsets      = (uint64_t*)malloc(wal->index_size * sizeof(uint64_t));
+    wal->index_committed    = (uint64_t*)malloc(wal->index_size * sizeof(uint64_t));
+    wal->sync_in_progress   = false;
+    memset(wal->index_pages, 0xff, wal->index_size * sizeof(uint32_t));
+    pthread_mutex_init(&(wal->lock), NULL);
+    pthread_cond_init(&(wal->synced), NULL);
+    return wal;
+}
+
+/*
+*function to close the log, it is left on disk for recovery if it has frames
+*@param wal     pointer to the log
+*/
+void wal_close(Wal* wal){
+    close(wal->file_descriptor);
+    pthread_mutex_destroy(&(wal->lock));
+    pthread_cond_destroy(&(wal->synced));
+    free(wal->index_pages);
+    free(wal->index_offsets);
+    free(wal->index_committed);
+    free(wal);
+}
+
+#endif